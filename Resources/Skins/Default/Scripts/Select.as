@@ -82,6 +82,10 @@ class Title : CoroutineScene {
     }
     InitCursor();
     while(true) {
+      if (cursor.CheckUpdate()) {
+        isCategory = cursor.GetState() == CursorState::Category;
+        InitCursor();
+      }
       YieldFrame(1);
     }
   }
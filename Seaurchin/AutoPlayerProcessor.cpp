@@ -36,9 +36,10 @@ void AutoPlayerProcessor::Reset()
         }
     }
     player->currentResult->SetAllNotes(an);
+    BuildSoundEvents();
 }
 
-bool AutoPlayerProcessor::ShouldJudge(const std::shared_ptr<SusDrawableNoteData> note)
+bool AutoPlayerProcessor::ShouldJudge(const std::shared_ptr<SusDrawableNoteData> &note)
 {
     const auto current = player->currentTime - note->StartTime + player->soundBufferingLatency;
     const auto extra = 0.5;
@@ -51,8 +52,15 @@ bool AutoPlayerProcessor::ShouldJudge(const std::shared_ptr<SusDrawableNoteData>
     return false;
 }
 
+double AutoPlayerProcessor::GetJudgeMargin() const
+{
+    return 0.5 + fabs(player->soundBufferingLatency);
+}
+
 void AutoPlayerProcessor::Update(vector<shared_ptr<SusDrawableNoteData>> &notes)
 {
+    ScheduleSounds();
+
     auto slideCheck = false;
     auto holdCheck = false;
     auto aaCheck = false;
@@ -89,6 +97,13 @@ void AutoPlayerProcessor::MovePosition(const double relative)
     player->EnqueueJudgeSound(JudgeSoundType::AirHoldingStop);
     player->RemoveSlideEffect();
 
+    // 予約済みの判定音は取り消して、新しい位置から予約し直す
+    player->CancelScheduledJudgeSounds();
+    for (auto &event : soundEvents) get<2>(event)->OnTheFlyData.reset(size_t(NoteAttribute::SoundScheduled));
+    nextSoundEvent = lower_bound(soundEvents.begin(), soundEvents.end(), newTime, [](const decltype(soundEvents)::value_type &event, const double time) {
+        return get<0>(event) < time;
+    }) - soundEvents.begin();
+
     // 送り: 飛ばした部分をFinishedに
     // 戻し: 入ってくる部分をUn-Finishedに
     for (auto &note : data) {
@@ -141,9 +156,9 @@ void AutoPlayerProcessor::ProcessScore(const shared_ptr<SusDrawableNoteData>& no
     if (note->Type.test(size_t(SusNoteType::Hold))) {
         isInHold = true;
         if (!note->OnTheFlyData.test(size_t(NoteAttribute::Finished))) {
-            player->EnqueueJudgeSound(JudgeSoundType::Tap);
+            EnqueueNoteSound(note, JudgeSoundType::Tap);
             player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
-            IncrementCombo({ AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length }, "");
+            IncrementCombo(note, { AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length }, "");
             note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
         }
 
@@ -155,23 +170,23 @@ void AutoPlayerProcessor::ProcessScore(const shared_ptr<SusDrawableNoteData>& no
             if (extra->Type.test(size_t(SusNoteType::End))) isInHold = false;
             if (extra->OnTheFlyData.test(size_t(NoteAttribute::Finished))) continue;
             if (extra->Type[size_t(SusNoteType::Injection)]) {
-                IncrementCombo({ AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length }, "");
+                IncrementCombo(extra, { AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length }, "");
                 extra->OnTheFlyData.set(size_t(NoteAttribute::Finished));
                 return;
             }
-            player->EnqueueJudgeSound(JudgeSoundType::HoldStep);
+            EnqueueNoteSound(extra, JudgeSoundType::HoldStep);
             player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
-            IncrementCombo({ AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length }, "");
+            IncrementCombo(extra, { AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length }, "");
             extra->OnTheFlyData.set(size_t(NoteAttribute::Finished));
             return;
         }
     } else if (note->Type.test(size_t(SusNoteType::Slide))) {
         isInSlide = true;
         if (!note->OnTheFlyData.test(size_t(NoteAttribute::Finished))) {
-            player->EnqueueJudgeSound(JudgeSoundType::Tap);
+            EnqueueNoteSound(note, JudgeSoundType::Tap);
             player->SpawnSlideLoopEffect(note);
 
-            IncrementCombo({ AbilityNoteType::Slide, note->StartLane, note->StartLane + note->Length }, "");
+            IncrementCombo(note, { AbilityNoteType::Slide, note->StartLane, note->StartLane + note->Length }, "");
             note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
         }
 
@@ -185,13 +200,13 @@ void AutoPlayerProcessor::ProcessScore(const shared_ptr<SusDrawableNoteData>& no
             if (extra->Type.test(size_t(SusNoteType::Invisible))) continue;
             if (extra->OnTheFlyData.test(size_t(NoteAttribute::Finished))) continue;
             if (extra->Type.test(size_t(SusNoteType::Injection))) {
-                IncrementCombo({ AbilityNoteType::Slide, extra->StartLane, extra->StartLane + extra->Length }, "");
+                IncrementCombo(extra, { AbilityNoteType::Slide, extra->StartLane, extra->StartLane + extra->Length }, "");
                 extra->OnTheFlyData.set(size_t(NoteAttribute::Finished));
                 return;
             }
-            player->EnqueueJudgeSound(JudgeSoundType::SlideStep);
+            EnqueueNoteSound(extra, JudgeSoundType::SlideStep);
             player->SpawnJudgeEffect(extra, JudgeType::SlideTap);
-            IncrementCombo({ AbilityNoteType::Slide, extra->StartLane, extra->StartLane + extra->Length }, "");
+            IncrementCombo(extra, { AbilityNoteType::Slide, extra->StartLane, extra->StartLane + extra->Length }, "");
             extra->OnTheFlyData.set(size_t(NoteAttribute::Finished));
             return;
         }
@@ -208,60 +223,125 @@ void AutoPlayerProcessor::ProcessScore(const shared_ptr<SusDrawableNoteData>& no
             if (extra->Type.test(size_t(SusNoteType::Invisible))) continue;
             if (extra->OnTheFlyData.test(size_t(NoteAttribute::Finished))) continue;
             if (extra->Type[size_t(SusNoteType::Injection)]) {
-                IncrementCombo({ AbilityNoteType::AirAction, extra->StartLane, extra->StartLane + extra->Length }, "");
+                IncrementCombo(extra, { AbilityNoteType::AirAction, extra->StartLane, extra->StartLane + extra->Length }, "");
                 extra->OnTheFlyData.set(size_t(NoteAttribute::Finished));
                 return;
             }
-            player->EnqueueJudgeSound(JudgeSoundType::AirAction);
+            EnqueueNoteSound(extra, JudgeSoundType::AirAction);
             player->SpawnJudgeEffect(extra, JudgeType::Action);
-            IncrementCombo({ AbilityNoteType::AirAction, extra->StartLane, extra->StartLane + extra->Length }, "");
+            IncrementCombo(extra, { AbilityNoteType::AirAction, extra->StartLane, extra->StartLane + extra->Length }, "");
             extra->OnTheFlyData.set(size_t(NoteAttribute::Finished));
         }
     } else if (note->Type.test(size_t(SusNoteType::Air))) {
         if (note->Type[size_t(SusNoteType::Up)]) {
-            player->EnqueueJudgeSound(JudgeSoundType::Air);
+            EnqueueNoteSound(note, JudgeSoundType::Air);
         } else {
-            player->EnqueueJudgeSound(JudgeSoundType::AirDown);
+            EnqueueNoteSound(note, JudgeSoundType::AirDown);
         }
         player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
         player->SpawnJudgeEffect(note, JudgeType::ShortEx);
-        IncrementCombo({ AbilityNoteType::Air, note->StartLane, note->StartLane + note->Length }, "");
+        IncrementCombo(note, { AbilityNoteType::Air, note->StartLane, note->StartLane + note->Length }, "");
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
     } else if (note->Type.test(size_t(SusNoteType::Tap))) {
-        player->EnqueueJudgeSound(JudgeSoundType::Tap);
+        EnqueueNoteSound(note, JudgeSoundType::Tap);
         player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
-        IncrementCombo({ AbilityNoteType::Tap, note->StartLane, note->StartLane + note->Length }, "");
+        IncrementCombo(note, { AbilityNoteType::Tap, note->StartLane, note->StartLane + note->Length }, "");
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
     } else if (note->Type.test(size_t(SusNoteType::ExTap))) {
-        player->EnqueueJudgeSound(JudgeSoundType::ExTap);
+        EnqueueNoteSound(note, JudgeSoundType::ExTap);
         player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
         player->SpawnJudgeEffect(note, JudgeType::ShortEx);
-        IncrementCombo({ AbilityNoteType::ExTap, note->StartLane, note->StartLane + note->Length }, "");
+        IncrementCombo(note, { AbilityNoteType::ExTap, note->StartLane, note->StartLane + note->Length }, "");
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
     } else if (note->Type.test(size_t(SusNoteType::AwesomeExTap))) {
-        player->EnqueueJudgeSound(JudgeSoundType::ExTap);
+        EnqueueNoteSound(note, JudgeSoundType::ExTap);
         player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
         player->SpawnJudgeEffect(note, JudgeType::ShortEx);
-        IncrementCombo(
+        IncrementCombo(note,
             { AbilityNoteType::AwesomeExTap, note->StartLane, note->StartLane + note->Length },
             note->Type[size_t(SusNoteType::Down)] ? "AwesomeExTapDown" : "AwesomeExTapUp"
         );
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
     } else if (note->Type.test(size_t(SusNoteType::Flick))) {
-        player->EnqueueJudgeSound(JudgeSoundType::Flick);
+        EnqueueNoteSound(note, JudgeSoundType::Flick);
         player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
-        IncrementCombo({ AbilityNoteType::Flick, note->StartLane, note->StartLane + note->Length }, "");
+        IncrementCombo(note, { AbilityNoteType::Flick, note->StartLane, note->StartLane + note->Length }, "");
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
     } else if (note->Type.test(size_t(SusNoteType::HellTap))) {
-        player->EnqueueJudgeSound(JudgeSoundType::Tap);
+        EnqueueNoteSound(note, JudgeSoundType::Tap);
         player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
-        IncrementCombo({ AbilityNoteType::HellTap, note->StartLane, note->StartLane + note->Length }, "");
+        IncrementCombo(note, { AbilityNoteType::HellTap, note->StartLane, note->StartLane + note->Length }, "");
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
     }
 }
 
-void AutoPlayerProcessor::IncrementCombo(const JudgeInformation &info, const string& extra) const
+// ProcessScoreで鳴らす判定音を全部拾っておく
+void AutoPlayerProcessor::BuildSoundEvents()
+{
+    soundEvents.clear();
+    nextSoundEvent = 0;
+    const auto add = [this](const shared_ptr<SusDrawableNoteData> &note, const JudgeSoundType type) {
+        soundEvents.emplace_back(note->StartTime, type, note);
+    };
+    const auto isStep = [](const shared_ptr<SusDrawableNoteData> &extra) {
+        return !extra->Type.test(size_t(SusNoteType::Control))
+            && !extra->Type.test(size_t(SusNoteType::Invisible))
+            && !extra->Type.test(size_t(SusNoteType::Injection));
+    };
+
+    for (const auto &note : data) {
+        if (note->Type.test(size_t(SusNoteType::Hold))) {
+            add(note, JudgeSoundType::Tap);
+            for (const auto &extra : note->ExtraData) if (!extra->Type.test(size_t(SusNoteType::Injection))) add(extra, JudgeSoundType::HoldStep);
+        } else if (note->Type.test(size_t(SusNoteType::Slide))) {
+            add(note, JudgeSoundType::Tap);
+            for (const auto &extra : note->ExtraData) if (isStep(extra)) add(extra, JudgeSoundType::SlideStep);
+        } else if (note->Type.test(size_t(SusNoteType::AirAction))) {
+            for (const auto &extra : note->ExtraData) if (isStep(extra)) add(extra, JudgeSoundType::AirAction);
+        } else if (note->Type.test(size_t(SusNoteType::Air))) {
+            add(note, note->Type[size_t(SusNoteType::Up)] ? JudgeSoundType::Air : JudgeSoundType::AirDown);
+        } else if (note->Type.test(size_t(SusNoteType::Tap)) || note->Type.test(size_t(SusNoteType::HellTap))) {
+            add(note, JudgeSoundType::Tap);
+        } else if (note->Type.test(size_t(SusNoteType::ExTap)) || note->Type.test(size_t(SusNoteType::AwesomeExTap))) {
+            add(note, JudgeSoundType::ExTap);
+        } else if (note->Type.test(size_t(SusNoteType::Flick))) {
+            add(note, JudgeSoundType::Flick);
+        }
+    }
+    stable_sort(soundEvents.begin(), soundEvents.end(), [](const decltype(soundEvents)::value_type &a, const decltype(soundEvents)::value_type &b) {
+        return get<0>(a) != get<0>(b) ? get<0>(a) < get<0>(b) : get<1>(a) < get<1>(b);
+    });
+}
+
+// 判定音を先読みしてBGMに混ぜ込む予約をする
+// 同時刻・同種類の音は1回にまとめる 予約できなかったものはProcessScoreで従来通り鳴らす
+void AutoPlayerProcessor::ScheduleSounds()
+{
+    const auto until = player->currentTime + player->GetJudgeSoundLookahead();
+    while (nextSoundEvent < soundEvents.size()) {
+        const auto time = get<0>(soundEvents[nextSoundEvent]);
+        const auto type = get<1>(soundEvents[nextSoundEvent]);
+        if (time > until) break;
+
+        auto last = nextSoundEvent + 1;
+        while (last < soundEvents.size() && get<0>(soundEvents[last]) == time && get<1>(soundEvents[last]) == type) ++last;
+        // 通り過ぎたものは予約しない
+        if (time >= player->currentTime && player->ScheduleJudgeSound(type, time, int(last - nextSoundEvent))) {
+            for (auto i = nextSoundEvent; i < last; i++) get<2>(soundEvents[i])->OnTheFlyData.set(size_t(NoteAttribute::SoundScheduled));
+        }
+        nextSoundEvent = last;
+    }
+}
+
+void AutoPlayerProcessor::EnqueueNoteSound(const shared_ptr<SusDrawableNoteData>& note, const JudgeSoundType type) const
+{
+    if (note->OnTheFlyData.test(size_t(NoteAttribute::SoundScheduled))) return;
+    player->EnqueueJudgeSound(type);
+}
+
+void AutoPlayerProcessor::IncrementCombo(const shared_ptr<SusDrawableNoteData>& note, const JudgeInformation &info, const string& extra) const
 {
+    player->RecordJudge(note, info, AbilityJudgeType::JusticeCritical);
     player->currentResult->PerformJusticeCritical();
     player->currentCharacterInstance->OnJusticeCritical(info, extra);
 }
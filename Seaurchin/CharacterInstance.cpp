@@ -26,11 +26,12 @@ CharacterInstance::~CharacterInstance()
     if (imageSet) imageSet->Release();
 }
 
-shared_ptr<CharacterInstance> CharacterInstance::CreateInstance(shared_ptr<CharacterParameter> character, shared_ptr<SkillParameter> skill, shared_ptr<AngelScript> script, std::shared_ptr<Result> result)
+shared_ptr<CharacterInstance> CharacterInstance::CreateInstance(shared_ptr<CharacterParameter> character, shared_ptr<SkillParameter> skill, shared_ptr<AngelScript> script, std::shared_ptr<Result> result, const bool loadImages)
 {
     auto ci = make_shared<CharacterInstance>(character, skill, script, result);
     ci->LoadAbilities();
-    ci->CreateImageSet();
+    // リプレイでは立ち絵を使わない
+    if (loadImages) ci->CreateImageSet();
     ci->AddRef();
     return ci;
 }
@@ -270,6 +271,7 @@ SkillIndicators* CharacterInstance::GetSkillIndicators() const
 
 CharacterImageSet* CharacterInstance::GetCharacterImages() const
 {
+    if (!imageSet) return nullptr;
     imageSet->AddRef();
     return imageSet;
 }
@@ -77,7 +77,7 @@ public:
     SkillParameter* GetSkillParameter() const;
     SkillIndicators* GetSkillIndicators() const;
 
-    static std::shared_ptr<CharacterInstance> CreateInstance(std::shared_ptr<CharacterParameter> character, std::shared_ptr<SkillParameter> skill, std::shared_ptr<AngelScript> script, std::shared_ptr<Result> result);
+    static std::shared_ptr<CharacterInstance> CreateInstance(std::shared_ptr<CharacterParameter> character, std::shared_ptr<SkillParameter> skill, std::shared_ptr<AngelScript> script, std::shared_ptr<Result> result, bool loadImages = true);
 };
 
 void RegisterCharacterSkillTypes(asIScriptEngine *engine);
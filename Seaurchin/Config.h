@@ -15,6 +15,7 @@
 #define SU_SKIN_DIR L"Skins"
 #define SU_FONT_DIR L"Fonts"
 #define SU_CACHE_DIR L"Cache"
+#define SU_CACHE_SCORE_DIR L"Scores"
 #define SU_CHARACTER_DIR L"Characters"
 #define SU_MUSIC_DIR L"Music"
 #define SU_SOUND_DIR L"Sounds"
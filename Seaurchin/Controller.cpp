@@ -1,6 +1,12 @@
 ﻿#include "Controller.h"
 
 using namespace std;
+using namespace std::chrono;
+
+ControlState::~ControlState()
+{
+    StopSampling();
+}
 
 void ControlState::Initialize()
 {
@@ -11,6 +17,10 @@ void ControlState::Initialize()
     ZeroMemory(integratedSliderLast, sizeof(bool) * 16);
     ZeroMemory(integratedSliderTrigger, sizeof(bool) * 16);
     ZeroMemory(integratedAir, sizeof(bool) * 4);
+    ZeroMemory(sampledSliderHeld, sizeof(bool) * 16);
+    ZeroMemory(sampledAirHeld, sizeof(bool) * 4);
+    fill_n(sliderTriggerDelay, 16, 0.0);
+    fill_n(airTriggerDelay, 4, 0.0);
 
     sliderKeyboardInputCombinations[0] = { KEY_INPUT_A };
     sliderKeyboardInputCombinations[1] = { KEY_INPUT_Z };
@@ -36,10 +46,111 @@ void ControlState::Initialize()
 
 void ControlState::Terminate()
 {
+    StopSampling();
+}
+
+int64_t ControlState::GetTimestamp()
+{
+    return duration_cast<nanoseconds>(high_resolution_clock::now().time_since_epoch()).count();
+}
+
+void ControlState::StartSampling(const int rate)
+{
+    if (rate <= 0 || IsSampling()) return;
+
+    // DxLibのKEY_INPUT_*はDirectInputのスキャンコードなので仮想キーコードに直しておく
+    const auto toVirtualKeys = [](const vector<int> &keys) {
+        vector<int> result;
+        for (const auto &key : keys) {
+            const auto scan = UINT((key & 0x80) ? (0xE000 | (key & 0x7F)) : key);
+            const auto vk = MapVirtualKey(scan, MAPVK_VSC_TO_VK_EX);
+            if (vk) result.push_back(int(vk));
+        }
+        return result;
+    };
+    vector<vector<int>> sliderKeys, airKeys;
+    for (const auto &keys : sliderKeyboardInputCombinations) sliderKeys.push_back(toVirtualKeys(keys));
+    for (const auto &keys : airStringKeyboardInputCombinations) airKeys.push_back(toVirtualKeys(keys));
+
+    ZeroMemory(sampledSliderHeld, sizeof(bool) * 16);
+    ZeroMemory(sampledAirHeld, sizeof(bool) * 4);
+    sampledEvents.reset();
+    samplingActive = true;
+    samplingThread = thread([this, sliderKeys, airKeys, rate] { SampleInputs(sliderKeys, airKeys, rate); });
+}
+
+void ControlState::StopSampling()
+{
+    if (!IsSampling()) return;
+    samplingActive = false;
+    samplingThread.join();
+    sampledEvents.reset();
+}
+
+// サンプリングスレッド本体
+// rate Hzで非同期キー状態を読み、スライダー・エアストリングごとに
+// 押下キーが増えたら押下、全部離れたら離しのイベントを積む
+void ControlState::SampleInputs(const vector<vector<int>> sliderKeys, const vector<vector<int>> airKeys, const int rate)
+{
+    timeBeginPeriod(1);
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+
+    const auto window = GetMainWindowHandle();
+    const auto interval = nanoseconds(1000000000 / rate);
+    vector<uint32_t> sliderPrevious(sliderKeys.size(), 0);
+    vector<uint32_t> airPrevious(airKeys.size(), 0);
+
+    const auto scan = [](const vector<int> &keys, const bool active) {
+        uint32_t state = 0;
+        uint32_t mask = 1;
+        for (const auto &vk : keys) {
+            if (active && (GetAsyncKeyState(vk) & 0x8000)) state |= mask;
+            mask <<= 1;
+            if (!mask) break;
+        }
+        return state;
+    };
+    const auto detect = [this, &scan](const ControllerSource source, const vector<vector<int>> &keys, vector<uint32_t> &previous, const bool active, const int64_t timestamp) {
+        for (size_t i = 0; i < keys.size(); i++) {
+            const auto state = scan(keys[i], active);
+            if (state & ~previous[i]) {
+                sampledEvents.push({ timestamp, source, uint8_t(i), true });
+            } else if (!state && previous[i]) {
+                sampledEvents.push({ timestamp, source, uint8_t(i), false });
+            }
+            previous[i] = state;
+        }
+    };
+
+    auto next = high_resolution_clock::now();
+    while (samplingActive) {
+        const auto timestamp = GetTimestamp();
+        // DirectInputと同じく非アクティブの間は何も押されていない扱い
+        const auto active = !window || GetForegroundWindow() == window;
+        detect(ControllerSource::IntegratedSliders, sliderKeys, sliderPrevious, active, timestamp);
+        detect(ControllerSource::IntegratedAir, airKeys, airPrevious, active, timestamp);
+
+        // 遅れた分は取り戻さない
+        next += interval;
+        auto now = high_resolution_clock::now();
+        if (next < now) next = now;
+        while (now < next) {
+            if (next - now >= microseconds(500)) {
+                Sleep(1);
+            } else {
+                this_thread::yield();
+            }
+            now = high_resolution_clock::now();
+        }
+    }
+
+    timeEndPeriod(1);
 }
 
 void ControlState::Update()
 {
+    frameTimestamp = GetTimestamp();
+
     // 生のキーボード入力
     memcpy_s(keyboardLast, sizeof(char) * 256, keyboardCurrent, sizeof(char) * 256);
     GetHitKeyStateAll(keyboardCurrent);
@@ -85,6 +196,10 @@ void ControlState::Update()
     }
 
     // 統合化
+    if (IsSampling()) {
+        UpdateFromEvents();
+        return;
+    }
     for (auto i = 0; i < 16; i++) integratedSliderLast[i] = integratedSliderCurrent[i];
     for (auto i = 0; i < 16; i++) integratedSliderCurrent[i] = !!sliderKeyboardCurrent[i];
     for (auto i = 0; i < 16; i++) integratedSliderTrigger[i] = sliderKeyboardTrigger[i];
@@ -99,6 +214,64 @@ void ControlState::Update()
     }*/
 }
 
+// サンプリングスレッドのイベントで統合化した状態を更新する
+// フレーム内で押して離した場合もトリガーとして扱い、最初の押下からフレームまでの遅れを覚えておく
+void ControlState::UpdateFromEvents()
+{
+    bool airTrigger[4] = { false };
+    for (auto i = 0; i < 16; i++) {
+        integratedSliderLast[i] = integratedSliderCurrent[i];
+        integratedSliderTrigger[i] = false;
+        sliderTriggerDelay[i] = 0;
+    }
+    fill_n(airTriggerDelay, 4, 0.0);
+
+    while (sampledEvents.read_available()) {
+        const auto event = sampledEvents.front();
+        if (event.Timestamp > frameTimestamp) break;
+        sampledEvents.pop();
+
+        const auto delay = (frameTimestamp - event.Timestamp) / 1000000000.0;
+        switch (event.Source) {
+            case ControllerSource::IntegratedSliders:
+                if (event.Number >= 16) break;
+                sampledSliderHeld[event.Number] = event.Pressed;
+                if (!event.Pressed || integratedSliderTrigger[event.Number]) break;
+                integratedSliderTrigger[event.Number] = true;
+                sliderTriggerDelay[event.Number] = delay;
+                break;
+            case ControllerSource::IntegratedAir:
+                if (event.Number >= 4) break;
+                sampledAirHeld[event.Number] = event.Pressed;
+                if (!event.Pressed || airTrigger[event.Number]) break;
+                airTrigger[event.Number] = true;
+                airTriggerDelay[event.Number] = delay;
+                break;
+            default:
+                break;
+        }
+    }
+
+    for (auto i = 0; i < 16; i++) integratedSliderCurrent[i] = sampledSliderHeld[i];
+    integratedAir[size_t(AirControlSource::AirUp)] = airTrigger[size_t(AirControlSource::AirUp)];
+    integratedAir[size_t(AirControlSource::AirDown)] = airTrigger[size_t(AirControlSource::AirDown)];
+    integratedAir[size_t(AirControlSource::AirHold)] = sampledAirHeld[size_t(AirControlSource::AirHold)] || airTrigger[size_t(AirControlSource::AirHold)];
+    integratedAir[size_t(AirControlSource::AirAction)] = airTrigger[size_t(AirControlSource::AirAction)];
+}
+
+// キーボードの代わりに記録済みの入力で統合化した状態だけを更新する
+void ControlState::UpdateFromSnapshot(const ControlSnapshot &snapshot)
+{
+    for (auto i = 0; i < 16; i++) {
+        integratedSliderLast[i] = integratedSliderCurrent[i];
+        integratedSliderCurrent[i] = !!(snapshot.Sliders & (1 << i));
+        integratedSliderTrigger[i] = !integratedSliderLast[i] && integratedSliderCurrent[i];
+    }
+    for (auto i = 0; i < 4; i++) integratedAir[i] = !!(snapshot.Air & (1 << i));
+    fill_n(sliderTriggerDelay, 16, 0.0);
+    fill_n(airTriggerDelay, 4, 0.0);
+}
+
 bool ControlState::GetTriggerState(const ControllerSource source, const int number)
 {
     switch (source) {
@@ -153,6 +326,22 @@ bool ControlState::GetLastState(const ControllerSource source, const int number)
     return false;
 }
 
+// 今フレームのトリガーが実際に押されてからフレーム開始までの秒数
+// サンプリングしていない場合やトリガーが無い場合は0
+double ControlState::GetTriggerDelay(const ControllerSource source, const int number)
+{
+    switch (source) {
+        case ControllerSource::IntegratedSliders:
+            if (number < 0 || number >= 16) return 0;
+            return sliderTriggerDelay[number];
+        case ControllerSource::IntegratedAir:
+            if (number < 0 || number >= 4) return 0;
+            return airTriggerDelay[number];
+        default:
+            return 0;
+    }
+}
+
 void ControlState::SetSliderKeyCombination(const int sliderNumber, const vector<int>& keys)
 {
     if (sliderNumber < 0 || sliderNumber >= 16) return;
@@ -14,6 +14,23 @@ enum class AirControlSource {
     AirAction,
 };
 
+// 記録済みの入力1回分 (リプレイ用)
+// Slidersはbit iがスライダーiの押下、AirはbitがAirControlSourceの順
+struct ControlSnapshot {
+    double Time;
+    uint16_t Sliders;
+    uint8_t Air;
+};
+
+// 入力スレッドで検出した押下・離しの1回分
+// TimestampはControlState::GetTimestamp()と同じ基準のナノ秒
+struct ControlEvent {
+    int64_t Timestamp;
+    ControllerSource Source;
+    uint8_t Number;
+    bool Pressed;
+};
+
 class ControlState final {
 private:
     char keyboardCurrent[256];
@@ -31,14 +48,37 @@ private:
     std::vector<int> airStringKeyboardInputCombinations[4];
     bool airStringKeyboard[4];
 
+    // 入力サンプリングスレッド
+    // フレームとは独立に押下を検出し、時刻付きのイベントとしてUpdateに渡す
+    boost::lockfree::spsc_queue<ControlEvent, boost::lockfree::capacity<1024>> sampledEvents;
+    std::thread samplingThread;
+    std::atomic<bool> samplingActive { false };
+    int64_t frameTimestamp = 0;
+    bool sampledSliderHeld[16];
+    bool sampledAirHeld[4];
+    double sliderTriggerDelay[16];
+    double airTriggerDelay[4];
+
+    void SampleInputs(std::vector<std::vector<int>> sliderKeys, std::vector<std::vector<int>> airKeys, int rate);
+    void UpdateFromEvents();
+
 public:
+    ~ControlState();
+
     void Initialize();
     void Terminate();
     void Update();
+    void UpdateFromSnapshot(const ControlSnapshot &snapshot);
+    void StartSampling(int rate);
+    void StopSampling();
+    bool IsSampling() const { return samplingThread.joinable(); }
+
+    static int64_t GetTimestamp();
 
     bool GetTriggerState(ControllerSource source, int number);
     bool GetCurrentState(ControllerSource source, int number);
     bool GetLastState(ControllerSource source, int number);
+    double GetTriggerDelay(ControllerSource source, int number);
     void SetSliderKeyCombination(int sliderNumber, const std::vector<int>& keys);
     void SetAirStringKeyCombination(int airNumber, const std::vector<int>& keys);
 };
@@ -72,11 +72,21 @@ void ExecutionManager::Initialize()
         log->warn(u8"エアストリングキー設定の配列が4要素未満のため、フォールバックを利用します");
     }
 
+    // 判定用の入力はフレームとは別スレッドで取る (0ならフレームごとに取る)
+    const auto samplingRate = sharedSetting->ReadValue<int>("Play", "InputSamplingRate", 1000);
+    sharedControlState->StartSampling(samplingRate);
+    if (sharedControlState->IsSampling()) log->info(u8"入力サンプリング: {0:d}Hz", samplingRate);
+
     // 拡張ライブラリ読み込み
     extensions->LoadExtensions();
     extensions->Initialize(scriptInterface->GetEngine());
 
     // サウンド初期化
+    SoundMixerOptions mixerOptions;
+    mixerOptions.UseSoftwareMixer = sharedSetting->ReadValue<bool>("Sound", "SoftwareMixer", false);
+    mixerOptions.BufferFrames = SU_TO_UINT32(max(sharedSetting->ReadValue<int>("Sound", "MixerBufferFrames", 256), 16));
+    sound->SetMixerOptions(mixerOptions);
+    if (mixerOptions.UseSoftwareMixer) log->info(u8"ソフトウェアミキサー: {0:d}フレーム", mixerOptions.BufferFrames);
     mixerBgm = SSoundMixer::CreateMixer(sound.get());
     mixerSe = SSoundMixer::CreateMixer(sound.get());
 
@@ -121,6 +131,7 @@ void ExecutionManager::Shutdown()
     scenesPending.clear();
 
     if (skin) skin->Terminate();
+    musics->StopWatching();
     settingManager->SaveAllValues();
     sharedControlState->Terminate();
 
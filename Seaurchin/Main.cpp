@@ -8,6 +8,9 @@
 #include "MoverFunctionExpression.h"
 #include "Easing.h"
 #include "ScriptSpriteMover.h"
+#include "ReplayRunner.h"
+#include "ScoreBenchmark.h"
+#include "MixerBenchmark.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -23,9 +26,39 @@ shared_ptr<Logger> logger;
 unique_ptr<ExecutionManager> manager;
 WNDPROC dxlibWndProc;
 HWND hDxlibWnd;
+ReplayOptions replayOptions;
+bool isReplayMode = false;
 
 int WINAPI WinMain(const HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 {
+    auto argc = 0;
+    const auto argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    vector<wstring> args;
+    if (argv) {
+        args.assign(argv, argv + argc);
+        LocalFree(argv);
+    }
+
+    ScoreBenchmarkOptions benchmarkOptions;
+    if (ScoreBenchmarkOptions::Parse(args, benchmarkOptions)) {
+        // 譜面解析だけなのでDxLibもBASSも初期化しない
+        logger = make_shared<Logger>();
+        logger->Initialize();
+        const auto succeeded = ScoreBenchmark(benchmarkOptions).Run();
+        logger->Terminate();
+        return succeeded ? 0 : 1;
+    }
+    MixerBenchmarkOptions mixerBenchmarkOptions;
+    if (MixerBenchmarkOptions::Parse(args, mixerBenchmarkOptions)) {
+        // 出力はNull/WAVなのでBASSも使わない
+        logger = make_shared<Logger>();
+        logger->Initialize();
+        const auto succeeded = MixerBenchmark(mixerBenchmarkOptions).Run();
+        logger->Terminate();
+        return succeeded ? 0 : 1;
+    }
+    isReplayMode = ReplayOptions::Parse(args, replayOptions);
+
     PreInitialize(hInstance);
     if (!Initialize()) {
         logger->LogError(u8"初期化処理に失敗しました。強制終了します。");
@@ -33,6 +66,13 @@ int WINAPI WinMain(const HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpC
         return -1;
     }
 
+    if (isReplayMode) {
+        // ウィンドウを出さずに譜面を最後まで流して終わる
+        const auto succeeded = ReplayRunner(manager.get(), replayOptions).Run();
+        Terminate();
+        return succeeded ? 0 : 1;
+    }
+
     Run();
 
     Terminate();
@@ -59,6 +99,10 @@ void PreInitialize(HINSTANCE hInstance)
     SetUseFPUPreserveFlag(TRUE);
     SetGraphMode(SU_RES_WIDTH, SU_RES_HEIGHT, 32);
     SetFullSceneAntiAliasingMode(2, 2);
+    if (isReplayMode) {
+        SetNotWinFlag(TRUE);
+        SetNotSoundFlag(TRUE);
+    }
 
     logger->LogDebug(u8"PreInitialize完了");
 }
@@ -69,14 +113,17 @@ bool Initialize()
     if (DxLib_Init() == -1) abort();
     logger->LogInfo(u8"DxLib初期化OK");
 
-    //WndProc差し替え
-    hDxlibWnd = GetMainWindowHandle();
-    dxlibWndProc = WNDPROC(GetWindowLong(hDxlibWnd, GWL_WNDPROC));
-    SetWindowLong(hDxlibWnd, GWL_WNDPROC, LONG(CustomWindowProc));
-    //D3D設定
-    SetUseZBuffer3D(TRUE);
-    SetWriteZBuffer3D(TRUE);
-    SetDrawScreen(DX_SCREEN_BACK);
+    // リプレイはウィンドウも描画先も使わない
+    if (!isReplayMode) {
+        //WndProc差し替え
+        hDxlibWnd = GetMainWindowHandle();
+        dxlibWndProc = WNDPROC(GetWindowLong(hDxlibWnd, GWL_WNDPROC));
+        SetWindowLong(hDxlibWnd, GWL_WNDPROC, LONG(CustomWindowProc));
+        //D3D設定
+        SetUseZBuffer3D(TRUE);
+        SetWriteZBuffer3D(TRUE);
+        SetDrawScreen(DX_SCREEN_BACK);
+    }
 
     MoverFunctionExpressionManager::Initialize();
     if (!easing::RegisterDefaultMoverFunctionExpressions()) {
@@ -1,7 +1,17 @@
 ﻿#include "Misc.h"
 
+#ifndef _WIN32
+#include <codecvt>
+#include <locale>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 using namespace std;
 
+#ifdef _WIN32
 wstring ConvertUTF8ToUnicode(const string &utf8Str)
 {
     const auto len = MultiByteToWideChar(CP_UTF8, 0, utf8Str.c_str(), -1, nullptr, 0);
@@ -22,6 +32,7 @@ string ConvertUnicodeToUTF8(const wstring &utf16Str)
     return ret;
 }
 
+// AngelScriptを使うのはWindows版だけ
 void ScriptSceneWarnOutOf(const string &funcName, const string &type, asIScriptContext *ctx)
 {
     const char *secn;
@@ -29,6 +40,20 @@ void ScriptSceneWarnOutOf(const string &funcName, const string &type, asIScriptC
     const auto row = ctx->GetLineNumber(0, &col, &secn);
     ctx->GetEngine()->WriteMessage(secn, row, col, asMSGTYPE_WARNING, ("You can call \"" + funcName + "\" Function only from " + type + "!").c_str());
 }
+#else
+// Windows以外ではwchar_tがUTF-32 変換できない場合は空文字列になる
+wstring ConvertUTF8ToUnicode(const string &utf8Str)
+{
+    wstring_convert<codecvt_utf8<wchar_t>> converter { string(), wstring() };
+    return converter.from_bytes(utf8Str);
+}
+
+string ConvertUnicodeToUTF8(const wstring &utf16Str)
+{
+    wstring_convert<codecvt_utf8<wchar_t>> converter { string(), wstring() };
+    return converter.to_bytes(utf16Str);
+}
+#endif
 
 double ToDouble(const char *str)
 {
@@ -103,3 +128,48 @@ void SplitProps(const string &source, PropList &vec)
     if (pos == string::npos) return;
     vec.push_back(make_tuple(pset.substr(0, pos), pset.substr(pos + 1)));
 }
+
+#ifdef _WIN32
+MappedFile::MappedFile(const wstring &fileName)
+{
+    file = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return;
+
+    LARGE_INTEGER fileSize;
+    // 空ファイルはマップできない
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return;
+
+    mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) return;
+    data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (data) size = static_cast<size_t>(fileSize.QuadPart);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+}
+#else
+MappedFile::MappedFile(const wstring &fileName)
+{
+    file = open(ConvertUnicodeToUTF8(fileName).c_str(), O_RDONLY);
+    if (file < 0) return;
+
+    struct stat status;
+    // 空ファイルはマップできない
+    if (fstat(file, &status) != 0 || status.st_size == 0) return;
+
+    const auto view = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    if (view == MAP_FAILED) return;
+    data = static_cast<const char*>(view);
+    size = size_t(status.st_size);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data) munmap(const_cast<char*>(data), size);
+    if (file >= 0) close(file);
+}
+#endif
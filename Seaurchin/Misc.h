@@ -28,6 +28,8 @@ To* CastReferenceType(From *from)
 
 using PropList = std::vector<std::tuple<std::string, std::string>>;
 
+class asIScriptContext;
+
 std::wstring ConvertUTF8ToUnicode(const std::string &utf8Str);
 std::string ConvertUnicodeToUTF8(const std::wstring &utf16Str);
 void ScriptSceneWarnOutOf(const std::string &funcName, const std::string &type, asIScriptContext *ctx);
@@ -40,6 +42,29 @@ float ConvertFloat(const std::string &input);
 bool ConvertBoolean(const std::string &input);
 void SplitProps(const std::string &source, PropList &vec);
 
+// 読み込み専用でファイル全体をメモリにマップする
+// 開けなかった場合や空ファイルの場合はGetSize()が0になる
+class MappedFile final {
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int file = -1;
+#endif
+    const char *data = nullptr;
+    size_t size = 0;
+
+public:
+    explicit MappedFile(const std::wstring &fileName);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char *GetData() const { return data; }
+    size_t GetSize() const { return size; }
+};
+
 #define SU_TO_INT8(value)   static_cast<int8_t>((value))
 #define SU_TO_UINT8(value)  static_cast<uint8_t>((value))
 #define SU_TO_INT16(value)  static_cast<int16_t>((value))
@@ -48,3 +73,76 @@ void SplitProps(const std::string &source, PropList &vec);
 #define SU_TO_UINT32(value) static_cast<uint32_t>((value))
 #define SU_TO_FLOAT(value)  static_cast<float>((value))
 #define SU_TO_DOUBLE(value) static_cast<double>((value))
+
+// キャッシュファイル用のバイナリ書き出しバッファ
+// 数値はメモリ上の表現そのままで書く
+class BinaryBufferWriter final {
+private:
+    std::string buffer;
+
+public:
+    template<typename T>
+    void Write(const T &value)
+    {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void WriteString(const std::string &value)
+    {
+        Write(SU_TO_UINT32(value.size()));
+        buffer.append(value);
+    }
+
+    const std::string &GetBuffer() const { return buffer; }
+};
+
+// BinaryBufferWriterで書いたものを読む
+// 範囲外を読もうとしたらそれ以降は全部失敗扱い
+class BinaryBufferReader final {
+private:
+    const char *cursor;
+    const char *end;
+    bool failed = false;
+
+public:
+    BinaryBufferReader(const char *data, const size_t size) : cursor(data), end(data + size) {}
+
+    template<typename T>
+    T Read()
+    {
+        T value {};
+        if (failed || size_t(end - cursor) < sizeof(T)) {
+            failed = true;
+            return value;
+        }
+        memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return value;
+    }
+
+    // 要素数を読む(残りサイズに収まらない値なら壊れている)
+    uint32_t ReadCount(const size_t elementSize)
+    {
+        const auto count = Read<uint32_t>();
+        if (failed || size_t(end - cursor) / elementSize < count) {
+            failed = true;
+            return 0;
+        }
+        return count;
+    }
+
+    std::string ReadString()
+    {
+        const auto size = Read<uint32_t>();
+        if (failed || size_t(end - cursor) < size) {
+            failed = true;
+            return "";
+        }
+        std::string value(cursor, size);
+        cursor += size;
+        return value;
+    }
+
+    bool IsFailed() const { return failed; }
+    bool IsEnd() const { return cursor == end; }
+};
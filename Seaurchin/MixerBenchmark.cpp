@@ -0,0 +1,126 @@
+﻿#include "MixerBenchmark.h"
+#include "Config.h"
+#include "Misc.h"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace
+{
+    const double toneLength = 0.25;
+    const uint32_t toneCount = 8;
+}
+
+bool MixerBenchmarkOptions::Parse(const vector<wstring> &args, MixerBenchmarkOptions &options)
+{
+    auto found = false;
+    for (auto i = 0u; i + 1 < args.size(); i++) {
+        const auto &value = args[i + 1];
+        if (args[i] == SU_MIXER_BENCHMARK_OPTION) {
+            options.OutputPath = value;
+            found = true;
+        } else if (args[i] == L"--wave") {
+            options.WavePath = value;
+        } else if (args[i] == L"--buffer") {
+            options.BufferFrames = max(16u, SU_TO_UINT32(wcstoul(value.c_str(), nullptr, 10)));
+        } else if (args[i] == L"--voices") {
+            options.Voices = max(1u, SU_TO_UINT32(wcstoul(value.c_str(), nullptr, 10)));
+        } else if (args[i] == L"--seconds") {
+            options.Seconds = max(1.0, wcstod(value.c_str(), nullptr));
+        } else {
+            continue;
+        }
+        ++i;
+    }
+    return found;
+}
+
+MixerBenchmark::MixerBenchmark(const MixerBenchmarkOptions &options)
+    : options(options)
+{}
+
+// 減衰する正弦波 音程を変えてtoneCount個
+vector<MixerPcm> MixerBenchmark::GenerateTones() const
+{
+    const auto pi = 3.14159265358979;
+    const auto frames = size_t(toneLength * options.Frequency);
+    vector<MixerPcm> result;
+    for (auto i = 0u; i < toneCount; i++) {
+        const auto pitch = 440.0 * pow(2.0, i / 12.0);
+        vector<float> pcm(frames * SoftwareMixer::Channels);
+        for (size_t f = 0; f < frames; f++) {
+            const auto t = double(f) / options.Frequency;
+            const auto value = SU_TO_FLOAT(sin(2 * pi * pitch * t) * exp(-t * 12));
+            pcm[f * 2] = value;
+            pcm[f * 2 + 1] = value;
+        }
+        result.push_back(make_shared<const vector<float>>(move(pcm)));
+    }
+    return result;
+}
+
+bool MixerBenchmark::Run()
+{
+    auto log = spdlog::get("main");
+    SoftwareMixer mixer(options.Frequency, options.BufferFrames);
+    unique_ptr<NullOutputDevice> device;
+    if (options.WavePath.empty()) {
+        device = make_unique<NullOutputDevice>();
+    } else {
+        device = make_unique<WaveFileOutputDevice>(options.WavePath);
+    }
+
+    const auto tones = GenerateTones();
+    mixer.SetVolume(1.0 / sqrt(double(options.Voices)));
+    if (!device->Start(&mixer)) {
+        log->error(u8"ミキサーの出力を開始できませんでした");
+        return false;
+    }
+    log->info(u8"ミキサー計測中: {0:d}フレーム {1:d}音 {2:.1f}秒", options.BufferFrames, options.Voices, options.Seconds);
+
+    // 同時発音数がVoicesぐらいになる間隔で鳴らし続ける
+    const auto interval = duration_cast<steady_clock::duration>(duration<double>(toneLength / options.Voices));
+    const auto end = steady_clock::now() + duration_cast<steady_clock::duration>(duration<double>(options.Seconds));
+    auto next = steady_clock::now();
+    auto plays = uint64_t(0);
+    while (next < end) {
+        this_thread::sleep_until(next);
+        mixer.Play(SU_TO_UINT32(plays), tones[plays % tones.size()], 1.0, false);
+        ++plays;
+        next += interval;
+    }
+    device->Stop();
+    return WriteResult(mixer.GetStatistics(), device->GetLateBuffers(), plays);
+}
+
+// 記録して比べられるように、項目の並びと名前は変えない
+bool MixerBenchmark::WriteResult(const SoftwareMixerStatistics &statistics, const uint64_t lateBuffers, const uint64_t plays) const
+{
+    auto log = spdlog::get("main");
+    boost::filesystem::ofstream file(boost::filesystem::path(options.OutputPath), ios::out | ios::binary | ios::trunc);
+    if (!file) {
+        log->error(u8"計測結果 {0} を書き出せませんでした", ConvertUnicodeToUTF8(options.OutputPath));
+        return false;
+    }
+
+    const auto bufferTime = double(options.BufferFrames) / options.Frequency;
+    file << "{\n";
+    file << fmt::format("  \"version\": \"{0}\",\n", SU_APP_VERSION);
+    file << fmt::format("  \"frequency\": {0},\n", options.Frequency);
+    file << fmt::format("  \"buffer_frames\": {0},\n", options.BufferFrames);
+    file << fmt::format("  \"buffer_ms\": {0:.3f},\n", bufferTime * 1000);
+    file << fmt::format("  \"voices\": {0},\n", options.Voices);
+    file << fmt::format("  \"seconds\": {0:.1f},\n", options.Seconds);
+    file << fmt::format("  \"plays\": {0},\n", plays);
+    file << fmt::format("  \"dropped_commands\": {0},\n", statistics.DroppedCommands);
+    file << fmt::format("  \"buffers\": {0},\n", statistics.Buffers);
+    file << fmt::format("  \"late_buffers\": {0},\n", lateBuffers);
+    file << fmt::format("  \"render_mean_us\": {0:.3f},\n", statistics.RenderTimeMean * 1e6);
+    file << fmt::format("  \"render_max_us\": {0:.3f},\n", statistics.RenderTimeMax * 1e6);
+    file << fmt::format("  \"load\": {0:.6f},\n", statistics.RenderTimeMean / bufferTime);
+    file << fmt::format("  \"latency_mean_ms\": {0:.3f},\n", statistics.LatencyMean * 1000);
+    file << fmt::format("  \"latency_max_ms\": {0:.3f}\n", statistics.LatencyMax * 1000);
+    file << "}\n";
+    log->info(u8"計測結果を {0} に書き出しました", ConvertUnicodeToUTF8(options.OutputPath));
+    return true;
+}
@@ -0,0 +1,34 @@
+﻿#pragma once
+
+#include "SoftwareMixer.h"
+
+#define SU_MIXER_BENCHMARK_OPTION L"--mixer-benchmark"
+
+// MixerBenchmarkの設定 コマンドライン
+//   --mixer-benchmark <結果.json> [--wave <出力.wav>] [--buffer <フレーム数>] [--voices <同時発音数>] [--seconds <秒>]
+struct MixerBenchmarkOptions {
+    std::wstring OutputPath;
+    std::wstring WavePath;          // 空ならNullOutputDeviceに流す
+    uint32_t Frequency = 44100;
+    uint32_t BufferFrames = 256;
+    uint32_t Voices = 32;
+    double Seconds = 10;
+
+    static bool Parse(const std::vector<std::wstring> &args, MixerBenchmarkOptions &options);
+};
+
+// ソフトウェアミキサーの計測
+// 短い音をVoices個ぐらい重なる間隔で鳴らし続け、描画時間と発音までの遅延をJSONで書き出す
+// SoftwareMixerだけに依存するので音の出ない環境でも動く
+class MixerBenchmark final {
+private:
+    MixerBenchmarkOptions options;
+
+    std::vector<MixerPcm> GenerateTones() const;
+    bool WriteResult(const SoftwareMixerStatistics &statistics, uint64_t lateBuffers, uint64_t plays) const;
+
+public:
+    explicit MixerBenchmark(const MixerBenchmarkOptions &options);
+
+    bool Run();
+};
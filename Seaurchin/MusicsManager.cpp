@@ -10,30 +10,137 @@ using namespace xpressive;
 
 typedef std::lock_guard<std::mutex> LockGuard;
 
+namespace {
+
+// 楽曲一覧キャッシュの1譜面分
+// 更新日時とサイズが変わっていなければ解析せずにMetaDataを使う
+struct MusicFileRecord final {
+    int64_t LastWriteTime = 0;
+    uint64_t Size = 0;
+    uint32_t Hash = 0;
+    SusMetaData MetaData;
+};
+
+struct MusicIndexHeader final {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t ScanRule;
+    uint32_t BodySize;
+};
+
+const uint32_t musicIndexMagic = 0x494D5553; // "SUMI"
+const uint32_t musicIndexVersion = 1;
+
+void LoadMusicIndex(const path &indexPath, const uint32_t scanRule, unordered_map<string, MusicFileRecord> &records)
+{
+    const MappedFile file(indexPath.wstring());
+    if (file.GetSize() < sizeof(MusicIndexHeader)) return;
+
+    MusicIndexHeader header;
+    memcpy(&header, file.GetData(), sizeof(MusicIndexHeader));
+    if (header.Magic != musicIndexMagic) return;
+    if (header.Version != (musicIndexVersion << 16 | SU_SUS_ANALYZER_VERSION)) return;
+    if (header.ScanRule != scanRule) return;
+    if (header.BodySize != file.GetSize() - sizeof(MusicIndexHeader)) return;
+
+    BinaryBufferReader reader(file.GetData() + sizeof(MusicIndexHeader), header.BodySize);
+    unordered_map<string, MusicFileRecord> loaded;
+    const auto count = reader.ReadCount(sizeof(uint32_t));
+    for (auto i = 0u; i < count && !reader.IsFailed(); i++) {
+        auto &record = loaded[reader.ReadString()];
+        record.LastWriteTime = reader.Read<int64_t>();
+        record.Size = reader.Read<uint64_t>();
+        record.Hash = reader.Read<uint32_t>();
+        record.MetaData.USongId = reader.ReadString();
+        record.MetaData.UTitle = reader.ReadString();
+        record.MetaData.UArtist = reader.ReadString();
+        record.MetaData.UJacketFileName = reader.ReadString();
+        record.MetaData.UBackgroundFileName = reader.ReadString();
+        record.MetaData.UWaveFileName = reader.ReadString();
+        record.MetaData.UDesigner = reader.ReadString();
+        record.MetaData.UExtraDifficulty = reader.ReadString();
+        record.MetaData.ShowBpm = reader.Read<double>();
+        record.MetaData.Level = reader.Read<uint32_t>();
+        record.MetaData.DifficultyType = reader.Read<uint32_t>();
+    }
+    if (reader.IsFailed() || !reader.IsEnd()) return;
+    records.swap(loaded);
+}
+
+void SaveMusicIndex(const path &indexPath, const uint32_t scanRule, const vector<std::tuple<string, const MusicFileRecord*>> &records)
+{
+    BinaryBufferWriter writer;
+    writer.Write(SU_TO_UINT32(records.size()));
+    for (const auto &entry : records) {
+        const auto &record = *std::get<1>(entry);
+        writer.WriteString(std::get<0>(entry));
+        writer.Write(record.LastWriteTime);
+        writer.Write(record.Size);
+        writer.Write(record.Hash);
+        writer.WriteString(record.MetaData.USongId);
+        writer.WriteString(record.MetaData.UTitle);
+        writer.WriteString(record.MetaData.UArtist);
+        writer.WriteString(record.MetaData.UJacketFileName);
+        writer.WriteString(record.MetaData.UBackgroundFileName);
+        writer.WriteString(record.MetaData.UWaveFileName);
+        writer.WriteString(record.MetaData.UDesigner);
+        writer.WriteString(record.MetaData.UExtraDifficulty);
+        writer.Write(record.MetaData.ShowBpm);
+        writer.Write(record.MetaData.Level);
+        writer.Write(record.MetaData.DifficultyType);
+    }
+
+    const auto &body = writer.GetBuffer();
+    MusicIndexHeader header;
+    header.Magic = musicIndexMagic;
+    header.Version = musicIndexVersion << 16 | SU_SUS_ANALYZER_VERSION;
+    header.ScanRule = scanRule;
+    header.BodySize = SU_TO_UINT32(body.size());
+
+    boost::system::error_code ec;
+    create_directories(indexPath.parent_path(), ec);
+    std::ofstream file(indexPath.wstring(), ios::out | ios::binary | ios::trunc);
+    if (!file) {
+        spdlog::get("main")->warn(u8"楽曲一覧のキャッシュを書き出せませんでした");
+        return;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(MusicIndexHeader));
+    file.write(body.data(), body.size());
+}
+
+}
+
 //path sepath = Setting::GetRootDirectory() / SU_DATA_DIR / SU_SKIN_DIR;
 
 MusicsManager::MusicsManager(ExecutionManager *exm)
 {
     manager = exm;
-    analyzer = make_unique<SusAnalyzer>(192);
 }
 
 MusicsManager::~MusicsManager()
-= default;
+{
+    StopWatching();
+}
 
 void MusicsManager::Initialize()
 {}
 
 void MusicsManager::Reload(const bool async)
 {
-    if (IsReloading()) return;
+    {
+        LockGuard lock(flagMutex);
+        if (loading) return;
+        loading = true;
+    }
 
     if (async) {
-        thread loadthread([this] { CreateMusicCache(); });
+        thread loadthread([this] { CreateMusicCache(false); });
         loadthread.detach();
     } else {
-        CreateMusicCache();
+        CreateMusicCache(false);
     }
+
+    if (!IsWatching() && manager->GetSettingInstanceSafe()->ReadValue<bool>("Music", "WatchLibrary", false)) StartWatching();
 }
 
 bool MusicsManager::IsReloading()
@@ -42,65 +149,240 @@ bool MusicsManager::IsReloading()
     return loading;
 }
 
+// 選曲確定時に決めたパスを返す Selected:*の番号で今の一覧を引き直すと、監視で差し替わった後は別の譜面になりうる
 path MusicsManager::GetSelectedScorePath()
 {
-    const auto ci = manager->GetData<int>("Selected:Category");
-    const auto mi = manager->GetData<int>("Selected:Music");
-    const auto vi = manager->GetData<int>("Selected:Variant");
-    auto result = Setting::GetRootDirectory() / SU_MUSIC_DIR / ConvertUTF8ToUnicode(categories[ci]->GetName());
-    result /= categories[ci]->Musics[mi]->Scores[vi]->Path;
-    return result;
+    LockGuard lock(flagMutex);
+    return selectedScorePath;
 }
 
-void MusicsManager::CreateMusicCache()
+void MusicsManager::StartWatching()
 {
-    {
-        LockGuard lock(flagMutex);
-        loading = true;
+    if (IsWatching()) return;
+    watchStopEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (!watchStopEvent) return;
+    watchThread = std::thread([this] { WatchMusicDirectory(); });
+}
+
+void MusicsManager::StopWatching()
+{
+    if (!IsWatching()) return;
+    SetEvent(watchStopEvent);
+    watchThread.join();
+    CloseHandle(watchStopEvent);
+    watchStopEvent = nullptr;
+}
+
+// SU_MUSIC_DIR以下の変更を待って一覧を作り直す
+// 変更内容は見ずに、落ち着いたところで差分読み込み(CreateMusicCache)に任せる
+void MusicsManager::WatchMusicDirectory()
+{
+    auto log = spdlog::get("main");
+    const auto mlpath = Setting::GetRootDirectory() / SU_MUSIC_DIR;
+    const auto directory = CreateFileW(
+        mlpath.wstring().c_str(), FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+    if (directory == INVALID_HANDLE_VALUE) {
+        log->warn(u8"楽曲フォルダを監視できません");
+        return;
     }
+    const auto changedEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    const DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+    const DWORD settleTime = 500;   // コピー中のファイルを拾わないように、最後の変更からこれだけ待つ
+    log->info(u8"楽曲フォルダの監視を開始しました");
+
+    vector<DWORD> buffer(16 * 1024);
+    OVERLAPPED overlapped = {};
+    overlapped.hEvent = changedEvent;
+    const HANDLE events[] = { watchStopEvent, changedEvent };
+    auto dirty = false;
+    auto pending = false;
+    while (true) {
+        if (!pending) {
+            ResetEvent(changedEvent);
+            if (!ReadDirectoryChangesW(directory, buffer.data(), SU_TO_UINT32(buffer.size() * sizeof(DWORD)), TRUE, filter, nullptr, &overlapped, nullptr)) {
+                log->warn(u8"楽曲フォルダの監視に失敗しました");
+                break;
+            }
+            pending = true;
+        }
+
+        const auto result = WaitForMultipleObjects(2, events, FALSE, dirty ? settleTime : INFINITE);
+        if (result == WAIT_OBJECT_0) break;
+        if (result == WAIT_OBJECT_0 + 1) {
+            // バッファが溢れても(結果が0バイトでも)何か変わったことだけ分かればよい
+            DWORD returned;
+            GetOverlappedResult(directory, &overlapped, &returned, FALSE);
+            pending = false;
+            dirty = true;
+            continue;
+        }
 
-    categories.clear();
+        // しばらく変更が無かったので反映する
+        dirty = false;
+        try {
+            CreateMusicCache(true);
+        } catch (const filesystem_error &e) {
+            // 走査中に消されたなど。次の変更で作り直す
+            log->warn(u8"楽曲一覧の更新に失敗しました: {0}", e.what());
+        }
+    }
 
+    if (pending) {
+        DWORD returned;
+        CancelIo(directory);
+        GetOverlappedResult(directory, &overlapped, &returned, TRUE);
+    }
+    CloseHandle(changedEvent);
+    CloseHandle(directory);
+}
+
+// 監視スレッドが作った一覧があれば差し替えて、現在の世代を返す
+// MusicSelectionCursorから呼ぶので、一覧を読むスレッドと同じスレッドで差し替わる
+uint32_t MusicsManager::ApplyPendingCategories()
+{
+    LockGuard lock(flagMutex);
+    if (!hasPendingCategories || loading) return generation;
+    categories.swap(pendingCategories);
+    pendingCategories.clear();
+    hasPendingCategories = false;
+    return ++generation;
+}
+
+// stagedならpendingCategoriesに置くだけでcategoriesには触らない(読み込み中扱いにもしない)
+void MusicsManager::CreateMusicCache(const bool staged)
+{
+    LockGuard scanLock(scanMutex);
+
+    const auto setting = manager->GetSettingInstanceSafe();
+    const auto headerOnly = setting->ReadValue<bool>("Music", "HeaderOnlyScan", false);
+    const auto threadSetting = setting->ReadValue<int>("Music", "ScanThreads", 0);
+    const auto scanRule = headerOnly ? SusMetaDataScanRule::UntilNoteData : SusMetaDataScanRule::WholeFile;
+
+    // 前回の楽曲一覧
+    const auto indexPath = Setting::GetRootDirectory() / SU_DATA_DIR / SU_CACHE_DIR / SU_CACHE_MUSIC_FILE;
+    unordered_map<string, MusicFileRecord> cachedRecords;
+    LoadMusicIndex(indexPath, SU_TO_UINT32(scanRule), cachedRecords);
+
+    // 走査対象の列挙(順序はここで決まる)
+    vector<std::shared_ptr<CategoryInfo>> newCategories;
+    vector<std::tuple<size_t, path, string>> scoreFiles;
     const auto mlpath = Setting::GetRootDirectory() / SU_MUSIC_DIR;
     for (const auto& fdata : make_iterator_range(directory_iterator(mlpath), {})) {
         if (!is_directory(fdata)) continue;
 
-        auto category = make_shared<CategoryInfo>(fdata);
+        newCategories.push_back(make_shared<CategoryInfo>(fdata));
         for (const auto& mdir : make_iterator_range(directory_iterator(fdata), {})) {
             if (!is_directory(mdir)) continue;
             for (const auto& file : make_iterator_range(directory_iterator(mdir), {})) {
                 if (is_directory(file)) continue;
                 if (file.path().extension() != ".sus") continue;     //これ大文字どうすんの
-                analyzer->Reset();
-                analyzer->LoadFromFile(file.path().wstring(), true);
-                auto music = find_if(category->Musics.begin(), category->Musics.end(), [&](const std::shared_ptr<MusicMetaInfo> info) {
-                    return info->SongId == analyzer->SharedMetaData.USongId;
-                });
-                if (music == category->Musics.end()) {
-                    music = category->Musics.insert(category->Musics.begin(), make_shared<MusicMetaInfo>());
-                    (*music)->SongId = analyzer->SharedMetaData.USongId;
-                    (*music)->Name = analyzer->SharedMetaData.UTitle;
-                    (*music)->Artist = analyzer->SharedMetaData.UArtist;
-                    (*music)->JacketPath = mdir.path().filename() / ConvertUTF8ToUnicode(analyzer->SharedMetaData.UJacketFileName);
-                }
-                auto score = make_shared<MusicScoreInfo>();
-                score->Path = mdir.path().filename() / file.path().filename();
-                score->BackgroundPath = ConvertUTF8ToUnicode(analyzer->SharedMetaData.UBackgroundFileName);
-                score->WavePath = ConvertUTF8ToUnicode(analyzer->SharedMetaData.UWaveFileName);
-                score->Designer = analyzer->SharedMetaData.UDesigner;
-                score->BpmToShow = analyzer->SharedMetaData.ShowBpm;
-                score->Difficulty = analyzer->SharedMetaData.DifficultyType;
-                score->DifficultyName = analyzer->SharedMetaData.UExtraDifficulty;
-                score->Level = analyzer->SharedMetaData.Level;
-                (*music)->Scores.push_back(score);
+                const auto key = ConvertUnicodeToUTF8((fdata.path().filename() / mdir.path().filename() / file.path().filename()).generic_wstring());
+                scoreFiles.emplace_back(newCategories.size() - 1, file.path(), key);
+            }
+        }
+    }
+
+    // 更新日時とサイズが前回と同じものはそのまま使う
+    vector<MusicFileRecord> records(scoreFiles.size());
+    vector<std::tuple<size_t, const MusicFileRecord*>> pendingFiles;
+    for (auto i = 0u; i < scoreFiles.size(); i++) {
+        boost::system::error_code ec;
+        records[i].LastWriteTime = last_write_time(std::get<1>(scoreFiles[i]), ec);
+        records[i].Size = file_size(std::get<1>(scoreFiles[i]), ec);
+
+        const auto cached = cachedRecords.find(std::get<2>(scoreFiles[i]));
+        if (cached == cachedRecords.end()) {
+            pendingFiles.emplace_back(i, nullptr);
+        } else if (cached->second.LastWriteTime != records[i].LastWriteTime || cached->second.Size != records[i].Size) {
+            pendingFiles.emplace_back(i, &cached->second);
+        } else {
+            records[i] = cached->second;
+        }
+    }
+
+    // 解析はスレッドごとにSusAnalyzerを持って空いたスレッドから次のファイルを取っていく
+    // 更新日時だけ変わったもの(中身が同じもの)は解析しない
+    std::atomic<size_t> nextFile(0);
+    const auto analyzeFiles = [&] {
+        SusAnalyzer analyzer(192);
+        analyzer.SetMetaDataScanRule(scanRule);
+        for (auto i = nextFile++; i < pendingFiles.size(); i = nextFile++) {
+            const auto index = std::get<0>(pendingFiles[i]);
+            const auto cached = std::get<1>(pendingFiles[i]);
+            const auto fileName = std::get<1>(scoreFiles[index]).wstring();
+            auto &record = records[index];
+            record.Hash = SusAnalyzer::CalculateFileHash(fileName);
+            if (cached && cached->Hash == record.Hash) {
+                record.MetaData = cached->MetaData;
+                continue;
             }
+            analyzer.Reset();
+            analyzer.LoadFromFile(fileName, true);
+            record.MetaData = analyzer.SharedMetaData;
         }
-        categories.push_back(category);
+    };
+    const auto threadCount = std::min<size_t>(threadSetting > 0 ? size_t(threadSetting) : std::max(std::thread::hardware_concurrency(), 1u), std::max<size_t>(pendingFiles.size(), 1));
+    vector<std::thread> workers;
+    for (auto i = 1u; i < threadCount; i++) workers.emplace_back(analyzeFiles);
+    analyzeFiles();
+    for (auto &worker : workers) worker.join();
+
+    // 列挙順にまとめる
+    vector<unordered_map<string, std::shared_ptr<MusicMetaInfo>>> musicsBySongId(newCategories.size());
+    for (auto i = 0u; i < scoreFiles.size(); i++) {
+        const auto &category = newCategories[std::get<0>(scoreFiles[i])];
+        const auto &file = std::get<1>(scoreFiles[i]);
+        const auto &meta = records[i].MetaData;
+        const auto mdir = file.parent_path();
+
+        auto &music = musicsBySongId[std::get<0>(scoreFiles[i])][meta.USongId];
+        if (!music) {
+            music = make_shared<MusicMetaInfo>();
+            music->SongId = meta.USongId;
+            music->Name = meta.UTitle;
+            music->Artist = meta.UArtist;
+            music->JacketPath = mdir.filename() / ConvertUTF8ToUnicode(meta.UJacketFileName);
+            category->Musics.push_back(music);
+        }
+        auto score = make_shared<MusicScoreInfo>();
+        score->Path = mdir.filename() / file.filename();
+        score->BackgroundPath = ConvertUTF8ToUnicode(meta.UBackgroundFileName);
+        score->WavePath = ConvertUTF8ToUnicode(meta.UWaveFileName);
+        score->Designer = meta.UDesigner;
+        score->BpmToShow = meta.ShowBpm;
+        score->Difficulty = meta.DifficultyType;
+        score->DifficultyName = meta.UExtraDifficulty;
+        score->Level = meta.Level;
+        music->Scores.push_back(score);
+    }
+    // 新しく見つかった曲が先頭に来る(以前のinsert(begin)と同じ並び)
+    for (const auto &category : newCategories) reverse(category->Musics.begin(), category->Musics.end());
+
+    // 追加・更新・削除があった時だけ書き直す
+    spdlog::get("main")->info(u8"譜面総数: {0:d} (解析 {1:d})", scoreFiles.size(), pendingFiles.size());
+    if (!pendingFiles.empty() || cachedRecords.size() != scoreFiles.size()) {
+        vector<std::tuple<string, const MusicFileRecord*>> indexRecords;
+        for (auto i = 0u; i < scoreFiles.size(); i++) indexRecords.emplace_back(std::get<2>(scoreFiles[i]), &records[i]);
+        SaveMusicIndex(indexPath, SU_TO_UINT32(scanRule), indexRecords);
+    } else if (staged) {
+        // 監視で起こされたが譜面は何も変わっていない
+        return;
     }
 
     {
         LockGuard lock(flagMutex);
-        loading = false;
+        if (staged) {
+            pendingCategories.swap(newCategories);
+            hasPendingCategories = true;
+        } else {
+            categories.swap(newCategories);
+            pendingCategories.clear();
+            hasPendingCategories = false;
+            ++generation;
+            loading = false;
+        }
     }
 }
 
@@ -161,6 +443,7 @@ std::shared_ptr<MusicScoreInfo> MusicSelectionCursor::GetScoreVariantAt(const in
 
 MusicSelectionCursor::MusicSelectionCursor(MusicsManager *manager)
     : manager(manager)
+    , generation(manager->ApplyPendingCategories())
     , categoryIndex(0)
     , musicIndex(-1)
     , variantIndex(-1)
@@ -170,12 +453,62 @@ MusicSelectionCursor::MusicSelectionCursor(MusicsManager *manager)
 MusicSelectionState MusicSelectionCursor::ReloadMusic(const bool async)
 {
     if (manager->IsReloading()) return MusicSelectionState::Reloading;
+    // 監視中は一覧が常に最新なので読み直さない
+    if (manager->IsWatching()) {
+        CheckUpdate();
+        return MusicSelectionState::Success;
+    }
 
     manager->Reload(async);
 
     return MusicSelectionState::Success;
 }
 
+// 一覧が差し替わっていたらtrue
+// 選択中のカテゴリと楽曲はなるべく同じものを指し続けるようにする
+bool MusicSelectionCursor::CheckUpdate()
+{
+    if (manager->IsReloading()) return false;
+    // 選曲を確定した後は番号がずれないように差し替えない
+    if (state == MusicSelectionState::OutOfFunction) return false;
+
+    const auto category = GetCategoryAt(0);
+    const auto music = state == MusicSelectionState::Music ? GetMusicAt(0) : nullptr;
+    const auto current = manager->ApplyPendingCategories();
+    if (generation == current) return false;
+    generation = current;
+
+    const auto &categories = manager->categories;
+    if (categories.empty()) {
+        categoryIndex = 0;
+        if (state == MusicSelectionState::Music) state = MusicSelectionState::Category;
+        return true;
+    }
+    const auto newCategory = category ? find_if(categories.begin(), categories.end(), [&](const std::shared_ptr<CategoryInfo> &info) {
+        return info->GetName() == category->GetName();
+    }) : categories.end();
+    if (newCategory == categories.end()) {
+        categoryIndex = min(categoryIndex, SU_TO_INT32(categories.size()) - 1);
+        if (state == MusicSelectionState::Music) state = MusicSelectionState::Category;
+        return true;
+    }
+    categoryIndex = SU_TO_INT32(newCategory - categories.begin());
+    if (state != MusicSelectionState::Music) return true;
+
+    const auto &musics = (*newCategory)->Musics;
+    const auto newMusic = find_if(musics.begin(), musics.end(), [&](const std::shared_ptr<MusicMetaInfo> &info) {
+        return music && info->SongId == music->SongId;
+    });
+    if (newMusic != musics.end()) {
+        musicIndex = SU_TO_INT32(newMusic - musics.begin());
+    } else if (musics.empty()) {
+        state = MusicSelectionState::Category;
+    } else {
+        musicIndex = min(musicIndex, SU_TO_INT32(musics.size()) - 1);
+    }
+    return true;
+}
+
 MusicSelectionState MusicSelectionCursor::ResetState()
 {
     if (manager->IsReloading()) return MusicSelectionState::Reloading;
@@ -275,8 +608,15 @@ MusicSelectionState MusicSelectionCursor::Enter()
             musicIndex = 0;
             variantIndex = 0;
             return MusicSelectionState::Success;
-        case MusicSelectionState::Music:
+        case MusicSelectionState::Music: {
             //選曲終了
+            const auto category = GetCategoryAt(0);
+            const auto score = GetScoreVariantAt(0);
+            if (!category || !score) return MusicSelectionState::Error;
+            {
+                LockGuard lock(manager->flagMutex);
+                manager->selectedScorePath = Setting::GetRootDirectory() / SU_MUSIC_DIR / ConvertUTF8ToUnicode(category->GetName()) / score->Path;
+            }
             manager->manager->SetData<int>("Selected:Category", categoryIndex);
             manager->manager->SetData<int>("Selected:Music", musicIndex);
             manager->manager->SetData<int>("Selected:Variant", variantIndex);
@@ -284,6 +624,7 @@ MusicSelectionState MusicSelectionCursor::Enter()
             manager->manager->SetData("Player:Background", GetBackgroundFileName(0));
             state = MusicSelectionState::OutOfFunction;
             return MusicSelectionState::Confirmed;
+        }
         default:
             return MusicSelectionState::OutOfFunction;
     }
@@ -439,6 +780,7 @@ void MusicSelectionCursor::RegisterScriptInterface(asIScriptEngine *engine)
     engine->RegisterObjectBehaviour(SU_IF_MSCURSOR, asBEHAVE_RELEASE, "void f()", asMETHOD(MusicSelectionCursor, Release), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_MSCURSOR, SU_IF_MSCSTATE " ReloadMusic(bool = false)", asMETHOD(MusicSelectionCursor, ReloadMusic), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_MSCURSOR, SU_IF_MSCSTATE " ResetState()", asMETHOD(MusicSelectionCursor, ResetState), asCALL_THISCALL);
+    engine->RegisterObjectMethod(SU_IF_MSCURSOR, "bool CheckUpdate()", asMETHOD(MusicSelectionCursor, CheckUpdate), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_MSCURSOR, "string GetPrimaryString(int = 0)", asMETHOD(MusicSelectionCursor, GetPrimaryString), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_MSCURSOR, "string GetCategoryName(int = 0)", asMETHOD(MusicSelectionCursor, GetCategoryName), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_MSCURSOR, "string GetMusicName(int = 0)", asMETHOD(MusicSelectionCursor, GetMusicName), asCALL_THISCALL);
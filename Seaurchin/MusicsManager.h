@@ -59,10 +59,20 @@ private:
     ExecutionManager *manager;
 
     bool loading = false;
+    bool hasPendingCategories = false;
+    uint32_t generation = 0;    // categoriesを差し替えるたびに増える
     std::mutex flagMutex;
-    std::unique_ptr<SusAnalyzer> analyzer;
+    std::mutex scanMutex;
     std::vector<std::shared_ptr<CategoryInfo>> categories;
-    void CreateMusicCache();
+    std::vector<std::shared_ptr<CategoryInfo>> pendingCategories;   // 監視スレッドで作った次の一覧
+    boost::filesystem::path selectedScorePath;                      // 選曲を確定したときの譜面 (一覧が差し替わっても変わらない)
+
+    std::thread watchThread;
+    HANDLE watchStopEvent = nullptr;
+
+    void CreateMusicCache(bool staged);
+    void WatchMusicDirectory();
+    uint32_t ApplyPendingCategories();
 
 public:
     explicit MusicsManager(ExecutionManager *exm);
@@ -71,6 +81,9 @@ public:
     static void Initialize();
     void Reload(bool async);
     bool IsReloading();
+    bool IsWatching() const { return watchThread.joinable(); }
+    void StartWatching();
+    void StopWatching();
     boost::filesystem::path GetSelectedScorePath();
 
     MusicSelectionCursor *CreateMusicSelectionCursor();
@@ -83,6 +96,7 @@ private:
     int refcount = 0;
 
     MusicsManager *manager;
+    uint32_t generation;
     int32_t categoryIndex;
     int32_t musicIndex;
     uint16_t variantIndex;
@@ -100,6 +114,7 @@ public:
 
     MusicSelectionState ReloadMusic(bool async);
     MusicSelectionState ResetState();
+    bool CheckUpdate();
 
     std::string GetPrimaryString(int32_t relativeIndex) const;
     std::string GetCategoryName(int32_t relativeIndex) const;
@@ -0,0 +1,47 @@
+﻿#include "NoteSpriteBatch.h"
+
+using namespace std;
+
+// 状態が変わるか頂点番号が溢れるなら、溜まっている分を先に描いてもらう
+void NoteSpriteBatch::Prepare(const NoteSpriteState &newState, const uint32_t quads)
+{
+    if (!vertices.empty() && (newState != state || GetQuadCount() + quads > MaxQuads)) Flush();
+    state = newState;
+}
+
+void NoteSpriteBatch::AddQuad(const NoteSpriteState &spriteState, const float left, const float top, const float right, const float bottom, const float u1, const float v1, const float u2, const float v2)
+{
+    Prepare(spriteState, 1);
+    const auto base = static_cast<uint16_t>(vertices.size());
+    vertices.push_back({ left, top, u1, v1 });
+    vertices.push_back({ right, top, u2, v1 });
+    vertices.push_back({ right, bottom, u2, v2 });
+    vertices.push_back({ left, bottom, u1, v2 });
+
+    // ScenePlayer.Draw.cppのrectVertexIndicesと同じ並び
+    const uint16_t quad[] = { 0, 1, 3, 3, 1, 2 };
+    for (const auto i : quad) indices.push_back(static_cast<uint16_t>(base + i));
+}
+
+// 横にblocks個並べる 左端と右端はテクスチャの1/3ずつ、間は中央の1/3を使う
+// 元のDrawTapが1ブロックずつDrawRectRotaGraph3Fしていたのと同じ配置
+void NoteSpriteBatch::AddNoteBlocks(const NoteSpriteState &spriteState, const float left, const float centerY, const float blockWidth, const float blockHeight, const uint32_t blocks, const float blockU, const float blockV)
+{
+    Prepare(spriteState, blocks);
+    const auto top = centerY - blockHeight / 2;
+    const auto bottom = centerY + blockHeight / 2;
+    for (auto i = 0u; i < blocks; i++) {
+        const auto type = i ? (i == blocks - 1 ? 2 : 1) : 0;
+        const auto x = left + blockWidth * i;
+        AddQuad(spriteState, x, top, x + blockWidth, bottom, blockU * type, 0, blockU * (type + 1), blockV);
+    }
+}
+
+void NoteSpriteBatch::Flush()
+{
+    if (vertices.empty()) return;
+    flush(*this);
+    vertices.clear();
+    indices.clear();
+    ++flushCount;
+}
@@ -0,0 +1,51 @@
+﻿#pragma once
+
+// ショートノーツ等の矩形スプライトをまとめて1回のポリゴン描画にするための頂点バッファ
+// DxLibには依存せず頂点と頂点番号を作るだけで、実際の描画はFlushで渡す関数に任せる
+
+struct NoteSpriteVertex final {
+    float X, Y;
+    float U, V;
+};
+
+// この組が同じ間は1つのバッチにまとめられる
+struct NoteSpriteState final {
+    int Texture = 0;
+    int BlendMode = 0;
+    int BlendParam = 0;
+
+    bool operator==(const NoteSpriteState &other) const
+    {
+        return Texture == other.Texture && BlendMode == other.BlendMode && BlendParam == other.BlendParam;
+    }
+    bool operator!=(const NoteSpriteState &other) const { return !(*this == other); }
+};
+
+class NoteSpriteBatch final {
+public:
+    using FlushFunction = std::function<void(const NoteSpriteBatch &batch)>;
+    static const uint32_t MaxQuads = 0x10000 / 4;   // 頂点番号がuint16_tに収まる数
+
+private:
+    FlushFunction flush;
+    NoteSpriteState state;
+    std::vector<NoteSpriteVertex> vertices;
+    std::vector<uint16_t> indices;
+    uint32_t flushCount = 0;
+
+    void Prepare(const NoteSpriteState &newState, uint32_t quads);
+
+public:
+    explicit NoteSpriteBatch(FlushFunction flushFunction) : flush(std::move(flushFunction)) {}
+
+    void AddQuad(const NoteSpriteState &spriteState, float left, float top, float right, float bottom, float u1, float v1, float u2, float v2);
+    void AddNoteBlocks(const NoteSpriteState &spriteState, float left, float centerY, float blockWidth, float blockHeight, uint32_t blocks, float blockU, float blockV);
+    void Flush();
+    void ResetFlushCount() { flushCount = 0; }
+
+    const NoteSpriteState &GetState() const { return state; }
+    const std::vector<NoteSpriteVertex> &GetVertices() const { return vertices; }
+    const std::vector<uint16_t> &GetIndices() const { return indices; }
+    uint32_t GetQuadCount() const { return static_cast<uint32_t>(vertices.size() / 4); }
+    uint32_t GetFlushCount() const { return flushCount; }
+};
@@ -61,7 +61,7 @@ void PlayableProcessor::Reset()
     imageHoldLight = dynamic_cast<SImage*>(player->resources["LaneHoldLight"]);
 }
 
-bool PlayableProcessor::ShouldJudge(std::shared_ptr<SusDrawableNoteData> note)
+bool PlayableProcessor::ShouldJudge(const std::shared_ptr<SusDrawableNoteData> &note)
 {
     auto current = player->currentTime - note->StartTime;
     const auto extra = 0.033;
@@ -84,6 +84,14 @@ bool PlayableProcessor::ShouldJudge(std::shared_ptr<SusDrawableNoteData> note)
     return current >= -leastWidthSlider && current <= leastWidthSlider;
 }
 
+double PlayableProcessor::GetJudgeMargin() const
+{
+    const auto extra = 0.033;
+    const auto leastWidthAir = judgeWidthAttack * judgeMultiplierAir + extra;
+    const auto leastWidthSlider = judgeWidthAttack * judgeMultiplierSlider + extra;
+    return max(leastWidthAir + fabs(judgeAdjustAirString), leastWidthSlider + fabs(judgeAdjustSlider));
+}
+
 void PlayableProcessor::Update(vector<shared_ptr<SusDrawableNoteData>>& notes)
 {
     auto slideCheck = false;
@@ -230,19 +238,13 @@ bool PlayableProcessor::CheckJudgement(const shared_ptr<SusDrawableNoteData>& no
     reltime /= judgeMultiplierSlider;
     if (note->OnTheFlyData.test(size_t(NoteAttribute::Finished))) return false;
     if (reltime < -judgeWidthAttack) return false;
-    if (reltime > judgeWidthAttack) {
-        if (note->Type[size_t(SusNoteType::ExTap)]) {
-            ResetCombo(note, { AbilityNoteType::ExTap, note->StartLane, note->StartLane + note->Length });
-        } else if (note->Type[size_t(SusNoteType::Flick)]) {
-            ResetCombo(note, { AbilityNoteType::Flick, note->StartLane, note->StartLane + note->Length });
-        } else {
-            ResetCombo(note, { AbilityNoteType::Tap, note->StartLane, note->StartLane + note->Length });
-        }
-        return false;
-    }
+
+    // フレームの時刻ではなく実際に押された時刻で判定する
     const int left = SU_TO_INT32(note->StartLane), right = SU_TO_INT32(note->StartLane + note->Length);
     for (int i = left; i < right; i++) {
         if (!currentState->GetTriggerState(ControllerSource::IntegratedSliders, i)) continue;
+        const auto pressTime = reltime - currentState->GetTriggerDelay(ControllerSource::IntegratedSliders, i) / judgeMultiplierSlider;
+        if (pressTime < -judgeWidthAttack || pressTime > judgeWidthAttack) continue;
         if (note->Type[size_t(SusNoteType::ExTap)]) {
             IncrementComboEx(note, "");
         } else if (note->Type[size_t(SusNoteType::AwesomeExTap)]) {
@@ -253,12 +255,21 @@ bool PlayableProcessor::CheckJudgement(const shared_ptr<SusDrawableNoteData>& no
                 : "AwesomeExTapUp"
             );
         } else if (note->Type[size_t(SusNoteType::Flick)]) {
-            IncrementCombo(note, reltime, { AbilityNoteType::Flick, note->StartLane, note->StartLane + note->Length }, "");
+            IncrementCombo(note, pressTime, { AbilityNoteType::Flick, note->StartLane, note->StartLane + note->Length }, "");
         } else {
-            IncrementCombo(note, reltime, { AbilityNoteType::Tap, note->StartLane, note->StartLane + note->Length }, "");
+            IncrementCombo(note, pressTime, { AbilityNoteType::Tap, note->StartLane, note->StartLane + note->Length }, "");
         }
         return true;
     }
+    if (reltime > judgeWidthAttack) {
+        if (note->Type[size_t(SusNoteType::ExTap)]) {
+            ResetCombo(note, { AbilityNoteType::ExTap, note->StartLane, note->StartLane + note->Length });
+        } else if (note->Type[size_t(SusNoteType::Flick)]) {
+            ResetCombo(note, { AbilityNoteType::Flick, note->StartLane, note->StartLane + note->Length });
+        } else {
+            ResetCombo(note, { AbilityNoteType::Tap, note->StartLane, note->StartLane + note->Length });
+        }
+    }
     return false;
 }
 
@@ -280,7 +291,9 @@ bool PlayableProcessor::CheckHellJudgement(const shared_ptr<SusDrawableNoteData>
     const int left = SU_TO_INT32(note->StartLane), right = SU_TO_INT32(note->StartLane + note->Length);
     for (int i = left; i < right; i++) {
         /* 押しっぱなしにしていた時にJC出るのは違う気がした */
-        if (!currentState->GetCurrentState(ControllerSource::IntegratedSliders, i)) continue;
+        /* フレーム内で押して離した場合も押したことにする */
+        if (!currentState->GetCurrentState(ControllerSource::IntegratedSliders, i)
+            && !currentState->GetTriggerState(ControllerSource::IntegratedSliders, i)) continue;
         IncrementComboHell(note, 1, "");
         return false;
     }
@@ -293,24 +306,25 @@ bool PlayableProcessor::CheckAirJudgement(const shared_ptr<SusDrawableNoteData>&
     reltime /= judgeMultiplierAir;
     if (note->OnTheFlyData.test(size_t(NoteAttribute::Finished))) return false;
     if (reltime < -judgeWidthAttack) return false;
+
+    if (!isAutoAir) {
+        const auto source = note->Type[size_t(SusNoteType::Up)] ? int(AirControlSource::AirUp) : int(AirControlSource::AirDown);
+        if (currentState->GetTriggerState(ControllerSource::IntegratedAir, source)) {
+            // フレームの時刻ではなく実際に入力された時刻で判定する
+            const auto inputTime = reltime - currentState->GetTriggerDelay(ControllerSource::IntegratedAir, source) / judgeMultiplierAir;
+            if (inputTime >= -judgeWidthAttack && inputTime <= judgeWidthAttack) {
+                IncrementComboAir(note, (inputTime < 0.0) ? 0.0 : inputTime, { AbilityNoteType::Air, note->StartLane, note->StartLane + note->Length }, "");
+                return true;
+            }
+        }
+    }
     if (reltime > judgeWidthAttack) {
         ResetCombo(note, { AbilityNoteType::Air, note->StartLane, note->StartLane + note->Length });
         return false;
     }
-
-    if (isAutoAir) {
-        if (reltime >= 0) {
-            IncrementComboAir(note, reltime, { AbilityNoteType::Air, note->StartLane, note->StartLane + note->Length }, "");
-            return true;
-        }
-    } else {
-        const auto judged = currentState->GetTriggerState(
-            ControllerSource::IntegratedAir,
-            note->Type[size_t(SusNoteType::Up)] ? int(AirControlSource::AirUp) : int(AirControlSource::AirDown));
-        if (judged) {
-            IncrementComboAir(note, (reltime < 0.0) ? 0.0 : reltime, { AbilityNoteType::Air, note->StartLane, note->StartLane + note->Length }, "");
-            return true;
-        }
+    if (isAutoAir && reltime >= 0) {
+        IncrementComboAir(note, reltime, { AbilityNoteType::Air, note->StartLane, note->StartLane + note->Length }, "");
+        return true;
     }
     return false;
 }
@@ -326,23 +340,30 @@ bool PlayableProcessor::CheckHoldJudgement(const shared_ptr<SusDrawableNoteData>
     const auto right = left + note->Length;
     // left <= i < right で判定
     auto held = false, trigger = false, release = false;
+    auto triggerDelay = 0.0;
     const int l = SU_TO_INT32(left), r = SU_TO_INT32(right);
     for (auto i = l; i < r; i++) {
         held |= currentState->GetCurrentState(ControllerSource::IntegratedSliders, i);
-        trigger |= currentState->GetTriggerState(ControllerSource::IntegratedSliders, i);
+        if (currentState->GetTriggerState(ControllerSource::IntegratedSliders, i)) {
+            // 複数レーンで押されていたら一番早い入力を採る
+            const auto delay = currentState->GetTriggerDelay(ControllerSource::IntegratedSliders, i);
+            triggerDelay = trigger ? max(triggerDelay, delay) : delay;
+            trigger = true;
+        }
         release |= currentState->GetLastState(ControllerSource::IntegratedSliders, i) && !currentState->GetCurrentState(ControllerSource::IntegratedSliders, i);
     }
     auto judgeTime = player->currentTime - note->StartTime - judgeAdjustSlider;
     judgeTime /= judgeMultiplierSlider;
+    const auto pressTime = judgeTime - triggerDelay / judgeMultiplierSlider;
 
     // Start判定
     if (!note->OnTheFlyData[size_t(NoteAttribute::Finished)]) {
-        if (judgeTime >= judgeWidthAttack) {
-            ResetCombo(note, { AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length });
-        } else if (trigger) {
-            IncrementCombo(note, judgeTime, { AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length }, "");
+        if (trigger && pressTime >= -judgeWidthAttack && pressTime < judgeWidthAttack) {
+            IncrementCombo(note, pressTime, { AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length }, "");
             player->EnqueueJudgeSound(JudgeSoundType::Tap);
             player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
+        } else if (judgeTime >= judgeWidthAttack) {
+            ResetCombo(note, { AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length });
         }
 
         if (held) {
@@ -425,7 +446,7 @@ bool PlayableProcessor::CheckSlideJudgement(const shared_ptr<SusDrawableNoteData
         right = left + note->Length;
     } else {
         // カーブデータ存在範囲内
-        auto &refcurve = player->curveData[refNote];
+        const auto refcurve = player->curveData.GetCurve(*refNote);
         const auto timeInBlock = player->currentTime - lastStep->StartTime;
         auto start = refcurve[0];
         auto next = refcurve[0];
@@ -446,23 +467,30 @@ bool PlayableProcessor::CheckSlideJudgement(const shared_ptr<SusDrawableNoteData
     }
     // left <= i < right で判定
     auto held = false, trigger = false, release = false;
+    auto triggerDelay = 0.0;
     const int l = SU_TO_INT32(left), r = SU_TO_INT32(right);
     for (auto i = l; i < r; i++) {
         held |= currentState->GetCurrentState(ControllerSource::IntegratedSliders, i);
-        trigger |= currentState->GetTriggerState(ControllerSource::IntegratedSliders, i);
+        if (currentState->GetTriggerState(ControllerSource::IntegratedSliders, i)) {
+            // 複数レーンで押されていたら一番早い入力を採る
+            const auto delay = currentState->GetTriggerDelay(ControllerSource::IntegratedSliders, i);
+            triggerDelay = trigger ? max(triggerDelay, delay) : delay;
+            trigger = true;
+        }
         release |= currentState->GetLastState(ControllerSource::IntegratedSliders, i) && !currentState->GetCurrentState(ControllerSource::IntegratedSliders, i);
     }
     auto judgeTime = player->currentTime - note->StartTime - judgeAdjustSlider;
     judgeTime /= judgeMultiplierSlider;
+    const auto pressTime = judgeTime - triggerDelay / judgeMultiplierSlider;
 
     // Start判定
     if (!note->OnTheFlyData[size_t(NoteAttribute::Finished)]) {
-        if (judgeTime >= judgeWidthAttack) {
-            ResetCombo(note, { AbilityNoteType::Slide, note->StartLane, note->StartLane + note->Length });
-        } else if (trigger) {
-            IncrementCombo(note, judgeTime, { AbilityNoteType::Slide, note->StartLane, note->StartLane + note->Length }, "");
+        if (trigger && pressTime >= -judgeWidthAttack && pressTime < judgeWidthAttack) {
+            IncrementCombo(note, pressTime, { AbilityNoteType::Slide, note->StartLane, note->StartLane + note->Length }, "");
             player->EnqueueJudgeSound(JudgeSoundType::SlideStep);
             player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
+        } else if (judgeTime >= judgeWidthAttack) {
+            ResetCombo(note, { AbilityNoteType::Slide, note->StartLane, note->StartLane + note->Length });
         }
 
         if (held) {
@@ -574,14 +602,17 @@ void PlayableProcessor::IncrementCombo(const shared_ptr<SusDrawableNoteData>& no
     reltime = fabs(reltime);
     if (reltime <= judgeWidthJusticeCritical) {
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
+        player->RecordJudge(note, info, AbilityJudgeType::JusticeCritical);
         player->currentResult->PerformJusticeCritical();
         player->currentCharacterInstance->OnJusticeCritical(info, extra);
     } else if (reltime <= judgeWidthJustice) {
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
+        player->RecordJudge(note, info, AbilityJudgeType::Justice);
         player->currentResult->PerformJustice();
         player->currentCharacterInstance->OnJustice(info, extra);
     } else {
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
+        player->RecordJudge(note, info, AbilityJudgeType::Attack);
         player->currentResult->PerformAttack();
         player->currentCharacterInstance->OnAttack(info, extra);
     }
@@ -589,21 +620,25 @@ void PlayableProcessor::IncrementCombo(const shared_ptr<SusDrawableNoteData>& no
 
 void PlayableProcessor::IncrementComboEx(const shared_ptr<SusDrawableNoteData>& note, const string& extra) const
 {
+    const JudgeInformation info = { note->Type[size_t(SusNoteType::AwesomeExTap)] ? AbilityNoteType::AwesomeExTap : AbilityNoteType::ExTap, note->StartLane, note->StartLane + note->Length };
     note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
+    player->RecordJudge(note, info, AbilityJudgeType::JusticeCritical);
     player->currentResult->PerformJusticeCritical();
-    player->currentCharacterInstance->OnJusticeCritical({ note->Type[size_t(SusNoteType::AwesomeExTap)] ? AbilityNoteType::AwesomeExTap : AbilityNoteType::ExTap, note->StartLane, note->StartLane + note->Length }, extra);
+    player->currentCharacterInstance->OnJusticeCritical(info, extra);
 }
 
 void PlayableProcessor::IncrementComboHell(const std::shared_ptr<SusDrawableNoteData>& note, const int state, const string& extra) const
 {
+    const JudgeInformation info = { AbilityNoteType::HellTap, note->StartLane, note->StartLane + note->Length };
     switch (state) {
         case -1:
             // 無事判定終了、もう心配ない
             /* ここで初めてJC扱いにする */
             note->OnTheFlyData.reset(size_t(NoteAttribute::HellChecking));
             note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
+            player->RecordJudge(note, info, AbilityJudgeType::JusticeCritical);
             player->currentResult->PerformJusticeCritical();
-            player->currentCharacterInstance->OnJusticeCritical({ AbilityNoteType::HellTap, note->StartLane, note->StartLane + note->Length }, extra);
+            player->currentCharacterInstance->OnJusticeCritical(info, extra);
             break;
         case 0:
             // とりあえず通過した
@@ -614,8 +649,9 @@ void PlayableProcessor::IncrementComboHell(const std::shared_ptr<SusDrawableNote
             break;
         case 1:
             // 判定失敗
+            player->RecordJudge(note, info, AbilityJudgeType::Miss);
             player->currentResult->PerformMiss();
-            player->currentCharacterInstance->OnMiss({ AbilityNoteType::HellTap, note->StartLane, note->StartLane + note->Length }, extra);
+            player->currentCharacterInstance->OnMiss(info, extra);
             note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
             break;
         default: break;
@@ -627,14 +663,17 @@ void PlayableProcessor::IncrementComboAir(const std::shared_ptr<SusDrawableNoteD
     reltime = fabs(reltime);
     if (reltime <= judgeWidthJusticeCritical) {
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
+        player->RecordJudge(note, info, AbilityJudgeType::JusticeCritical);
         player->currentResult->PerformJusticeCritical();
         player->currentCharacterInstance->OnJusticeCritical(info, extra);
     } else if (reltime <= judgeWidthJustice) {
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
+        player->RecordJudge(note, info, AbilityJudgeType::Justice);
         player->currentResult->PerformJustice();
         player->currentCharacterInstance->OnJustice(info, extra);
     } else {
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
+        player->RecordJudge(note, info, AbilityJudgeType::Attack);
         player->currentResult->PerformAttack();
         player->currentCharacterInstance->OnAttack(info, extra);
     }
@@ -643,6 +682,7 @@ void PlayableProcessor::IncrementComboAir(const std::shared_ptr<SusDrawableNoteD
 void PlayableProcessor::ResetCombo(const shared_ptr<SusDrawableNoteData>& note, const JudgeInformation &info) const
 {
     note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
+    player->RecordJudge(note, info, AbilityJudgeType::Miss);
     player->currentResult->PerformMiss();
     player->currentCharacterInstance->OnMiss(info, "");
 }
@@ -0,0 +1,73 @@
+﻿#pragma once
+
+// プラットフォームに依存しないライブラリだけのヘッダ
+// Windows版ではPrecompiledHeader.hから、ポータブルビルド(CMakeLists.txt)では直接強制includeする
+
+//C Runtime
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cassert>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+
+//C++ Standard
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <ios>
+#include <map>
+#include <set>
+#include <bitset>
+#include <utility>
+#include <limits>
+#include <unordered_set>
+#include <unordered_map>
+#include <forward_list>
+#include <list>
+#include <tuple>
+#include <random>
+#include <exception>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <numeric>
+
+//Boost
+#include <boost/config.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <boost/regex.hpp>
+#include <boost/xpressive/xpressive.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/algorithm/clamp.hpp>
+#include <boost/crc.hpp>
+#include <boost/any.hpp>
+#include <boost/spirit/include/qi.hpp>
+#include <boost/optional.hpp>
+#include <boost/utility/string_view.hpp>
+#include <boost/range/sub_range.hpp>
+#include <boost/lockfree/queue.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+
+#ifndef SPDLOG_FMT_EXTERNAL
+#define SPDLOG_FMT_EXTERNAL
+#endif
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/sink.h>
+
+#include "Crc32.h"
@@ -0,0 +1,25 @@
+﻿#include "Misc.h"
+#include "ScoreBenchmark.h"
+#include "MixerBenchmark.h"
+
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+using namespace std;
+
+// ポータブルビルド(CMakeLists.txt)の入口
+// Windows版と同じコマンドラインで、DxLibもBASSも使わない計測モードだけを動かす
+int main(const int argc, char *argv[])
+{
+    vector<wstring> args;
+    for (auto i = 0; i < argc; i++) args.push_back(ConvertUTF8ToUnicode(argv[i]));
+
+    auto log = spdlog::stdout_color_mt("main");
+    ScoreBenchmarkOptions benchmarkOptions;
+    if (ScoreBenchmarkOptions::Parse(args, benchmarkOptions)) return ScoreBenchmark(benchmarkOptions).Run() ? 0 : 1;
+    MixerBenchmarkOptions mixerBenchmarkOptions;
+    if (MixerBenchmarkOptions::Parse(args, mixerBenchmarkOptions)) return MixerBenchmark(mixerBenchmarkOptions).Run() ? 0 : 1;
+
+    log->error(u8"使い方: {0} --benchmark <コーパスのディレクトリ> [--output <結果.json>] [--repeat <回数>]", argv[0]);
+    log->error(u8"        {0} --mixer-benchmark <結果.json> [--wave <出力.wav>] [--buffer <フレーム数>] [--voices <同時発音数>] [--seconds <秒>]", argv[0]);
+    return 2;
+}
@@ -15,54 +15,7 @@
 #include <intrin.h>
 
 
-//C Runtime
-#include <cstdio>
-#include <cstdlib>
-#include <cstdint>
-#include <cassert>
-#include <cstring>
-#include <cmath>
-
-//C++ Standard
-#include <string>
-#include <iostream>
-#include <iomanip>
-#include <fstream>
-#include <sstream>
-#include <vector>
-#include <memory>
-#include <algorithm>
-#include <functional>
-#include <chrono>
-#include <ios>
-#include <map>
-#include <utility>
-#include <limits>
-#include <unordered_set>
-#include <unordered_map>
-#include <forward_list>
-#include <list>
-#include <tuple>
-#include <random>
-#include <exception>
-#include <future>
-#include <thread>
-#include <numeric>
-
-//Boost
-#include <boost/config.hpp>
-#include <boost/filesystem.hpp>
-#include <boost/range/iterator_range.hpp>
-#include <boost/regex.hpp>
-#include <boost/xpressive/xpressive.hpp>
-#include <boost/algorithm/string.hpp>
-#include <boost/algorithm/clamp.hpp>
-#include <boost/crc.hpp>
-#include <boost/any.hpp>
-#include <boost/spirit/include/qi.hpp>
-#include <boost/optional.hpp>
-#include <boost/range/sub_range.hpp>
-#include <boost/lockfree/queue.hpp>
+#include "PortableHeader.h"
 
 //Libraries
 #include <DxLib.h>
@@ -90,17 +43,9 @@
 #include <bassmix.h>
 #include <bass_fx.h>
 
-#define FMT_HEADER_ONLY
-#include <fmt/format.h>
-
-#define SPDLOG_FMT_EXTERNAL
-#include <spdlog/spdlog.h>
 #include <spdlog/sinks/wincolor_sink.h>
-#include <spdlog/sinks/sink.h>
 
 #include <toml/toml.h>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
-
-#include "Crc32.h"
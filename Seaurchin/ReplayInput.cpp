@@ -0,0 +1,91 @@
+﻿#include "ReplayInput.h"
+
+using namespace std;
+
+bool ReplayOptions::Parse(const vector<wstring> &args, ReplayOptions &options)
+{
+    auto found = false;
+    for (auto i = 0u; i + 1 < args.size(); i++) {
+        const auto &value = args[i + 1];
+        if (args[i] == SU_REPLAY_OPTION) {
+            options.ScorePath = value;
+            found = true;
+        } else if (args[i] == L"--input") {
+            options.InputPath = value;
+        } else if (args[i] == L"--output") {
+            options.OutputPath = value;
+        } else if (args[i] == L"--delta") {
+            options.Delta = wcstod(value.c_str(), nullptr);
+        } else {
+            continue;
+        }
+        ++i;
+    }
+    if (found && options.OutputPath.empty()) options.OutputPath = options.ScorePath + L".replay.txt";
+    return found;
+}
+
+// 形式が正しくない行があればその行番号をログに出してfalse
+bool ReplayInputTimeline::Load(istream &stream)
+{
+    auto log = spdlog::get("main");
+    inputs.clear();
+    Rewind();
+
+    string rawline;
+    uint32_t line = 0;
+    while (getline(stream, rawline)) {
+        ++line;
+        if (!rawline.empty() && rawline.back() == '\r') rawline.pop_back();
+        if (rawline.empty() || rawline[0] == '#') continue;
+
+        istringstream fields(rawline);
+        string sliders, air, rest;
+        ControlSnapshot snapshot = { 0, 0, 0 };
+        auto valid = (fields >> snapshot.Time >> sliders) && sliders.size() == 16 && sliders.find_first_not_of("01") == string::npos;
+        fields >> air;
+        valid = valid && air.find_first_not_of("UDHA") == string::npos && !(fields >> rest);
+        if (!valid) {
+            log->error(u8"リプレイ入力 {0}行目の形式が正しくありません", line);
+            inputs.clear();
+            return false;
+        }
+        for (auto i = 0; i < 16; i++) if (sliders[i] == '1') snapshot.Sliders |= 1 << i;
+        for (const auto c : air) {
+            switch (c) {
+                case 'U': snapshot.Air |= 1 << size_t(AirControlSource::AirUp); break;
+                case 'D': snapshot.Air |= 1 << size_t(AirControlSource::AirDown); break;
+                case 'H': snapshot.Air |= 1 << size_t(AirControlSource::AirHold); break;
+                case 'A': snapshot.Air |= 1 << size_t(AirControlSource::AirAction); break;
+                default: break;
+            }
+        }
+        inputs.push_back(snapshot);
+    }
+    stable_sort(inputs.begin(), inputs.end(), [](const ControlSnapshot &a, const ControlSnapshot &b) {
+        return a.Time < b.Time;
+    });
+    return true;
+}
+
+void ReplayInputTimeline::Rewind()
+{
+    nextInput = 0;
+    lastInput = {};
+}
+
+// timeまでの入力をまとめて1フレーム分にする
+// 1フレームの間に入った立ち上がりは取りこぼさないように全部立てる
+// (スライダーは押してすぐ離していても、そのフレームは押していることにする)
+ControlSnapshot ReplayInputTimeline::GetSnapshotUntil(const double time)
+{
+    auto air = uint8_t(0);
+    auto pressed = uint16_t(0);
+    while (nextInput < inputs.size() && inputs[nextInput].Time <= time) {
+        pressed |= inputs[nextInput].Sliders & ~lastInput.Sliders;
+        lastInput = inputs[nextInput++];
+        air |= lastInput.Air;
+    }
+    const auto holdMask = uint8_t(1 << size_t(AirControlSource::AirHold));
+    return { time, uint16_t(lastInput.Sliders | pressed), uint8_t((air & ~holdMask) | (lastInput.Air & holdMask)) };
+}
@@ -0,0 +1,34 @@
+﻿#pragma once
+
+#include "Controller.h"
+
+#define SU_REPLAY_OPTION L"--replay"
+
+// ReplayRunnerの設定 コマンドライン
+//   --replay <譜面.sus> [--input <入力>] [--output <出力>] [--delta <秒>]
+struct ReplayOptions {
+    std::wstring ScorePath;
+    std::wstring InputPath;         // 空ならオートプレイ
+    std::wstring OutputPath;        // 空なら譜面と同じ場所の<譜面>.replay.txt
+    double Delta = 1.0 / 60.0;      // 1Tickで進める時間
+
+    static bool Parse(const std::vector<std::wstring> &args, ReplayOptions &options);
+};
+
+// 記録済みの入力タイムライン 1行1回分で、その時刻以降はその状態になる
+//   <時刻(秒)> <スライダー0～15を0/1で16桁> [Airの立ち上がり U/D/A, 押している間 H]
+// '#'で始まる行と空行は読み飛ばす
+class ReplayInputTimeline final {
+private:
+    std::vector<ControlSnapshot> inputs;    // Time順
+    size_t nextInput = 0;
+    ControlSnapshot lastInput {};
+
+public:
+    bool Load(std::istream &stream);
+    void Rewind();
+    ControlSnapshot GetSnapshotUntil(double time);
+
+    bool IsEmpty() const { return inputs.empty(); }
+    size_t GetSize() const { return inputs.size(); }
+};
@@ -0,0 +1,109 @@
+﻿#include "ReplayRunner.h"
+#include "ExecutionManager.h"
+#include "ScenePlayer.h"
+#include "Misc.h"
+
+using namespace std;
+
+static const char *noteTypeNames[] = { "", "Tap", "ExTap", "AwesomeExTap", "Flick", "Air", "HellTap", "Hold", "Slide", "AirAction" };
+static const char *judgeTypeNames[] = { "", "JusticeCritical", "Justice", "Attack", "Miss" };
+
+ReplayRunner::ReplayRunner(ExecutionManager *exm, const ReplayOptions &options)
+    : manager(exm)
+    , options(options)
+{}
+
+// 入力ファイルが無ければオートプレイなので何も読まない
+bool ReplayRunner::LoadInputs()
+{
+    auto log = spdlog::get("main");
+    if (options.InputPath.empty()) {
+        inputs = ReplayInputTimeline();
+        return true;
+    }
+
+    ifstream file(options.InputPath, ios::in);
+    if (!file) {
+        log->error(u8"リプレイ入力 {0} を開けませんでした", ConvertUnicodeToUTF8(options.InputPath));
+        return false;
+    }
+    if (!inputs.Load(file)) return false;
+    log->info(u8"リプレイ入力 {0}件", inputs.GetSize());
+    return true;
+}
+
+bool ReplayRunner::Run()
+{
+    auto log = spdlog::get("main");
+    if (options.Delta <= 0) {
+        log->error(u8"リプレイの時間刻みは正の値にしてください");
+        return false;
+    }
+    if (!boost::filesystem::exists(options.ScorePath)) {
+        log->error(u8"譜面 {0} が見つかりません", ConvertUnicodeToUTF8(options.ScorePath));
+        return false;
+    }
+    if (!LoadInputs()) return false;
+    // 入力は記録済みのものだけを使う
+    manager->GetControlStateUnsafe()->StopSampling();
+
+    // 入力が無ければオートプレイ
+    manager->SetData<int>("AutoPlay", inputs.IsEmpty() ? 1 : 0);
+    const auto player = manager->CreatePlayer();
+    player->isReplaying = true;
+    player->replayScorePath = options.ScorePath;
+    player->Initialize();
+    player->LoadWorker();
+    player->GetReady();
+    player->Play();
+
+    // 最後のノーツの判定幅を過ぎるまで進める
+    const auto controlState = manager->GetControlStateUnsafe();
+    const auto endTime = player->scoreDuration + player->processor->GetJudgeMargin();
+    auto frames = 0u;
+    while (player->currentTime <= endTime) {
+        if (!inputs.IsEmpty()) controlState->UpdateFromSnapshot(inputs.GetSnapshotUntil(player->currentTime + options.Delta));
+        player->Tick(options.Delta);
+        ++frames;
+    }
+    log->info(u8"リプレイ終了 {0}フレーム 判定{1}件", frames, player->judgeLog.size());
+
+    const auto written = WriteResult(*player);
+    player->Release();
+    return written;
+}
+
+// 最終結果と判定ログをテキストで書き出す 回帰テストで差分を取れるように並びは固定
+bool ReplayRunner::WriteResult(const ScenePlayer &player) const
+{
+    auto log = spdlog::get("main");
+    ofstream file(options.OutputPath, ios::out | ios::trunc);
+    if (!file) {
+        log->error(u8"リプレイ結果 {0} を書き出せませんでした", ConvertUnicodeToUTF8(options.OutputPath));
+        return false;
+    }
+
+    DrawableResult result;
+    player.GetCurrentResult(&result);
+    file << fmt::format("JusticeCritical {0}\n", result.JusticeCritical);
+    file << fmt::format("Justice {0}\n", result.Justice);
+    file << fmt::format("Attack {0}\n", result.Attack);
+    file << fmt::format("Miss {0}\n", result.Miss);
+    file << fmt::format("Combo {0}\n", result.Combo);
+    file << fmt::format("MaxCombo {0}\n", result.MaxCombo);
+    file << fmt::format("Notes {0}\n", result.Notes);
+    file << fmt::format("PastNotes {0}\n", result.PastNotes);
+    file << fmt::format("FulfilledGauges {0}\n", result.FulfilledGauges);
+    file << fmt::format("CurrentGaugeRatio {0:.6f}\n", result.CurrentGaugeRatio);
+    file << fmt::format("Score {0}\n", result.Score);
+
+    file << "# Time NoteTime Note Judge Left Right\n";
+    for (const auto &entry : player.judgeLog) {
+        file << fmt::format("{0:.6f} {1:.6f} {2} {3} {4} {5}\n",
+            entry.Time, entry.NoteTime,
+            noteTypeNames[size_t(entry.Note)], judgeTypeNames[size_t(entry.Judge)],
+            entry.Left, entry.Right);
+    }
+    log->info(u8"リプレイ結果を {0} に書き出しました", ConvertUnicodeToUTF8(options.OutputPath));
+    return true;
+}
@@ -0,0 +1,22 @@
+﻿#pragma once
+
+#include "ReplayInput.h"
+
+class ExecutionManager;
+class ScenePlayer;
+// 画面と音声を使わずにScenePlayerを固定刻みで最後まで進め、最終結果と判定ログを書き出す
+// 入力は記録済みのタイムラインから作るので、同じ譜面と入力なら毎回同じ結果になる
+class ReplayRunner final {
+private:
+    ExecutionManager *manager;
+    ReplayOptions options;
+    ReplayInputTimeline inputs;
+
+    bool LoadInputs();
+    bool WriteResult(const ScenePlayer &player) const;
+
+public:
+    ReplayRunner(ExecutionManager *exm, const ReplayOptions &options);
+
+    bool Run();
+};
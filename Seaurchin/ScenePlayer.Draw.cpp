@@ -84,6 +84,9 @@ void ScenePlayer::LoadResources()
     slideLineColor = GetColor(scv[0].as<int>(), scv[1].as<int>(), scv[2].as<int>());
     airActionJudgeColor = GetColor(aajcv[0].as<int>(), aajcv[1].as<int>(), aajcv[2].as<int>());
 
+    // リプレイでは描画しないので画面やバッファを作らない
+    if (isReplaying) return;
+
     // 2^x制限があるのでここで計算
     const auto exty = laneBufferX * SU_LANE_ASPECT_EXT;
     auto bufferY = 2.0f;
@@ -92,6 +95,7 @@ void ScenePlayer::LoadResources()
     for (auto i = 2; i < 4; i++) groundVertices[i].v = bufferV;
     if (hGroundBuffer) DeleteGraph(hGroundBuffer);
     hGroundBuffer = MakeScreen(SU_TO_INT32(laneBufferX), SU_TO_INT32(bufferY), TRUE);
+    CreateGroundBuffers();
 
     if (!spriteLane) {
         SSynthSprite *pSynthSprite = SSynthSprite::Factory(1024, 4224);
@@ -144,35 +148,21 @@ void ScenePlayer::Draw()
     spriteLane->Draw();
     SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
     SetDrawBright(255, 255, 255);
-    for (auto& note : seenData) {
-        auto &type = note->Type;
-        if (type[size_t(SusNoteType::MeasureLine)]) DrawMeasureLine(note);
-    }
-
-    // 下側のロングノーツ類
-    for (auto& note : seenData) {
-        auto &type = note->Type;
-        if (type[size_t(SusNoteType::Hold)]) DrawHoldNotes(note);
-        if (type[size_t(SusNoteType::Slide)]) DrawSlideNotes(note);
-    }
-
-    // 上側のショートノーツ類
-    for (auto& note : seenData) {
-        const auto type = note->Type.to_ulong();
-#define GET_BIT(num) (1UL << (int(num)))
-        const auto mask = GET_BIT(SusNoteType::Tap) | GET_BIT(SusNoteType::ExTap) | GET_BIT(SusNoteType::AwesomeExTap) | GET_BIT(SusNoteType::Flick) | GET_BIT(SusNoteType::HellTap) | GET_BIT(SusNoteType::Grounded);
-#undef GET_BIT
-        if (type & mask) DrawShortNotes(note);
-    }
+    BuildRenderCommands();
+    SubmitRenderCommands(RenderLayer::ShortNote);
 
     FINISH_DRAW_TRANSACTION;
     Prepare3DDrawCall();
-    DrawPolygonIndexed3D(groundVertices, 4, rectVertexIndices, 2, hGroundBuffer, TRUE);
+    if (hGroundVertexBuffer != -1 && hGroundIndexBuffer != -1) {
+        DrawPolygonIndexed3D_UseVertexBuffer(hGroundVertexBuffer, hGroundIndexBuffer, hGroundBuffer, TRUE);
+    } else {
+        DrawPolygonIndexed3D(groundVertices, 4, rectVertexIndices, 2, hGroundBuffer, TRUE);
+    }
     for (auto& i : sprites) i->Draw();
 
     //3D系ノーツ
     Prepare3DDrawCall();
-    DrawAerialNotes(seenData);
+    SubmitRenderCommands(RenderLayer::AirActionStepBox);
 
     if (airActionShown && showAirActionJudge) {
         SetDrawBlendMode(DX_BLENDMODE_ADD, 192);
@@ -190,72 +180,173 @@ void ScenePlayer::Draw()
     }
 }
 
-void ScenePlayer::DrawAerialNotes(const vector<shared_ptr<SusDrawableNoteData>>& notes)
+// seenDataから1フレーム分の描画命令を作って描画順に並べる
+// 層の順と(usePrioritySortなら)優先度の順、同じ層・同じ優先度の中のseenDataの順は今まで通り
+// 並べ替えで重なりは変えず、隣り合う命令の描画状態が同じならSubmitRenderCommandsで切り替えを省く
+void ScenePlayer::BuildRenderCommands()
 {
-    vector<AirDrawQuery> airdraws, covers;
-    for (const auto &note : seenData) {
-        if (note->Type.test(size_t(SusNoteType::AirAction))) {
-            // DrawAirActionNotes(note);
-            AirDrawQuery head;
-            head.Type = AirDrawType::AirActionStart;
-            head.Z = 1.0 - note->ModifiedPosition / seenDuration;
-            head.Note = note;
-            airdraws.push_back(head);
+    renderCommands.clear();
+    nextRenderCommand = 0;
+
+    auto sequence = 0u;
+    auto group = 0u;
+    const auto push = [&](const RenderLayer layer, const RenderCommandType type, const shared_ptr<SusDrawableNoteData> &note, const int mode, const int param) -> RenderCommand& {
+        RenderCommand command;
+        command.Key = RenderCommand::MakeKey(layer, layer < RenderLayer::Aerial ? group : 0);
+        command.Sequence = sequence++;
+        command.Type = type;
+        command.BlendMode = mode;
+        command.BlendParam = param;
+        command.Note = note;
+        renderCommands.push_back(move(command));
+        return renderCommands.back();
+    };
+    // Hold/Slideの帯は判定状態で濃さが変わる
+    const auto longBodyParam = [](const shared_ptr<SusDrawableNoteData> &note) {
+        if (!note->OnTheFlyData[size_t(NoteAttribute::Finished)]) return 239;     // 判定前
+        if (note->OnTheFlyData[size_t(NoteAttribute::Activated)]) return 255;     // 判定中 : 押している時
+        return 175;                                                                 // 判定中 : 離している時
+    };
+#define GET_BIT(num) (1UL << (int(num)))
+    const auto shortMask = GET_BIT(SusNoteType::Tap) | GET_BIT(SusNoteType::ExTap) | GET_BIT(SusNoteType::AwesomeExTap) | GET_BIT(SusNoteType::Flick) | GET_BIT(SusNoteType::HellTap) | GET_BIT(SusNoteType::Grounded);
+#undef GET_BIT
+
+    for (size_t i = 0; i < seenData.size(); ++i) {
+        const auto &note = seenData[i];
+        const auto &type = note->Type;
+        // seenDataは優先度順に並んでいるので、変わり目で順位を上げる
+        if (usePrioritySort && i && note->ExtraAttribute->Priority != seenData[i - 1]->ExtraAttribute->Priority) ++group;
+
+        if (type[size_t(SusNoteType::MeasureLine)]) push(RenderLayer::MeasureLine, RenderCommandType::MeasureLine, note, DX_BLENDMODE_ALPHA, 255);
+        if (type[size_t(SusNoteType::Hold)]) {
+            const auto param = longBodyParam(note);
+            push(RenderLayer::LongNote, RenderCommandType::HoldBody, note, DX_BLENDMODE_ADD, param);
+            push(RenderLayer::LongNote, RenderCommandType::HoldStep, note, DX_BLENDMODE_ALPHA, 255);
+        }
+        if (type[size_t(SusNoteType::Slide)]) {
+            const auto param = longBodyParam(note);
+            push(RenderLayer::LongNote, RenderCommandType::SlideBody, note, DX_BLENDMODE_ADD, param);
+            if (showSlideLine) push(RenderLayer::LongNote, RenderCommandType::SlideLine, note, DX_BLENDMODE_ALPHA, param);
+            push(RenderLayer::LongNote, RenderCommandType::SlideStep, note, DX_BLENDMODE_ALPHA, 255);
+        }
+        if (type.to_ulong() & shortMask) push(RenderLayer::ShortNote, RenderCommandType::ShortNote, note, DX_BLENDMODE_ALPHA, 255);
+
+        if (type.test(size_t(SusNoteType::AirAction))) {
+            const auto headZ = 1.0 - note->ModifiedPosition / seenDuration;
+            push(RenderLayer::Aerial, RenderCommandType::AirActionStart, note, DX_BLENDMODE_ALPHA, 255).Z = headZ;
             auto prev = note;
-            auto lastZ = head.Z;
+            auto lastZ = headZ;
             for (const auto &extra : note->ExtraData) {
                 if (extra->Type.test(size_t(SusNoteType::Control))) continue;
                 if (extra->Type.test(size_t(SusNoteType::Injection))) continue;
                 const auto z = 1.0 - extra->ModifiedPosition / seenDuration;
                 if ((z >= 0 || lastZ >= 0) && (z < cullingLimit || lastZ < cullingLimit)) {
-                    AirDrawQuery tail;
-                    tail.Type = AirDrawType::AirActionStep;
-                    tail.Z = z;
-                    tail.Note = extra;
-                    tail.PreviousNote = prev;
-                    airdraws.push_back(tail);
-                    covers.push_back(tail);
+                    auto &step = push(RenderLayer::Aerial, RenderCommandType::AirActionStep, extra, DX_BLENDMODE_ALPHA, 255);
+                    step.Z = z;
+                    step.PreviousNote = prev;
+                    push(RenderLayer::AirActionCover, RenderCommandType::AirActionCover, extra, DX_BLENDMODE_ALPHA, 255).PreviousNote = prev;
+                    push(RenderLayer::AirActionStepBox, RenderCommandType::AirActionStepBox, extra, DX_BLENDMODE_ALPHA, 255).Z = z;
                 }
                 prev = extra;
                 lastZ = z;
             }
         }
-        if (note->Type.test(size_t(SusNoteType::Air))) {
+        if (type.test(size_t(SusNoteType::Air))) {
             const auto z = 1.0 - note->ModifiedPosition / seenDuration;
             if (z < 0 || z >= cullingLimit) continue;
-            AirDrawQuery head;
-            head.Type = AirDrawType::Air;
-            head.Z = z;
-            head.Note = note;
-            airdraws.push_back(head);
+            push(RenderLayer::Aerial, RenderCommandType::Air, note, DX_BLENDMODE_ALPHA, 255).Z = z;
         }
     }
-    stable_sort(airdraws.begin(), airdraws.end(), [](const AirDrawQuery a, const AirDrawQuery b) {
-        return a.Z < b.Z;
+
+    sort(renderCommands.begin(), renderCommands.end(), [](const RenderCommand &a, const RenderCommand &b) {
+        if (a.Key != b.Key) return a.Key < b.Key;
+        if (a.Z != b.Z) return a.Z < b.Z;
+        return a.Sequence < b.Sequence;
     });
-    for (const auto &query : airdraws) {
-        switch (query.Type) {
-            case AirDrawType::Air:
-                DrawAirNotes(query);
+}
+
+// lastLayerまでの描画命令を描画する
+void ScenePlayer::SubmitRenderCommands(const RenderLayer lastLayer)
+{
+    // 前回からの間に他の描画が挟まっているのでブレンドは改めて設定する
+    appliedBlendMode = appliedBlendParam = -1;
+    for (; nextRenderCommand < renderCommands.size(); ++nextRenderCommand) {
+        const auto &command = renderCommands[nextRenderCommand];
+        if (command.GetLayer() > lastLayer) break;
+
+        switch (command.Type) {
+            case RenderCommandType::MeasureLine:
+                // 小節線は連続しているので、層を抜けるまで積むだけ
+                SetNoteBlendMode(command.BlendMode, command.BlendParam);
                 break;
-            case AirDrawType::AirActionStart:
-                DrawAirActionStart(query);
+            case RenderCommandType::HoldStep:
+            case RenderCommandType::SlideStep:
+            case RenderCommandType::ShortNote:
+                // noteSpritesに積むだけなので、ブレンドはまとめて描画する時に設定される
+                FlushMeasureLines();
                 break;
-            case AirDrawType::AirActionStep:
-                DrawAirActionStep(query);
+            default:
+                FlushMeasureLines();
+                noteSprites.Flush();
+                SetNoteBlendMode(command.BlendMode, command.BlendParam);
+                break;
+        }
+
+        switch (command.Type) {
+            case RenderCommandType::MeasureLine:
+                DrawMeasureLine(command.Note);
+                break;
+            case RenderCommandType::HoldBody:
+                DrawHoldBody(command.Note);
+                break;
+            case RenderCommandType::HoldStep:
+                DrawHoldSteps(command.Note);
+                break;
+            case RenderCommandType::SlideBody:
+                DrawSlideBody(command.Note);
+                break;
+            case RenderCommandType::SlideLine:
+                DrawSlideLine(command.Note);
+                break;
+            case RenderCommandType::SlideStep:
+                DrawSlideSteps(command.Note);
+                break;
+            case RenderCommandType::ShortNote:
+                DrawShortNotes(command.Note);
+                break;
+            case RenderCommandType::Air:
+                DrawAirNotes(command);
+                break;
+            case RenderCommandType::AirActionStart:
+                DrawAirActionStart(command);
+                break;
+            case RenderCommandType::AirActionStep:
+                DrawAirActionStep(command);
+                break;
+            case RenderCommandType::AirActionCover:
+                DrawAirActionCover(command);
+                break;
+            case RenderCommandType::AirActionStepBox:
+                DrawAirActionStepBox(command);
                 break;
-            default: break;
         }
     }
-    for (const auto &query : covers) DrawAirActionCover(query);
-    for (const auto &query : airdraws) {
-        if (query.Type == AirDrawType::AirActionStep) DrawAirActionStepBox(query);
-    }
+    FlushMeasureLines();
+    noteSprites.Flush();
+}
+
+void ScenePlayer::SetNoteBlendMode(const int mode, const int param)
+{
+    if (mode == appliedBlendMode && param == appliedBlendParam) return;
+    SetDrawBlendMode(mode, param);
+    appliedBlendMode = mode;
+    appliedBlendParam = param;
 }
 
 // position は 0 ~ 16
 void ScenePlayer::SpawnJudgeEffect(const shared_ptr<SusDrawableNoteData>& target, const JudgeType type)
 {
+    if (isReplaying) return;
     Prepare3DDrawCall();
     const auto position = target->StartLane + target->Length / 2.0f;
     const auto x = glm::mix(SU_LANE_X_MIN, SU_LANE_X_MAX, position / 16.0f);
@@ -326,6 +417,7 @@ void ScenePlayer::SpawnJudgeEffect(const shared_ptr<SusDrawableNoteData>& target
 
 void ScenePlayer::SpawnSlideLoopEffect(const shared_ptr<SusDrawableNoteData>& target)
 {
+    if (isReplaying) return;
     SpawnJudgeEffect(target, JudgeType::SlideTap);
 
     animeSlideLoop->AddRef();
@@ -372,7 +464,7 @@ void ScenePlayer::UpdateSlideEffect()
                 last = slideElement;
                 continue;
             }
-            auto &segmentPositions = curveData[slideElement];
+            const auto segmentPositions = curveData.GetCurve(*slideElement);
 
             auto lastSegmentPosition = segmentPositions[0];
             auto lastTimeInBlock = get<0>(lastSegmentPosition) / (slideElement->StartTime - last->StartTime);
@@ -403,9 +495,8 @@ void ScenePlayer::UpdateSlideEffect()
 }
 
 
-void ScenePlayer::DrawShortNotes(const shared_ptr<SusDrawableNoteData>& note) const
+void ScenePlayer::DrawShortNotes(const shared_ptr<SusDrawableNoteData>& note)
 {
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
     const auto relpos = 1.0 - note->ModifiedPosition / seenDuration;
     const auto length = note->Length;
 #ifdef SU_ENABLE_NOTE_HORIZONTAL_MOVING
@@ -431,10 +522,10 @@ void ScenePlayer::DrawShortNotes(const shared_ptr<SusDrawableNoteData>& note) co
 
     //64*3 x 64 を描画するから1/2でやる必要がある
 
-    if (handleToDraw) DrawTap(slane, SU_TO_INT32(length), relpos, handleToDraw->GetHandle());
+    if (handleToDraw) DrawTap(slane, SU_TO_INT32(length), relpos, handleToDraw);
 }
 
-void ScenePlayer::DrawAirNotes(const AirDrawQuery &query) const
+void ScenePlayer::DrawAirNotes(const RenderCommand &query) const
 {
     auto note = query.Note;
     const auto length = note->Length;
@@ -484,13 +575,11 @@ void ScenePlayer::DrawAirNotes(const AirDrawQuery &query) const
             0.0f, roll + 0.5f, 0.0f, 0.0f
         }
     };
-    Prepare3DDrawCall();
     SetUseZBuffer3D(FALSE);
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
     DrawPolygonIndexed3D(vertices, 4, rectVertexIndices, 2, handle, TRUE);
 }
 
-void ScenePlayer::DrawHoldNotes(const shared_ptr<SusDrawableNoteData>& note) const
+void ScenePlayer::DrawHoldBody(const shared_ptr<SusDrawableNoteData>& note) const
 {
     const auto length = note->Length;
     const auto slane = note->StartLane;
@@ -505,14 +594,6 @@ void ScenePlayer::DrawHoldNotes(const shared_ptr<SusDrawableNoteData>& note) con
     auto head = relpos;
     auto tail = reltailpos;
     if (!(head < 0 && tail < 0) && !(head >= cullingLimit && tail >= cullingLimit)) {
-        if (!begin) { // 判定前
-            SetDrawBlendMode(DX_BLENDMODE_ADD, 239);
-        } else if (activated) { // 判定中 : Hold時
-            SetDrawBlendMode(DX_BLENDMODE_ADD, 255);
-        } else { // 判定中 : 非Hold時
-            SetDrawBlendMode(DX_BLENDMODE_ADD, 175);
-        }
-
         if (begin && activated) {
             if (head > 1) head = 1;
             if (tail > 1) tail = 1;
@@ -535,8 +616,13 @@ void ScenePlayer::DrawHoldNotes(const shared_ptr<SusDrawableNoteData>& note) con
             imageHoldStrut->GetHandle(), TRUE
         );
     }
+}
 
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
+void ScenePlayer::DrawHoldSteps(const shared_ptr<SusDrawableNoteData>& note)
+{
+    const auto length = note->Length;
+    const auto slane = note->StartLane;
+    const auto relpos = 1.0 - note->ModifiedPosition / seenDuration;
 
     for (int i = note->ExtraData.size() - 1; i >= 0; --i) {
         const auto &ex = note->ExtraData[i];
@@ -547,18 +633,18 @@ void ScenePlayer::DrawHoldNotes(const shared_ptr<SusDrawableNoteData>& note) con
         const auto relendpos = 1.0 - ex->ModifiedPosition / seenDuration;
         const int len = SU_TO_INT32(length);
         if (ex->Type.test(size_t(SusNoteType::Start))) {
-            DrawTap(slane, len, relendpos, imageHold->GetHandle());
+            DrawTap(slane, len, relendpos, imageHold);
         } else {
-            DrawTap(slane, len, relendpos, imageHoldStep->GetHandle());
+            DrawTap(slane, len, relendpos, imageHoldStep);
         }
     }
     if (!(note->OnTheFlyData[size_t(NoteAttribute::Finished)]/* && ノーツがAttack以上の判定*/)) {
         const int len = SU_TO_INT32(length);
-        DrawTap(slane, len, relpos, imageHold->GetHandle());
+        DrawTap(slane, len, relpos, imageHold);
     }
 }
 
-void ScenePlayer::DrawSlideNotes(const shared_ptr<SusDrawableNoteData>& note)
+void ScenePlayer::DrawSlideBody(const shared_ptr<SusDrawableNoteData>& note)
 {
     auto lastStep = note;
     auto offsetTimeInBlock = 0.0; /* そのslideElementの、不可視中継点のつながり等を考慮した時の先頭位置、的な */
@@ -633,7 +719,7 @@ void ScenePlayer::DrawSlideNotes(const shared_ptr<SusDrawableNoteData>& note)
         ++i; /* exData[0] はnoteそのものの情報だからこのインクリメントは必須 */
         if (slideElement->Type.test(size_t(SusNoteType::Control))) continue;
         if (slideElement->Type.test(size_t(SusNoteType::Injection))) continue;
-        auto &segmentPositions = curveData[slideElement];
+        const auto segmentPositions = curveData.GetCurve(*slideElement);
 
         auto lastSegmentPosition = segmentPositions[0];
         auto lastSegmentLength = double(lastStep->Length);
@@ -732,88 +818,76 @@ void ScenePlayer::DrawSlideNotes(const shared_ptr<SusDrawableNoteData>& note)
         lastStep = slideElement;
     }
 
-    if (!begin) { // 判定前
-        SetDrawBlendMode(DX_BLENDMODE_ADD, 239);
-    } else if (activated) { // 判定中 : Slide時
-        SetDrawBlendMode(DX_BLENDMODE_ADD, 255);
-    } else { // 判定中 : 非Slide時
-        SetDrawBlendMode(DX_BLENDMODE_ADD, 175);
-    }
-
     SetUseBackCulling(FALSE);
     DrawPolygonIndexed2D(slideVertices.data(), slideVertices.size(), slideIndices.data(), drawcount, imageSlideStrut->GetHandle(), TRUE);
+}
 
-    // 中心線
-    if (showSlideLine) {
-        if (!begin) { // 判定前
-            SetDrawBlendMode(DX_BLENDMODE_ALPHA, 239);
-        } else if (activated) { // 判定中 : Hold時
-            SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
-        } else { // 判定中 : 非Hold時
-            SetDrawBlendMode(DX_BLENDMODE_ALPHA, 175);
-        }
+void ScenePlayer::DrawSlideLine(const shared_ptr<SusDrawableNoteData>& note) const
+{
+    const auto begin = !!note->OnTheFlyData[size_t(NoteAttribute::Finished)];
+    const auto activated = !!note->OnTheFlyData[size_t(NoteAttribute::Activated)];
+    auto lastStep = note;
+    for (auto &slideElement : note->ExtraData) {
+        if (slideElement->Type.test(size_t(SusNoteType::Control))) continue;
+        if (slideElement->Type.test(size_t(SusNoteType::Injection))) continue;
+        const auto segmentPositions = curveData.GetCurve(*slideElement);
+        auto lastSegmentPosition = segmentPositions[0];
+        auto lastSegmentRelativeX = get<1>(lastSegmentPosition);
+        auto lastSegmentRelativeY = 1.0 - lastStep->ModifiedPosition / seenDuration;
 
-        lastStep = note;
-        for (auto &slideElement : note->ExtraData) {
-            if (slideElement->Type.test(size_t(SusNoteType::Control))) continue;
-            if (slideElement->Type.test(size_t(SusNoteType::Injection))) continue;
-            auto &segmentPositions = curveData[slideElement];
-            auto lastSegmentPosition = segmentPositions[0];
-            auto lastSegmentRelativeX = get<1>(lastSegmentPosition);
-            auto lastSegmentRelativeY = 1.0 - lastStep->ModifiedPosition / seenDuration;
+        for (auto &segmentPosition : segmentPositions) {
+            if (lastSegmentPosition == segmentPosition) continue;
+            const auto currentTimeInBlock = get<0>(segmentPosition) / (slideElement->StartTime - lastStep->StartTime);
+            const auto segmentExPosition = glm::mix(lastStep->ModifiedPosition, slideElement->ModifiedPosition, currentTimeInBlock);
+            auto currentSegmentRelativeX = get<1>(segmentPosition);
+            auto currentSegmentRelativeY = 1.0 - segmentExPosition / seenDuration;
+            if ((currentSegmentRelativeY >= 0 || lastSegmentRelativeY >= 0)
+                && (currentSegmentRelativeY < cullingLimit || lastSegmentRelativeY < cullingLimit)) {
+                if (begin && activated) {
+                    if (currentSegmentRelativeY >= 1 && lastSegmentRelativeY >= 1) {
+                        // セグメントの全体が判定ラインを超えているとき
+                        // 表示はしたくないけど内部数値は普通に処理した時と一致させたい
+                        //    => 描画先座標を一致させてお茶を濁す
+                        lastSegmentRelativeX = currentSegmentRelativeX;
+                        lastSegmentRelativeY = currentSegmentRelativeY;
+                    } else if (currentSegmentRelativeY >= 1) {
+                        // セグメントの始点が判定ラインより手前、終点が判定ラインを超えているとき
+                        // 始点はそのまま、終点は判定ラインに一致させ、次の始点は判定ラインから
+                        currentSegmentRelativeX = lastSegmentRelativeX - (lastSegmentRelativeX - currentSegmentRelativeX) / (lastSegmentRelativeY - currentSegmentRelativeY) * (lastSegmentRelativeY - 1.0);
+                        currentSegmentRelativeY = 1;
 
-            for (auto &segmentPosition : segmentPositions) {
-                if (lastSegmentPosition == segmentPosition) continue;
-                const auto currentTimeInBlock = get<0>(segmentPosition) / (slideElement->StartTime - lastStep->StartTime);
-                const auto segmentExPosition = glm::mix(lastStep->ModifiedPosition, slideElement->ModifiedPosition, currentTimeInBlock);
-                auto currentSegmentRelativeX = get<1>(segmentPosition);
-                auto currentSegmentRelativeY = 1.0 - segmentExPosition / seenDuration;
-                if ((currentSegmentRelativeY >= 0 || lastSegmentRelativeY >= 0)
-                    && (currentSegmentRelativeY < cullingLimit || lastSegmentRelativeY < cullingLimit)) {
-                    if (begin && activated) {
-                        if (currentSegmentRelativeY >= 1 && lastSegmentRelativeY >= 1) {
-                            // セグメントの全体が判定ラインを超えているとき
-                            // 表示はしたくないけど内部数値は普通に処理した時と一致させたい
-                            //    => 描画先座標を一致させてお茶を濁す
-                            lastSegmentRelativeX = currentSegmentRelativeX;
-                            lastSegmentRelativeY = currentSegmentRelativeY;
-                        } else if (currentSegmentRelativeY >= 1) {
-                            // セグメントの始点が判定ラインより手前、終点が判定ラインを超えているとき
-                            // 始点はそのまま、終点は判定ラインに一致させ、次の始点は判定ラインから
-                            currentSegmentRelativeX = lastSegmentRelativeX - (lastSegmentRelativeX - currentSegmentRelativeX) / (lastSegmentRelativeY - currentSegmentRelativeY) * (lastSegmentRelativeY - 1.0);
-                            currentSegmentRelativeY = 1;
-
-                        } else if (lastSegmentRelativeY >= 1) {
-                            // セグメントの終点は判定ラインより手前、始点が判定ラインを超えているとき(ハイスピ指定を行った場合に起こりうるはず)
-                            // どうしたいんだろう
-                            lastSegmentRelativeX = currentSegmentRelativeX - (currentSegmentRelativeX - lastSegmentRelativeX) / (currentSegmentRelativeY - lastSegmentRelativeY) * (currentSegmentRelativeY - 1.0);
-                            lastSegmentRelativeY = 1;
-                        }
+                    } else if (lastSegmentRelativeY >= 1) {
+                        // セグメントの終点は判定ラインより手前、始点が判定ラインを超えているとき(ハイスピ指定を行った場合に起こりうるはず)
+                        // どうしたいんだろう
+                        lastSegmentRelativeX = currentSegmentRelativeX - (currentSegmentRelativeX - lastSegmentRelativeX) / (currentSegmentRelativeY - lastSegmentRelativeY) * (currentSegmentRelativeY - 1.0);
+                        lastSegmentRelativeY = 1;
                     }
-
-                    DrawTriangleAA(
-                        SU_TO_FLOAT(lastSegmentRelativeX * laneBufferX - slideLineThickness), SU_TO_FLOAT(laneBufferY * lastSegmentRelativeY),
-                        SU_TO_FLOAT(lastSegmentRelativeX * laneBufferX + slideLineThickness), SU_TO_FLOAT(laneBufferY * lastSegmentRelativeY),
-                        SU_TO_FLOAT(currentSegmentRelativeX * laneBufferX - slideLineThickness), SU_TO_FLOAT(laneBufferY * currentSegmentRelativeY),
-                        slideLineColor, 16
-                    );
-                    DrawTriangleAA(
-                        SU_TO_FLOAT(lastSegmentRelativeX * laneBufferX + slideLineThickness), SU_TO_FLOAT(laneBufferY * lastSegmentRelativeY),
-                        SU_TO_FLOAT(currentSegmentRelativeX * laneBufferX - slideLineThickness), SU_TO_FLOAT(laneBufferY * currentSegmentRelativeY),
-                        SU_TO_FLOAT(currentSegmentRelativeX * laneBufferX + slideLineThickness), SU_TO_FLOAT(laneBufferY * currentSegmentRelativeY),
-                        slideLineColor, 16
-                    );
                 }
-                lastSegmentPosition = segmentPosition;
-                lastSegmentRelativeX = currentSegmentRelativeX;
-                lastSegmentRelativeY = currentSegmentRelativeY;
+
+                DrawTriangleAA(
+                    SU_TO_FLOAT(lastSegmentRelativeX * laneBufferX - slideLineThickness), SU_TO_FLOAT(laneBufferY * lastSegmentRelativeY),
+                    SU_TO_FLOAT(lastSegmentRelativeX * laneBufferX + slideLineThickness), SU_TO_FLOAT(laneBufferY * lastSegmentRelativeY),
+                    SU_TO_FLOAT(currentSegmentRelativeX * laneBufferX - slideLineThickness), SU_TO_FLOAT(laneBufferY * currentSegmentRelativeY),
+                    slideLineColor, 16
+                );
+                DrawTriangleAA(
+                    SU_TO_FLOAT(lastSegmentRelativeX * laneBufferX + slideLineThickness), SU_TO_FLOAT(laneBufferY * lastSegmentRelativeY),
+                    SU_TO_FLOAT(currentSegmentRelativeX * laneBufferX - slideLineThickness), SU_TO_FLOAT(laneBufferY * currentSegmentRelativeY),
+                    SU_TO_FLOAT(currentSegmentRelativeX * laneBufferX + slideLineThickness), SU_TO_FLOAT(laneBufferY * currentSegmentRelativeY),
+                    slideLineColor, 16
+                );
             }
-            lastStep = slideElement;
+            lastSegmentPosition = segmentPosition;
+            lastSegmentRelativeX = currentSegmentRelativeX;
+            lastSegmentRelativeY = currentSegmentRelativeY;
         }
+        lastStep = slideElement;
     }
+}
 
+void ScenePlayer::DrawSlideSteps(const shared_ptr<SusDrawableNoteData>& note)
+{
     // Tap
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
     for (int si = note->ExtraData.size() - 1; si >= 0; --si) {
         const auto &slideElement = note->ExtraData[si];
         if (slideElement->Type.test(size_t(SusNoteType::Control))) continue;
@@ -825,19 +899,19 @@ void ScenePlayer::DrawSlideNotes(const shared_ptr<SusDrawableNoteData>& note)
         if (currentStepRelativeY >= 0 && currentStepRelativeY < cullingLimit) {
             const int length = SU_TO_INT32(slideElement->Length);
             if (slideElement->Type.test(size_t(SusNoteType::Start))) {
-                DrawTap(slideElement->StartLane, length, currentStepRelativeY, imageSlide->GetHandle());
+                DrawTap(slideElement->StartLane, length, currentStepRelativeY, imageSlide);
             } else {
-                DrawTap(slideElement->StartLane, length, currentStepRelativeY, imageSlideStep->GetHandle());
+                DrawTap(slideElement->StartLane, length, currentStepRelativeY, imageSlideStep);
             }
         }
     }
     if (!(note->OnTheFlyData[size_t(NoteAttribute::Finished)]/* && ノーツがAttack以上の判定*/)) {
         const int length = SU_TO_INT32(note->Length);
-        DrawTap(note->StartLane, length, 1.0 - note->ModifiedPosition / seenDuration, imageSlide->GetHandle());
+        DrawTap(note->StartLane, length, 1.0 - note->ModifiedPosition / seenDuration, imageSlide);
     }
 }
 
-void ScenePlayer::DrawAirActionStart(const AirDrawQuery &query) const
+void ScenePlayer::DrawAirActionStart(const RenderCommand &query) const
 {
     const auto lastStep = query.Note;
     const auto lastStepRelativeY = query.Z;
@@ -878,13 +952,12 @@ void ScenePlayer::DrawAirActionStart(const AirDrawQuery &query) const
     DrawPolygonIndexed3D(vertices, 4, rectVertexIndices, 2, imageAirAction->GetHandle(), TRUE);
 }
 
-void ScenePlayer::DrawAirActionStepBox(const AirDrawQuery &query) const
+void ScenePlayer::DrawAirActionStepBox(const RenderCommand &query) const
 {
     const auto slideElement = query.Note;
     const auto currentStepRelativeY = query.Z;
 
     SetUseZBuffer3D(TRUE);
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
     if (!slideElement->Type.test(size_t(SusNoteType::Invisible))) {
         const auto atLeft = (slideElement->StartLane) / 16.0;
         const auto atRight = (slideElement->StartLane + slideElement->Length) / 16.0;
@@ -957,13 +1030,12 @@ void ScenePlayer::DrawAirActionStepBox(const AirDrawQuery &query) const
     }
 }
 
-void ScenePlayer::DrawAirActionStep(const AirDrawQuery &query) const
+void ScenePlayer::DrawAirActionStep(const RenderCommand &query) const
 {
     const auto slideElement = query.Note;
     const auto currentStepRelativeY = query.Z;
 
     SetUseZBuffer3D(TRUE);
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
     if (!slideElement->Type.test(size_t(SusNoteType::Invisible))) {
         const auto atLeft = (slideElement->StartLane) / 16.0;
         const auto atRight = (slideElement->StartLane + slideElement->Length) / 16.0;
@@ -986,11 +1058,11 @@ void ScenePlayer::DrawAirActionStep(const AirDrawQuery &query) const
     }
 }
 
-void ScenePlayer::DrawAirActionCover(const AirDrawQuery &query)
+void ScenePlayer::DrawAirActionCover(const RenderCommand &query)
 {
     const auto slideElement = query.Note;
     const auto lastStep = query.PreviousNote;
-    const auto &segmentPositions = curveData[slideElement];
+    const auto segmentPositions = curveData.GetCurve(*slideElement);
 
     auto lastSegmentPosition = segmentPositions[0];
     const auto blockDuration = slideElement->StartTime - lastStep->StartTime;
@@ -1046,24 +1118,86 @@ void ScenePlayer::DrawAirActionCover(const AirDrawQuery &query)
     }
 }
 
-void ScenePlayer::DrawTap(const float lane, const int length, const double relpos, const int handle) const
+// 半レーンごとのブロックを1つずつ描かずにnoteSpritesへ積み、テクスチャかブレンドが変わった時にまとめて描く
+void ScenePlayer::DrawTap(const float lane, const int length, const double relpos, SImage *image)
+{
+    if (length <= 0) return;
+    NoteSpriteState spriteState;
+    spriteState.Texture = image->GetHandle();
+    spriteState.BlendMode = DX_BLENDMODE_ALPHA;
+    spriteState.BlendParam = 255;
+    noteSprites.AddNoteBlocks(
+        spriteState,
+        lane * widthPerLane, SU_TO_FLOAT(laneBufferY * relpos),
+        noteImageBlockX * actualNoteScaleX, noteImageBlockY * actualNoteScaleY,
+        SU_TO_UINT32(length * 2),
+        noteImageBlockX / image->GetWidth(), noteImageBlockY / image->GetHeight());
+}
+
+void ScenePlayer::DrawNoteSprites(const NoteSpriteBatch &batch)
+{
+    const auto &vertices = batch.GetVertices();
+    noteSpriteVertices.clear();
+    for (const auto &vertex : vertices) {
+        noteSpriteVertices.push_back({ VGet(vertex.X, vertex.Y, 0), 1.0f, GetColorU8(255, 255, 255, 255), vertex.U, vertex.V });
+    }
+
+    const auto &state = batch.GetState();
+    SetNoteBlendMode(state.BlendMode, state.BlendParam);
+    SetUseBackCulling(FALSE);
+    DrawPolygonIndexed2D(noteSpriteVertices.data(), SU_TO_INT32(noteSpriteVertices.size()), batch.GetIndices().data(), SU_TO_INT32(batch.GetIndices().size() / 3), state.Texture, TRUE);
+}
+
+// 1本ずつDrawLineAAせずに、太さ6の帯(上下1pxは透明へぼかす)として積んでおく
+void ScenePlayer::DrawMeasureLine(const shared_ptr<SusDrawableNoteData>& note)
+{
+    if (measureLineVertices.size() + 8 > 0x10000) FlushMeasureLines();
+
+    const auto y = SU_TO_FLOAT(1.0 - note->ModifiedPosition / seenDuration) * laneBufferY;
+    const float rows[] = { y - 3.5f, y - 2.5f, y + 2.5f, y + 3.5f };
+    const int alphas[] = { 0, 255, 255, 0 };
+    const auto base = uint16_t(measureLineVertices.size());
+    for (auto i = 0; i < 4; i++) {
+        measureLineVertices.push_back({ VGet(0, rows[i], 0), 1.0f, GetColorU8(255, 255, 255, alphas[i]), 0.0f, 0.0f });
+        measureLineVertices.push_back({ VGet(laneBufferX, rows[i], 0), 1.0f, GetColorU8(255, 255, 255, alphas[i]), 0.0f, 0.0f });
+    }
+    for (auto i = 0; i < 3; i++) {
+        const auto top = uint16_t(base + i * 2);
+        const uint16_t quad[] = { top, uint16_t(top + 1), uint16_t(top + 2), uint16_t(top + 2), uint16_t(top + 1), uint16_t(top + 3) };
+        measureLineIndices.insert(measureLineIndices.end(), begin(quad), end(quad));
+    }
+}
+
+void ScenePlayer::FlushMeasureLines()
+{
+    if (measureLineVertices.empty()) return;
+    SetUseBackCulling(FALSE);
+    DrawPolygonIndexed2D(measureLineVertices.data(), SU_TO_INT32(measureLineVertices.size()), measureLineIndices.data(), SU_TO_INT32(measureLineIndices.size() / 3), DX_NONE_GRAPH, TRUE);
+    measureLineVertices.clear();
+    measureLineIndices.clear();
+}
+
+// 地面は世界座標で固定なので、頂点と頂点番号はGPU側に置いたままにする
+// カメラはPrepare3DDrawCallで設定するだけなのでAdjustCameraで作り直す必要はない
+void ScenePlayer::CreateGroundBuffers()
 {
-    for (auto i = 0; i < length * 2; i++) {
-        const auto type = i ? (i == length * 2 - 1 ? 2 : 1) : 0;
-        DrawRectRotaGraph3F(
-            (lane * 2 + i) * widthPerLane / 2, SU_TO_FLOAT(laneBufferY * relpos),
-            SU_TO_INT32(noteImageBlockX * type), (0),
-            SU_TO_INT32(noteImageBlockX), SU_TO_INT32(noteImageBlockY),
-            0, noteImageBlockY / 2,
-            actualNoteScaleX, actualNoteScaleY, 0,
-            handle, TRUE, FALSE);
+    DeleteGroundBuffers();
+    hGroundVertexBuffer = CreateVertexBuffer(4, DX_VERTEX_TYPE_NORMAL_3D);
+    hGroundIndexBuffer = CreateIndexBuffer(6, DX_INDEX_TYPE_16BIT);
+    if (hGroundVertexBuffer == -1 || hGroundIndexBuffer == -1) {
+        // 作れない環境では毎回頂点を渡して描画する
+        DeleteGroundBuffers();
+        return;
     }
+    SetVertexBufferData(0, groundVertices, 4, hGroundVertexBuffer);
+    SetIndexBufferData(0, rectVertexIndices, 6, hGroundIndexBuffer);
 }
 
-void ScenePlayer::DrawMeasureLine(const shared_ptr<SusDrawableNoteData>& note) const
+void ScenePlayer::DeleteGroundBuffers()
 {
-    const auto relpos = SU_TO_FLOAT(1.0 - note->ModifiedPosition / seenDuration);
-    DrawLineAA(0, relpos * laneBufferY, laneBufferX, relpos * laneBufferY, GetColor(255, 255, 255), 6);
+    if (hGroundVertexBuffer != -1) DeleteVertexBuffer(hGroundVertexBuffer);
+    if (hGroundIndexBuffer != -1) DeleteIndexBuffer(hGroundIndexBuffer);
+    hGroundVertexBuffer = hGroundIndexBuffer = -1;
 }
 
 void ScenePlayer::Prepare3DDrawCall() const
@@ -19,6 +19,9 @@ void RegisterPlayerScene(ExecutionManager * manager)
     engine->RegisterObjectProperty(SU_IF_SCENE_PLAYER_METRICS, "double JudgeLineLeftY", asOFFSET(ScenePlayerMetrics, JudgeLineLeftY));
     engine->RegisterObjectProperty(SU_IF_SCENE_PLAYER_METRICS, "double JudgeLineRightX", asOFFSET(ScenePlayerMetrics, JudgeLineRightX));
     engine->RegisterObjectProperty(SU_IF_SCENE_PLAYER_METRICS, "double JudgeLineRightY", asOFFSET(ScenePlayerMetrics, JudgeLineRightY));
+    engine->RegisterObjectProperty(SU_IF_SCENE_PLAYER_METRICS, "double ClockDrift", asOFFSET(ScenePlayerMetrics, ClockDrift));
+    engine->RegisterObjectProperty(SU_IF_SCENE_PLAYER_METRICS, "double ClockJitter", asOFFSET(ScenePlayerMetrics, ClockJitter));
+    engine->RegisterObjectProperty(SU_IF_SCENE_PLAYER_METRICS, "double ClockRate", asOFFSET(ScenePlayerMetrics, ClockRate));
 
     engine->RegisterObjectType(SU_IF_SCENE_PLAYER, 0, asOBJ_REF);
     engine->RegisterObjectBehaviour(SU_IF_SCENE_PLAYER, asBEHAVE_ADDREF, "void f()", asMETHOD(ScenePlayer, AddRef), asCALL_THISCALL);
@@ -70,15 +73,16 @@ namespace
 ScenePlayer::ScenePlayer(ExecutionManager *exm)
     : manager(exm)
     , soundManager(manager->GetSoundManagerUnsafe())
-    , judgeSoundQueue(32)
     , analyzer(make_unique<SusAnalyzer>(192))
     , processor(CreateScoreProcessor(exm, this))
     , isLoadCompleted(false) // 若干危険ですけどね……
+    , noteSprites([this](const NoteSpriteBatch &batch) { DrawNoteSprites(batch); })
     , currentResult(new Result())
     , hispeedMultiplier(exm->GetSettingInstanceSafe()->ReadValue<double>("Play", "Hispeed", 6))
     , soundBufferingLatency(manager->GetSettingInstanceSafe()->ReadValue<int>("Sound", "BufferLatency", 30) / 1000.0)
     , airRollSpeed(manager->GetSettingInstanceSafe()->ReadValue<double>("Play", "AirRollMultiplier", 1.5))
 {
+    judgeSoundEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
     judgeSoundThread = thread([this]() {
         ProcessSoundQueue();
     });
@@ -97,7 +101,7 @@ void ScenePlayer::Initialize()
 
     const auto cp = manager->GetCharacterManagerSafe()->GetCharacterParameterSafe(0);
     const auto sp = manager->GetSkillManagerSafe()->GetSkillParameterSafe(0);
-    currentCharacterInstance = CharacterInstance::CreateInstance(cp, sp, manager->GetScriptInterfaceSafe(), currentResult);
+    currentCharacterInstance = CharacterInstance::CreateInstance(cp, sp, manager->GetScriptInterfaceSafe(), currentResult, !isReplaying);
 }
 
 void ScenePlayer::SetProcessorOptions(ScoreProcessor *processor) const
@@ -112,17 +116,36 @@ void ScenePlayer::SetProcessorOptions(ScoreProcessor *processor) const
 
 void ScenePlayer::EnqueueJudgeSound(const JudgeSoundType type)
 {
+    if (isReplaying) return;
     judgeSoundQueue.push(type);
+    hasPendingJudgeSounds = true;
+}
+
+// 今フレームに積んだ判定音をまとめて鳴らしてもらう
+void ScenePlayer::FlushJudgeSounds()
+{
+    if (!hasPendingJudgeSounds) return;
+    hasPendingJudgeSounds = false;
+    SetEvent(judgeSoundEvent);
+}
+
+void ScenePlayer::RecordJudge(const shared_ptr<SusDrawableNoteData>& note, const JudgeInformation &info, const AbilityJudgeType judge)
+{
+    if (!isReplaying) return;
+    judgeLog.push_back({ currentTime, note->StartTime, info.Note, judge, info.Left, info.Right });
 }
 
 
 void ScenePlayer::Finalize()
 {
     isTerminating = true;
+    SetEvent(judgeSoundEvent);
+    judgeSoundThread.join();
+    CloseHandle(judgeSoundEvent);
     if (loadWorkerThread.joinable()) loadWorkerThread.join();
-    SoundManager::StopGlobal(soundHoldLoop->GetSample());
-    SoundManager::StopGlobal(soundSlideLoop->GetSample());
-    SoundManager::StopGlobal(soundAirLoop->GetSample());
+    if (soundHoldLoop) SoundManager::StopGlobal(soundHoldLoop->GetSample());
+    if (soundSlideLoop) SoundManager::StopGlobal(soundSlideLoop->GetSample());
+    if (soundAirLoop) SoundManager::StopGlobal(soundAirLoop->GetSample());
     for (auto& res : resources) if (res.second) res.second->Release();
     if (spriteLane) spriteLane->Release();
     for (auto &i : sprites) i->Release();
@@ -131,13 +154,14 @@ void ScenePlayer::Finalize()
     spritesPending.clear();
     for (auto &i : slideEffects) i.second->Release();
     slideEffects.clear();
-    SoundManager::StopGlobal(bgmStream);
+    if (bgmStream) SoundManager::StopGlobal(bgmStream);
     delete processor;
+    soundScheduler.reset();
     delete bgmStream;
 
-    DeleteGraph(hGroundBuffer);
+    if (hGroundBuffer) DeleteGraph(hGroundBuffer);
+    DeleteGroundBuffers();
     if (movieBackground) DeleteGraph(movieBackground);
-    judgeSoundThread.join();
 }
 
 void ScenePlayer::LoadWorker()
@@ -148,13 +172,19 @@ void ScenePlayer::LoadWorker()
     }
 
     auto mm = manager->GetMusicsManager();
-    auto scorefile = mm->GetSelectedScorePath();
+    auto scorefile = isReplaying ? replayScorePath : mm->GetSelectedScorePath();
 
     // 譜面の読み込み
-    analyzer->Reset();
-    analyzer->LoadFromFile(scorefile.wstring());
+    // 内容が同じなら前回の解析結果を使い回す
+    const auto scoreHash = SusAnalyzer::CalculateFileHash(scorefile.wstring());
+    const auto compiledScore = Setting::GetRootDirectory() / SU_DATA_DIR / SU_CACHE_DIR / SU_CACHE_SCORE_DIR / fmt::format(L"{0:08x}.susc", scoreHash);
+    if (!analyzer->LoadCompiledScore(compiledScore.wstring(), scoreHash, data, curveData)) {
+        analyzer->Reset();
+        analyzer->LoadFromFile(scorefile.wstring());
+        analyzer->RenderScoreData(data, curveData);
+        analyzer->SaveCompiledScore(compiledScore.wstring(), scoreHash, data, curveData);
+    }
     metronomeAvailable = !analyzer->SharedMetaData.ExtraFlags[size_t(SusMetaDataFlags::DisableMetronome)];
-    analyzer->RenderScoreData(data, curveData);
     // 各種情報の設定
     segmentsPerSecond = analyzer->SharedMetaData.SegmentsPerSecond;
     usePrioritySort = analyzer->SharedMetaData.ExtraFlags[size_t(SusMetaDataFlags::EnableDrawPriority)];
@@ -162,14 +192,15 @@ void ScenePlayer::LoadWorker()
     scoreDuration = analyzer->SharedMetaData.ScoreDuration;
     // Processor
     processor->Reset();
+    BuildNoteIndex();
     // スライド描画バッファ
     uint32_t maxElements = 0;
     for (const auto& note : data) {
         if (!note->Type[size_t(SusNoteType::Slide)]) continue;
-        const auto reserved = accumulate(note->ExtraData.begin(), note->ExtraData.end(), 2, [this](const int current, const shared_ptr<SusDrawableNoteData> part) {
+        const auto reserved = accumulate(note->ExtraData.begin(), note->ExtraData.end(), 2, [this](const int current, const shared_ptr<SusDrawableNoteData> &part) {
             if (part->Type.test(size_t(SusNoteType::Control))) return current;
             if (part->Type.test(size_t(SusNoteType::Injection))) return current;
-            return current + int(curveData[part].size()) + 1;
+            return current + int(part->CurveCount) + 1;
         });
         maxElements = max(maxElements, uint32_t(reserved));
     }
@@ -177,12 +208,15 @@ void ScenePlayer::LoadWorker()
     slideIndices.reserve(maxElements * 6);
 
 
-    // 動画・音声の読み込み
+    // 動画・音声の読み込み リプレイ実行ではBGMも動画も無しで進める
     auto file = boost::filesystem::path(scorefile).parent_path() / ConvertUTF8ToUnicode(analyzer->SharedMetaData.UWaveFileName);
-    bgmStream = SoundStream::CreateFromFile(file.wstring());
+    if (!isReplaying) {
+        bgmStream = SoundStream::CreateFromFile(file.wstring());
+        soundScheduler = make_unique<SoundScheduler>(bgmStream);
+    }
     state = PlayingState::ReadyToStart;
 
-    if (!analyzer->SharedMetaData.UMovieFileName.empty()) {
+    if (!isReplaying && !analyzer->SharedMetaData.UMovieFileName.empty()) {
         movieFileName = (boost::filesystem::path(scorefile).parent_path() / ConvertUTF8ToUnicode(analyzer->SharedMetaData.UMovieFileName)).wstring();
     }
 
@@ -192,6 +226,7 @@ void ScenePlayer::LoadWorker()
     nextMetronomeTime = backingTime;
     while (backingTime > analyzer->SharedMetaData.WaveOffset) backingTime -= 60.0 / analyzer->GetBpmAt(0, 0) * analyzer->GetBeatsAt(0);
     currentTime = backingTime;
+    songClock.Reset(currentTime);
 
     {
         lock_guard<mutex> lock(asyncMutex);
@@ -202,15 +237,121 @@ void ScenePlayer::LoadWorker()
     }
 }
 
+// 見えうる区間・判定しうる区間の索引を作る
+// 見た目の位置はタイムラインごとに違うので、ノーツ(ロングは中継点も)を乗っているタイムラインごとに分けておく
+void ScenePlayer::BuildNoteIndex()
+{
+    seenIndex.clear();
+    judgeOrder.clear();
+
+    unordered_map<SusHispeedTimeline*, size_t> timelineIndices;
+    const auto registerKey = [&](const shared_ptr<SusDrawableNoteData> &note, const uint32_t index) {
+        if (!note->Timeline) return;
+        auto it = timelineIndices.find(note->Timeline.get());
+        if (it == timelineIndices.end()) {
+            it = timelineIndices.emplace(note->Timeline.get(), seenIndex.size()).first;
+            seenIndex.emplace_back();
+            seenIndex.back().Timeline = note->Timeline;
+        }
+        seenIndex[it->second].Keys.emplace_back(note->StartTimeEx, index);
+    };
+    for (auto i = 0u; i < data.size(); i++) {
+        const auto &note = data[i];
+        const auto types = note->Type.to_ulong();
+        if (types & SU_NOTE_LONG_MASK) {
+            registerKey(note, i);
+            for (const auto &extra : note->ExtraData) registerKey(extra, i);
+        } else if (types & SU_NOTE_SHORT_MASK || note->Type[size_t(SusNoteType::MeasureLine)]) {
+            registerKey(note, i);
+        }
+        judgeOrder.push_back(i);
+    }
+    for (auto &index : seenIndex) {
+        sort(index.Keys.begin(), index.Keys.end(), [](const tuple<double, uint32_t> &a, const tuple<double, uint32_t> &b) {
+            return get<0>(a) < get<0>(b);
+        });
+    }
+    stable_sort(judgeOrder.begin(), judgeOrder.end(), [this](const uint32_t a, const uint32_t b) {
+        return data[a]->StartTime < data[b]->StartTime;
+    });
+    ResetNoteIndex();
+}
+
+// 時間が巻き戻ったら最初から数え直す
+void ScenePlayer::ResetNoteIndex()
+{
+    for (auto &index : seenIndex) {
+        index.Next = 0;
+        index.MaxSum = -numeric_limits<double>::infinity();
+    }
+    activeSeenNotes.clear();
+    activeJudgeNotes.clear();
+    seenActivated.assign(data.size(), 0);
+    nextJudgeNote = 0;
+    lastIndexedTime = -numeric_limits<double>::infinity();
+    indexedJudgeMargin = numeric_limits<double>::quiet_NaN();
+}
+
+// 索引で候補に残したノーツだけを今までと同じ条件で絞り込む
+// 候補は時間が進むにつれて足したり外したりする
 void ScenePlayer::CalculateNotes(double time, double duration, double preced)
 {
+    if (time < lastIndexedTime) ResetNoteIndex();
+    lastIndexedTime = time;
+
+    const auto mergeActivated = [this](vector<uint32_t> &active) {
+        if (activatedNotes.empty()) return;
+        sort(activatedNotes.begin(), activatedNotes.end());
+        const auto middle = active.size();
+        active.insert(active.end(), activatedNotes.begin(), activatedNotes.end());
+        inplace_merge(active.begin(), active.begin() + middle, active.end());
+    };
+
+    // 判定: 始点から余裕分手前で入れて、終点から余裕分過ぎたら外す
+    const auto judgeMargin = processor->GetJudgeMargin() + noteIndexMargin;
+    if (judgeMargin != indexedJudgeMargin) {
+        activeJudgeNotes.clear();
+        nextJudgeNote = 0;
+        indexedJudgeMargin = judgeMargin;
+    }
+    activatedNotes.clear();
+    while (nextJudgeNote < judgeOrder.size() && data[judgeOrder[nextJudgeNote]]->StartTime - judgeMargin <= time) {
+        activatedNotes.push_back(judgeOrder[nextJudgeNote++]);
+    }
+    mergeActivated(activeJudgeNotes);
+    activeJudgeNotes.erase(remove_if(activeJudgeNotes.begin(), activeJudgeNotes.end(), [&](const uint32_t index) {
+        return time > data[index]->StartTime + data[index]->Duration + judgeMargin;
+    }), activeJudgeNotes.end());
+
     judgeData.clear();
-    copy_if(data.begin(), data.end(), back_inserter(judgeData), [&](const shared_ptr<SusDrawableNoteData> n) {
-        return this->processor->ShouldJudge(n);
-    });
+    for (const auto index : activeJudgeNotes) {
+        if (processor->ShouldJudge(data[index])) judgeData.push_back(data[index]);
+    }
 
-    seenData.clear();
-    copy_if(data.begin(), data.end(), back_inserter(seenData), [&](shared_ptr<SusDrawableNoteData> n) {
+    // 描画: タイムラインがこれまでに進んだ最大の位置からduration先までに入ったら入れる
+    // 逆走していても一度入れたものは外れるまで残すので見落とさない
+    activatedNotes.clear();
+    for (auto &index : seenIndex) {
+        index.MaxSum = max(index.MaxSum, get<1>(index.Timeline->GetRawDrawStateAt(time)));
+        const auto limit = index.MaxSum + duration + noteIndexMargin;
+        while (index.Next < index.Keys.size() && get<0>(index.Keys[index.Next]) <= limit) {
+            const auto note = get<1>(index.Keys[index.Next++]);
+            if (seenActivated[note]) continue;
+            seenActivated[note] = 1;
+            activatedNotes.push_back(note);
+        }
+    }
+    mergeActivated(activeSeenNotes);
+    activeSeenNotes.erase(remove_if(activeSeenNotes.begin(), activeSeenNotes.end(), [&](const uint32_t index) {
+        const auto &n = data[index];
+        const auto types = n->Type.to_ulong();
+        if (types & SU_NOTE_LONG_MASK) return time > n->StartTime + n->Duration;
+        if (types & SU_NOTE_SHORT_MASK) return time > n->StartTime;
+        // 小節線はこの先ずっと-precedより手前にいるなら外す
+        return n->Timeline->GetMinSumFrom(time) > n->StartTimeEx + preced + noteIndexMargin;
+    }), activeSeenNotes.end());
+
+    const auto isVisible = [&](const shared_ptr<SusDrawableNoteData> &n) {
         const auto types = n->Type.to_ulong();
         if (types & SU_NOTE_LONG_MASK) {
             // ロング
@@ -219,13 +360,13 @@ void ScenePlayer::CalculateNotes(double time, double duration, double preced)
             // 先頭が見えてるならもちろん見える
             if (n->ModifiedPosition >= -preced && n->ModifiedPosition <= duration) return get<0>(st);
             // 先頭含めて全部-precedより手前なら見えない
-            if (all_of(n->ExtraData.begin(), n->ExtraData.end(), [preced](const shared_ptr<SusDrawableNoteData> en) {
+            if (all_of(n->ExtraData.begin(), n->ExtraData.end(), [preced](const shared_ptr<SusDrawableNoteData> &en) {
                 if (isnan(en->ModifiedPosition)) return true;
                 if (en->ModifiedPosition < -preced) return true;
                 return false;
             }) && n->ModifiedPosition < -preced) return false;
             //先頭含めて全部durationより後なら見えない
-            if (all_of(n->ExtraData.begin(), n->ExtraData.end(), [duration](const shared_ptr<SusDrawableNoteData> en) {
+            if (all_of(n->ExtraData.begin(), n->ExtraData.end(), [duration](const shared_ptr<SusDrawableNoteData> &en) {
                 if (isnan(en->ModifiedPosition)) return true;
                 if (en->ModifiedPosition > duration) return true;
                 return false;
@@ -245,12 +386,16 @@ void ScenePlayer::CalculateNotes(double time, double duration, double preced)
             return get<0>(st);
         }
         return false;
-    });
+    };
+    seenData.clear();
+    for (const auto index : activeSeenNotes) {
+        if (isVisible(data[index])) seenData.push_back(data[index]);
+    }
 
-    sort(seenData.begin(), seenData.end(), [](const shared_ptr<SusDrawableNoteData> a, const shared_ptr<SusDrawableNoteData> b) {
+    sort(seenData.begin(), seenData.end(), [](const shared_ptr<SusDrawableNoteData> &a, const shared_ptr<SusDrawableNoteData> &b) {
         return a->StartTime > b->StartTime;
     });
-    if (usePrioritySort) sort(seenData.begin(), seenData.end(), [](const shared_ptr<SusDrawableNoteData> a, const shared_ptr<SusDrawableNoteData> b) {
+    if (usePrioritySort) sort(seenData.begin(), seenData.end(), [](const shared_ptr<SusDrawableNoteData> &a, const shared_ptr<SusDrawableNoteData> &b) {
         return a->ExtraAttribute->Priority < b->ExtraAttribute->Priority;
     });
 }
@@ -275,7 +420,16 @@ void ScenePlayer::Tick(const double delta)
     }
 
     if (state != PlayingState::Paused) {
-        if (state >= PlayingState::ReadyCounting) currentTime += delta;
+        if (state >= PlayingState::ReadyCounting) {
+            songClock.Advance(delta);
+            // BGMが鳴っている間はその再生位置に合わせる
+            const auto bgmPlaying = state == PlayingState::BgmPreceding || state == PlayingState::BothOngoing || state == PlayingState::BgmLasting;
+            if (bgmPlaying && bgmStream && bgmStream->GetStatus() == BASS_ACTIVE_PLAYING) {
+                const auto gap = analyzer->SharedMetaData.WaveOffset - soundBufferingLatency;
+                songClock.Synchronize(bgmStream->GetPlayingPosition() + gap);
+            }
+            currentTime = songClock.GetTime();
+        }
         currentSoundTime = currentTime + soundBufferingLatency;
     }
 
@@ -302,6 +456,7 @@ void ScenePlayer::Tick(const double delta)
 
     previousStatus = status;
     if (state != PlayingState::Paused) processor->Update(judgeData);
+    FlushJudgeSounds();
     currentResult->GetCurrentResult(&status);
 
     TickGraphics(delta);
@@ -316,13 +471,13 @@ void ScenePlayer::ProcessSound()
     switch (state) {
         case PlayingState::ReadyCounting:
             if (actualOffset < 0 && currentTime >= actualOffset) {
-                SoundManager::PlayGlobal(bgmStream);
+                if (bgmStream) SoundManager::PlayGlobal(bgmStream);
                 state = PlayingState::BgmPreceding;
             } else if (currentTime >= 0) {
                 state = PlayingState::OnlyScoreOngoing;
             } else if (nextMetronomeTime < 0 && currentTime >= nextMetronomeTime) {
                 // TODO: NextMetronomeにもLatency適用？
-                if (metronomeAvailable) SoundManager::PlayGlobal(soundMetronome->GetSample());
+                if (metronomeAvailable && soundMetronome && !isReplaying) SoundManager::PlayGlobal(soundMetronome->GetSample());
                 nextMetronomeTime += 60 / analyzer->GetBpmAt(0, 0);
             }
             break;
@@ -331,12 +486,12 @@ void ScenePlayer::ProcessSound()
             break;
         case PlayingState::OnlyScoreOngoing:
             if (currentTime >= actualOffset) {
-                SoundManager::PlayGlobal(bgmStream);
+                if (bgmStream) SoundManager::PlayGlobal(bgmStream);
                 state = PlayingState::BothOngoing;
             }
             break;
         case PlayingState::BothOngoing:
-            if (bgmStream->GetStatus() == BASS_ACTIVE_STOPPED) {
+            if (!bgmStream || bgmStream->GetStatus() == BASS_ACTIVE_STOPPED) {
                 if (currentTime >= scoreDuration) {
                     hasEnded = true;
                     manager->Fire("Player:Completed");
@@ -352,7 +507,7 @@ void ScenePlayer::ProcessSound()
             }
             break;
         case PlayingState::BgmLasting:
-            if (bgmStream->GetStatus() == BASS_ACTIVE_STOPPED) {
+            if (!bgmStream || bgmStream->GetStatus() == BASS_ACTIVE_STOPPED) {
                 manager->Fire("Player:Completed");
                 state = PlayingState::Completed;
             }
@@ -367,6 +522,7 @@ void ScenePlayer::ProcessSound()
         default: break;
     }
 
+    if (!movieBackground) return;
     if (moviePlaying) {
         movieCurrentPosition = TellMovieToGraph(movieBackground) / 1000.0;
         return;
@@ -377,62 +533,119 @@ void ScenePlayer::ProcessSound()
     }
 }
 
+// 判定音スレッド
+// フレームごとに起こされ、その間に積まれた判定音を鳴らす
+// 同じ単発音が重なった場合(同時押しなど)は1回にまとめて少し大きく鳴らす
 void ScenePlayer::ProcessSoundQueue()
 {
-    JudgeSoundType type;
-    while (!isTerminating) {
-        if (!judgeSoundQueue.pop(type)) {
-            Sleep(0);
-            continue;
+    int counts[size_t(JudgeSoundType::Metronome) + 1];
+    while (true) {
+        WaitForSingleObject(judgeSoundEvent, INFINITE);
+        if (isTerminating) break;
+
+        fill_n(counts, size_t(JudgeSoundType::Metronome) + 1, 0);
+        JudgeSoundType type;
+        while (judgeSoundQueue.pop(type)) {
+            switch (type) {
+                case JudgeSoundType::Holding:
+                case JudgeSoundType::HoldingStop:
+                case JudgeSoundType::Sliding:
+                case JudgeSoundType::SlidingStop:
+                case JudgeSoundType::AirHolding:
+                case JudgeSoundType::AirHoldingStop:
+                    // ループ音の開始・停止は順番通りに
+                    PlayJudgeSound(type, 1);
+                    break;
+                default:
+                    ++counts[size_t(type)];
+                    break;
+            }
         }
-        switch (type) {
-            case JudgeSoundType::Tap:
-                if (soundTap) SoundManager::PlayGlobal(soundTap->GetSample());
-                break;
-            case JudgeSoundType::ExTap:
-                if (soundExTap) SoundManager::PlayGlobal(soundExTap->GetSample());
-                break;
-            case JudgeSoundType::Flick:
-                if (soundFlick) SoundManager::PlayGlobal(soundFlick->GetSample());
-                break;
-            case JudgeSoundType::Air:
-                if (soundAir) SoundManager::PlayGlobal(soundAir->GetSample());
-                break;
-            case JudgeSoundType::AirDown:
-                if (soundAirDown) SoundManager::PlayGlobal(soundAirDown->GetSample());
-                break;
-            case JudgeSoundType::AirAction:
-                if (soundAirAction) SoundManager::PlayGlobal(soundAirAction->GetSample());
-                break;
-            case JudgeSoundType::Holding:
-                if (soundHoldLoop) SoundManager::PlayGlobal(soundHoldLoop->GetSample());
-                break;
-            case JudgeSoundType::HoldStep:
-                if (soundHoldStep) SoundManager::PlayGlobal(soundHoldStep->GetSample());
-                break;
-            case JudgeSoundType::HoldingStop:
-                if (soundHoldLoop) SoundManager::StopGlobal(soundHoldLoop->GetSample());
-                break;
-            case JudgeSoundType::Sliding:
-                if (soundSlideLoop) SoundManager::PlayGlobal(soundSlideLoop->GetSample());
-                break;
-            case JudgeSoundType::SlideStep:
-                if (soundSlideStep) SoundManager::PlayGlobal(soundSlideStep->GetSample());
-                break;
-            case JudgeSoundType::SlidingStop:
-                if (soundSlideLoop) SoundManager::StopGlobal(soundSlideLoop->GetSample());
-                break;
-            case JudgeSoundType::AirHolding:
-                if (soundAirLoop) SoundManager::PlayGlobal(soundAirLoop->GetSample());
-                break;
-            case JudgeSoundType::AirHoldingStop:
-                if (soundAirLoop) SoundManager::StopGlobal(soundAirLoop->GetSample());
-                break;
-            default: break;
+        for (size_t i = 0; i <= size_t(JudgeSoundType::Metronome); i++) {
+            if (counts[i]) PlayJudgeSound(JudgeSoundType(i), counts[i]);
         }
     }
 }
 
+void ScenePlayer::PlayJudgeSound(const JudgeSoundType type, const int count)
+{
+    const auto sound = GetJudgeSound(type);
+    if (!sound) return;
+    switch (type) {
+        case JudgeSoundType::HoldingStop:
+        case JudgeSoundType::SlidingStop:
+        case JudgeSoundType::AirHoldingStop:
+            SoundManager::StopGlobal(sound->GetSample());
+            break;
+        default:
+            if (count > 1) {
+                SoundManager::PlayGlobal(sound->GetSample(), GetJudgeSoundGain(count));
+            } else {
+                SoundManager::PlayGlobal(sound->GetSample());
+            }
+            break;
+    }
+}
+
+SSound* ScenePlayer::GetJudgeSound(const JudgeSoundType type) const
+{
+    switch (type) {
+        case JudgeSoundType::Tap:
+            return soundTap;
+        case JudgeSoundType::ExTap:
+            return soundExTap;
+        case JudgeSoundType::Flick:
+            return soundFlick;
+        case JudgeSoundType::Air:
+            return soundAir;
+        case JudgeSoundType::AirDown:
+            return soundAirDown;
+        case JudgeSoundType::AirAction:
+            return soundAirAction;
+        case JudgeSoundType::Holding:
+        case JudgeSoundType::HoldingStop:
+            return soundHoldLoop;
+        case JudgeSoundType::HoldStep:
+            return soundHoldStep;
+        case JudgeSoundType::Sliding:
+        case JudgeSoundType::SlidingStop:
+            return soundSlideLoop;
+        case JudgeSoundType::SlideStep:
+            return soundSlideStep;
+        case JudgeSoundType::AirHolding:
+        case JudgeSoundType::AirHoldingStop:
+            return soundAirLoop;
+        default:
+            return nullptr;
+    }
+}
+
+// 同じ音をcount回分まとめて鳴らすときの音量 2倍で+15%、上限は2倍
+double ScenePlayer::GetJudgeSoundGain(const int count)
+{
+    return min(2.0, 1.0 + 0.15 * log2(double(count)));
+}
+
+// 判定音をBGMのtime(曲内時刻)の位置に直接混ぜ込む予約をする
+// 予約できなかった(BGMの範囲外・DSPに間に合わない)場合はfalseなので、EnqueueJudgeSoundで鳴らすこと
+bool ScenePlayer::ScheduleJudgeSound(const JudgeSoundType type, const double time, const int count)
+{
+    if (!soundScheduler || isReplaying) return false;
+    const auto sound = GetJudgeSound(type);
+    if (!sound) return false;
+    return soundScheduler->Schedule(sound->GetSample(), time - analyzer->SharedMetaData.WaveOffset, GetJudgeSoundGain(count));
+}
+
+void ScenePlayer::CancelScheduledJudgeSounds() const
+{
+    if (soundScheduler) soundScheduler->Clear();
+}
+
+double ScenePlayer::GetJudgeSoundLookahead() const
+{
+    return soundScheduler ? soundScheduler->GetLookahead() : 0;
+}
+
 // スクリプト側から呼べるやつら
 
 void ScenePlayer::Load()
@@ -525,6 +738,7 @@ void ScenePlayer::MovePositionBySecond(const double sec)
     newBgmPos = max(0.0, newBgmPos);
     bgmStream->SetPlayingPosition(newBgmPos);
     currentTime = newBgmPos + gap;
+    songClock.Reset(currentTime);
     processor->MovePosition(currentTime - oldTime);
     SeekMovieToGraph(movieBackground, int((currentTime - oldTime + movieCurrentPosition) * 1000.0));
 }
@@ -543,6 +757,7 @@ void ScenePlayer::MovePositionByMeasure(const int meas)
     newBgmPos = max(0.0, newBgmPos);
     bgmStream->SetPlayingPosition(newBgmPos);
     currentTime = newBgmPos + gap;
+    songClock.Reset(currentTime);
     processor->MovePosition(currentTime - oldTime);
     SeekMovieToGraph(movieBackground, int((currentTime - oldTime + movieCurrentPosition) * 1000.0));
 }
@@ -574,6 +789,7 @@ void ScenePlayer::Reload()
     const auto prevOffset = analyzer->SharedMetaData.WaveOffset;
     const auto prevBgmPos = bgmStream->GetPlayingPosition();
     SoundManager::StopGlobal(bgmStream);
+    soundScheduler.reset();
     delete bgmStream;
 
     SetMainWindowText(reinterpret_cast<const char*>(L"リロード中…"));
@@ -583,6 +799,7 @@ void ScenePlayer::Reload()
     const auto bgmMeantToBePlayedAt = prevBgmPos - (analyzer->SharedMetaData.WaveOffset - prevOffset);
     bgmStream->SetPlayingPosition(bgmMeantToBePlayedAt);
     currentTime = prevCurrentTime;
+    songClock.Reset(currentTime);
     state = PlayingState::Paused;
 }
 
@@ -621,6 +838,9 @@ void ScenePlayer::GetMetrics(ScenePlayerMetrics *metrics)
     metrics->JudgeLineLeftY = left.y;
     metrics->JudgeLineRightX = right.x;
     metrics->JudgeLineRightY = right.y;
+    metrics->ClockDrift = songClock.GetDrift();
+    metrics->ClockJitter = songClock.GetJitter();
+    metrics->ClockRate = songClock.GetRate();
 }
 
 void ScenePlayer::StoreResult() const
@@ -8,6 +8,8 @@
 #include "SoundManager.h"
 #include "Result.h"
 #include "CharacterInstance.h"
+#include "NoteSpriteBatch.h"
+#include "SongClock.h"
 
 #define SU_IF_SCENE_PLAYER "ScenePlayer"
 #define SU_IF_SCENE_PLAYER_METRICS "ScenePlayerMetrics"
@@ -66,17 +68,65 @@ enum class PlayingState {
     Completed,
 };
 
-enum class AirDrawType {
+// 描画順の大分類 この順に描画される
+// ShortNoteまでは背景バッファ、それ以降は3D
+enum class RenderLayer : uint8_t {
+    MeasureLine = 0,
+    LongNote,           // Hold/Slideの帯(加算)・中心線・始点・中継点・終点 (seenDataの順)
+    ShortNote,
+    Aerial,             // Air/AirActionの始点・中継点 (奥から)
+    AirActionCover,
+    AirActionStepBox,
+};
+
+enum class RenderCommandType {
+    MeasureLine,
+    HoldBody,
+    HoldStep,
+    SlideBody,
+    SlideLine,
+    SlideStep,
+    ShortNote,
     Air,
     AirActionStart,
     AirActionStep,
     AirActionCover,
+    AirActionStepBox,
 };
 
-struct AirDrawQuery {
-    double Z = 0.0;
-    AirDrawType Type = AirDrawType::Air;
+// 1フレーム分のノーツ描画命令
+// Keyは (層, 優先度の順位) を詰めたもので、Key→Z→Sequenceの順に並べて描画する
+struct RenderCommand {
+    uint64_t Key = 0;
+    double Z = 0.0;                 // Aerialでは判定線からの相対位置、その他は0
+    uint32_t Sequence = 0;          // 積んだ順
+    RenderCommandType Type = RenderCommandType::ShortNote;
+    int BlendMode = DX_BLENDMODE_ALPHA;
+    int BlendParam = 255;
     std::shared_ptr<SusDrawableNoteData> Note, PreviousNote;
+
+    static uint64_t MakeKey(RenderLayer layer, uint32_t group)
+    {
+        return uint64_t(layer) << 56 | uint64_t(std::min(group, 0xFFFFu)) << 40;
+    }
+    RenderLayer GetLayer() const { return RenderLayer(Key >> 56); }
+};
+
+// 同じタイムラインに乗っているノーツの索引(CalculateNotes用)
+struct NoteTimelineIndex {
+    std::shared_ptr<SusHispeedTimeline> Timeline;
+    std::vector<std::tuple<double, uint32_t>> Keys;                 // StartTimeExとdataでの位置(StartTimeEx順)
+    size_t Next = 0;                                                // 次に有効化するKeysの位置
+    double MaxSum = -std::numeric_limits<double>::infinity();       // これまでのフレームで見た最大の位置
+};
+
+// リプレイ実行で記録する1ノーツ分の判定
+struct JudgeLogEntry {
+    double Time;                // 判定したときのcurrentTime
+    double NoteTime;            // 判定したノーツ(中継点ならその中継点)のStartTime
+    AbilityNoteType Note;
+    AbilityJudgeType Judge;
+    double Left, Right;
 };
 
 struct ScenePlayerMetrics {
@@ -84,6 +134,9 @@ struct ScenePlayerMetrics {
     double JudgeLineLeftY;
     double JudgeLineRightX;
     double JudgeLineRightY;
+    double ClockDrift;      // BGM時刻 - 曲内時刻 の平均(秒)
+    double ClockJitter;     // 上の揺らぎ(秒)
+    double ClockRate;       // 推定したBGMの再生速度
 };
 
 class ExecutionManager;
@@ -92,12 +145,16 @@ class ScenePlayer : public SSprite {
     friend class ScoreProcessor;
     friend class AutoPlayerProcessor;
     friend class PlayableProcessor;
+    friend class ReplayRunner;
 
 protected:
     int hGroundBuffer {};
+    int hGroundVertexBuffer = -1, hGroundIndexBuffer = -1;     // LoadResourcesで作る地面の頂点/頂点番号バッファ
     ExecutionManager *manager;
     SoundManager * const soundManager; // soundManager のアドレスが不変、 soundManager の実体が持つ値は変わりうる
-    boost::lockfree::queue<JudgeSoundType> judgeSoundQueue;
+    boost::lockfree::spsc_queue<JudgeSoundType, boost::lockfree::capacity<256>> judgeSoundQueue;
+    HANDLE judgeSoundEvent = nullptr;   // フレームの終わりに判定音スレッドを起こす
+    bool hasPendingJudgeSounds = false;
     std::thread judgeSoundThread;
     std::mutex asyncMutex;
     std::thread loadWorkerThread;
@@ -106,6 +163,7 @@ protected:
     std::vector<SSprite*> spritesPending;
 
     SoundStream *bgmStream {};
+    std::unique_ptr<SoundScheduler> soundScheduler;     // 自動再生の判定音をBGMに混ぜ込む
     ScoreProcessor * const processor; // processor のアドレスが不変、 processor の実体が持つ値は変わりうる
 
     // 状態管理変数
@@ -114,6 +172,7 @@ protected:
     bool isTerminating = false;     // Finalizeで書き換え インスタンス破棄時にtrue これをもって音声スレッドを破棄
     bool usePrioritySort = false;   // LoadWorkerで書き換え 優先度付きノーツ描画が有効ならtrue
     bool hasEnded = false;          // ProcessSoundで書き換え すべてのノーツの判定が終わっていればtrue
+    bool isReplaying = false;       // ReplayRunnerで書き換え 映像・音声・演出を使わずに進めるならtrue
 
     // 描画関連定数
     double cameraZ = -340, cameraY = 620, cameraTargetZ = 580;  // カメラ位置 (スキンから設定可にしてるけどぶっちゃけconstで良い気がする)
@@ -162,20 +221,47 @@ protected:
     std::vector<VERTEX2D> slideVertices;    // Slide描画用頂点座標配列 関数内ローカル変数で頻繁に生成,破棄されるのを嫌って宣言
     std::vector<uint16_t> slideIndices;     // Slide描画用頂点番号指定配列 同上
 
+    // 小節線描画関係 1フレーム分をまとめて1回で描画する
+    std::vector<VERTEX2D> measureLineVertices;  // 小節線描画用頂点座標配列 関数内ローカル変数で頻繁に生成,破棄されるのを嫌って宣言
+    std::vector<uint16_t> measureLineIndices;   // 小節線描画用頂点番号指定配列 同上
+
+    // ノーツ描画命令 関数内ローカル変数で頻繁に生成,破棄されるのを嫌って宣言
+    std::vector<RenderCommand> renderCommands;
+    size_t nextRenderCommand = 0;                   // 次に描画するrenderCommandsの位置
+    int appliedBlendMode = -1, appliedBlendParam = -1;  // SetNoteBlendModeで最後に設定したもの
+
+    // ショートノーツ描画関係
+    NoteSpriteBatch noteSprites;                // DrawTapの矩形をテクスチャとブレンドが同じ間まとめておく
+    std::vector<VERTEX2D> noteSpriteVertices;   // noteSpritesを描画する時の頂点配列 関数内ローカル変数で頻繁に生成,破棄されるのを嫌って宣言
+
     const std::shared_ptr<Result> currentResult;
+    std::vector<JudgeLogEntry> judgeLog;        // isReplayingのときだけRecordJudgeで積む
+    boost::filesystem::path replayScorePath;    // isReplayingのときに選曲の代わりに読む譜面
     DrawableResult previousStatus {}, status {};
 
     std::shared_ptr<CharacterInstance> currentCharacterInstance;
 
     DrawableNotesList data;
     DrawableNotesList seenData, judgeData;
+    // CalculateNotesで見るノーツの索引 dataでの位置で持つ
+    std::vector<NoteTimelineIndex> seenIndex;
+    std::vector<uint32_t> judgeOrder;           // StartTime順
+    std::vector<uint32_t> activeSeenNotes;      // 見えうるノーツ(dataの順)
+    std::vector<uint32_t> activeJudgeNotes;     // 判定しうるノーツ(dataの順)
+    std::vector<uint32_t> activatedNotes;       // 1フレームで新しく有効化したノーツ 関数内ローカル変数で頻繁に生成,破棄されるのを嫌って宣言
+    std::vector<uint8_t> seenActivated;         // 一度でもactiveSeenNotesに入ったか
+    size_t nextJudgeNote = 0;
+    double lastIndexedTime = 0;
+    double indexedJudgeMargin = 0;
     std::unordered_map<std::shared_ptr<SusDrawableNoteData>, SSprite*> slideEffects;
-    NoteCurvesList curveData;
+    SusCurveBuffer curveData;
     double currentTime = 0;
     double currentSoundTime = 0;
+    SongClock songClock;            // currentTimeの元 BGM再生中はその位置に追従する
     double seenDuration = 0.8;
     const double hispeedMultiplier; // = 6.0
     const double preloadingTime = 0.5;
+    const double noteIndexMargin = 0.001;   // 索引で絞り込むときに足す余裕(丸め誤差対策)
     double backingTime = 0.0;
     double nextMetronomeTime = 0.0;
     double scoreDuration = 0.0;
@@ -193,26 +279,45 @@ protected:
     void LoadWorker();
     void RemoveSlideEffect();
     void UpdateSlideEffect();
+    void BuildNoteIndex();
+    void ResetNoteIndex();
     void CalculateNotes(double time, double duration, double preced);
-    void DrawShortNotes(const std::shared_ptr<SusDrawableNoteData>& note) const;
-    void DrawAirNotes(const AirDrawQuery &query) const;
-    void DrawHoldNotes(const std::shared_ptr<SusDrawableNoteData>& note) const;
-    void DrawSlideNotes(const std::shared_ptr<SusDrawableNoteData>& note);
-    void DrawAirActionStart(const AirDrawQuery &query) const;
-    void DrawAirActionStep(const AirDrawQuery &query) const;
-    void DrawAirActionStepBox(const AirDrawQuery &query) const;
-    void DrawAirActionCover(const AirDrawQuery &query);
-    void DrawTap(float lane, int length, double relpos, int handle) const;
-    void DrawMeasureLine(const std::shared_ptr<SusDrawableNoteData>& note) const;
+    void BuildRenderCommands();
+    void SubmitRenderCommands(RenderLayer lastLayer);
+    void SetNoteBlendMode(int mode, int param);
+    void DrawShortNotes(const std::shared_ptr<SusDrawableNoteData>& note);
+    void DrawAirNotes(const RenderCommand &query) const;
+    void DrawHoldBody(const std::shared_ptr<SusDrawableNoteData>& note) const;
+    void DrawHoldSteps(const std::shared_ptr<SusDrawableNoteData>& note);
+    void DrawSlideBody(const std::shared_ptr<SusDrawableNoteData>& note);
+    void DrawSlideLine(const std::shared_ptr<SusDrawableNoteData>& note) const;
+    void DrawSlideSteps(const std::shared_ptr<SusDrawableNoteData>& note);
+    void DrawAirActionStart(const RenderCommand &query) const;
+    void DrawAirActionStep(const RenderCommand &query) const;
+    void DrawAirActionStepBox(const RenderCommand &query) const;
+    void DrawAirActionCover(const RenderCommand &query);
+    void DrawTap(float lane, int length, double relpos, SImage *image);
+    void DrawNoteSprites(const NoteSpriteBatch &batch);
+    void DrawMeasureLine(const std::shared_ptr<SusDrawableNoteData>& note);
+    void FlushMeasureLines();
+    void CreateGroundBuffers();
+    void DeleteGroundBuffers();
     void Prepare3DDrawCall() const;
-    void DrawAerialNotes(const std::vector<std::shared_ptr<SusDrawableNoteData>>& notes);
 
     void ProcessSound();
     void ProcessSoundQueue();
+    void PlayJudgeSound(JudgeSoundType type, int count);
+    void FlushJudgeSounds();
+    SSound *GetJudgeSound(JudgeSoundType type) const;
+    static double GetJudgeSoundGain(int count);
 
     void SpawnJudgeEffect(const std::shared_ptr<SusDrawableNoteData>& target, JudgeType type);
     void SpawnSlideLoopEffect(const std::shared_ptr<SusDrawableNoteData>& target);
     void EnqueueJudgeSound(JudgeSoundType type);
+    bool ScheduleJudgeSound(JudgeSoundType type, double time, int count);
+    void CancelScheduledJudgeSounds() const;
+    double GetJudgeSoundLookahead() const;
+    void RecordJudge(const std::shared_ptr<SusDrawableNoteData>& note, const JudgeInformation &info, AbilityJudgeType judge);
 
 public:
     explicit ScenePlayer(ExecutionManager *exm);
@@ -0,0 +1,428 @@
+﻿#include "ScoreBenchmark.h"
+#include "Config.h"
+#include "Misc.h"
+
+using namespace std;
+using namespace std::chrono;
+namespace ba = boost::algorithm;
+
+namespace
+{
+    const uint32_t benchmarkSeed = 20180401;
+
+    string ToBase36(const uint32_t value, const size_t digits)
+    {
+        static const char table[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+        string result(digits, '0');
+        auto rest = value;
+        for (auto i = digits; i > 0; i--) {
+            result[i - 1] = table[rest % 36];
+            rest /= 36;
+        }
+        return result;
+    }
+
+    string WriteHeader(const string &title, const uint32_t ticksPerBeat)
+    {
+        return fmt::format(
+            "#TITLE \"{0}\"\n#ARTIST \"benchmark\"\n#DESIGNER \"benchmark\"\n#DIFFICULTY 3\n#PLAYLEVEL 13\n"
+            "#WAVE \"benchmark.ogg\"\n#WAVEOFFSET 0\n#REQUEST \"ticks_per_beat {1}\"\n#BPM01: 150\n#00008: 01\n",
+            title, ticksPerBeat);
+    }
+
+    // 1行分のノーツ列 divisions等分のうちslotsの位置にnoteを置く
+    string MakePattern(const uint32_t divisions, const vector<uint32_t> &slots, const string &note)
+    {
+        string result(divisions * 2, '0');
+        for (const auto slot : slots) result.replace(slot * 2, 2, note);
+        return result;
+    }
+
+    string GenerateTaps(mt19937 &random, const uint32_t measure, const uint32_t divisions)
+    {
+        string result;
+        uniform_int_distribution<uint32_t> lane(0, 12), slot(0, divisions - 1), kind(1, 5);
+        for (auto i = 0; i < 4; i++) {
+            result += fmt::format("#{0:03d}1{1:x}: {2}\n", measure, lane(random), MakePattern(divisions, { slot(random) }, fmt::format("{0}4", kind(random))));
+        }
+        return result;
+    }
+
+    // 少数の小節にタップだけ
+    string GenerateShortChart(mt19937 &random)
+    {
+        auto result = WriteHeader("short", 192);
+        for (auto m = 0u; m < 16; m++) result += GenerateTaps(random, m, 16);
+        return result;
+    }
+
+    // 長い譜面にタップ・ホールド・Air
+    string GenerateLongChart(mt19937 &random)
+    {
+        auto result = WriteHeader("long", 480);
+        uniform_int_distribution<uint32_t> lane(0, 12);
+        for (auto m = 0u; m < 800; m++) {
+            result += GenerateTaps(random, m, 16);
+            const auto channel = ToBase36(m % 36, 1);
+            result += fmt::format("#{0:03d}2{1:x}{2}: {3}\n", m, lane(random), channel, "14000000000024000000000000000000");
+            result += fmt::format("#{0:03d}5{1:x}: {2}\n", m, lane(random), "0000001400000000");
+        }
+        return result;
+    }
+
+    // 1小節に4回BPMが変わる
+    string GenerateBpmChart(mt19937 &random)
+    {
+        auto result = WriteHeader("bpm", 480);
+        uniform_real_distribution<double> bpm(60, 300);
+        const auto definitions = 1000u;
+        for (auto i = 2u; i < definitions; i++) result += fmt::format("#BPM{0}: {1:.2f}\n", ToBase36(i, 2), bpm(random));
+        uniform_int_distribution<uint32_t> number(2, definitions - 1);
+        for (auto m = 0u; m < 400; m++) {
+            string changes;
+            for (auto i = 0; i < 4; i++) changes += ToBase36(number(random), 2);
+            result += fmt::format("#{0:03d}08: {1}\n", m, changes);
+            result += GenerateTaps(random, m, 16);
+        }
+        return result;
+    }
+
+    // キーがとても多いハイスピード定義
+    string GenerateTimelineChart(mt19937 &random)
+    {
+        auto result = WriteHeader("til", 480);
+        uniform_real_distribution<double> speed(0.25, 4.0);
+        const auto measures = 250u;
+        string keys;
+        for (auto m = 0u; m < measures; m++) {
+            for (auto i = 0u; i < 16; i++) {
+                if (!keys.empty()) keys += ", ";
+                keys += fmt::format("{0}'{1}:{2:.3f}", m, i * 120, speed(random));
+            }
+        }
+        result += fmt::format("#TIL00: \"{0}\"\n#HISPEED 00\n", keys);
+        for (auto m = 0u; m < measures; m++) result += GenerateTaps(random, m, 16);
+        return result;
+    }
+
+    // 制御点付きのスライドが密に並ぶ
+    string GenerateSlideChart(mt19937 &random)
+    {
+        auto result = WriteHeader("slides", 480);
+        uniform_int_distribution<uint32_t> lane(0, 12);
+        const auto kinds = { "1", "4", "3", "4", "5", "4", "2" };
+        for (auto m = 0u; m < 300; m++) {
+            for (auto s = 0u; s < 6; s++) {
+                const auto channel = ToBase36((m % 6) * 6 + s, 1);
+                auto slot = 0u;
+                for (const auto kind : kinds) {
+                    result += fmt::format("#{0:03d}3{1:x}{2}: {3}\n", m, lane(random), channel, MakePattern(8, { slot++ }, string(kind) + "4"));
+                }
+            }
+        }
+        return result;
+    }
+
+    // 改行がCRLF(Windowsのエディタで保存したもの)
+    string GenerateCrlfChart(mt19937 &random)
+    {
+        auto result = WriteHeader("crlf", 480);
+        result += "#JACKET \"jacket.png\"\n#TIL00: \"0'0:1.0, 4'0:2.0\"\n#HISPEED 00\n";
+        uniform_int_distribution<uint32_t> lane(0, 12);
+        for (auto m = 0u; m < 200; m++) {
+            result += GenerateTaps(random, m, 16);
+            result += fmt::format("#{0:03d}2{1:x}{2}: {3}\n", m, lane(random), ToBase36(m % 36, 1), "14000000000024000000000000000000");
+        }
+        return ba::replace_all_copy(result, "\n", "\r\n");
+    }
+
+    // 以前のCalculateCurvesと同じく、分割点ごとに制御点をコピーしてde Casteljauで求める(比較用)
+    void PushDeCasteljau(vector<tuple<double, double>> &points, const vector<tuple<double, double>> &controlPoints, const uint32_t count)
+    {
+        vector<tuple<double, double>> work;
+        for (auto j = 0u; j < count; j++) {
+            const auto t = count > 1 ? double(j) / (count - 1) : 0.0;
+            work = controlPoints;
+            for (auto k = work.size() - 1; k > 0; k--) {
+                for (auto i = 0u; i < k; i++) {
+                    work[i] = make_tuple(
+                        get<0>(work[i]) * (1 - t) + get<0>(work[i + 1]) * t,
+                        get<1>(work[i]) * (1 - t) + get<1>(work[i + 1]) * t);
+                }
+            }
+            points.push_back(work[0]);
+        }
+    }
+
+    // 分解能が高く、1小節のデータが長い
+    string GenerateHighResolutionChart(mt19937 &random)
+    {
+        auto result = WriteHeader("tpb", 1920);
+        uniform_int_distribution<uint32_t> lane(0, 12), slot(0, 767);
+        for (auto m = 0u; m < 120; m++) {
+            for (auto i = 0; i < 4; i++) {
+                result += fmt::format("#{0:03d}1{1:x}: {2}\n", m, lane(random), MakePattern(768, { slot(random), slot(random), slot(random) }, "14"));
+            }
+        }
+        return result;
+    }
+}
+
+bool ScoreBenchmarkOptions::Parse(const vector<wstring> &args, ScoreBenchmarkOptions &options)
+{
+    auto found = false;
+    for (auto i = 0u; i + 1 < args.size(); i++) {
+        const auto &value = args[i + 1];
+        if (args[i] == SU_BENCHMARK_OPTION) {
+            options.CorpusDirectory = value;
+            found = true;
+        } else if (args[i] == L"--output") {
+            options.OutputPath = value;
+        } else if (args[i] == L"--repeat") {
+            options.Repeats = max(1u, SU_TO_UINT32(wcstoul(value.c_str(), nullptr, 10)));
+        } else {
+            continue;
+        }
+        ++i;
+    }
+    if (found && options.OutputPath.empty()) options.OutputPath = (boost::filesystem::path(options.CorpusDirectory) / L"benchmark.json").wstring();
+    return found;
+}
+
+ScoreBenchmark::ScoreBenchmark(const ScoreBenchmarkOptions &options)
+    : options(options)
+{}
+
+// 生成する譜面は毎回同じ内容になる
+bool ScoreBenchmark::GenerateCorpus() const
+{
+    auto log = spdlog::get("main");
+    const boost::filesystem::path directory(options.CorpusDirectory);
+    boost::system::error_code error;
+    boost::filesystem::create_directories(directory, error);
+    if (error) {
+        log->error(u8"コーパスのディレクトリ {0} を作れませんでした", ConvertUnicodeToUTF8(options.CorpusDirectory));
+        return false;
+    }
+
+    const vector<tuple<wstring, string(*)(mt19937&)>> generators = {
+        make_tuple(L"generated-short.sus", GenerateShortChart),
+        make_tuple(L"generated-long.sus", GenerateLongChart),
+        make_tuple(L"generated-bpm.sus", GenerateBpmChart),
+        make_tuple(L"generated-til.sus", GenerateTimelineChart),
+        make_tuple(L"generated-slides.sus", GenerateSlideChart),
+        make_tuple(L"generated-tpb.sus", GenerateHighResolutionChart),
+        make_tuple(L"generated-crlf.sus", GenerateCrlfChart),
+    };
+    for (const auto &generator : generators) {
+        mt19937 random(benchmarkSeed);
+        boost::filesystem::ofstream file(directory / get<0>(generator), ios::out | ios::binary | ios::trunc);
+        if (!file) {
+            log->error(u8"譜面 {0} を書き出せませんでした", ConvertUnicodeToUTF8(get<0>(generator)));
+            return false;
+        }
+        file << get<1>(generator)(random);
+    }
+    return true;
+}
+
+ScoreBenchmarkTiming ScoreBenchmark::Summarize(const string &name, vector<double> &samples, const uint64_t operations) const
+{
+    ScoreBenchmarkTiming timing;
+    timing.Name = name;
+    timing.Operations = operations;
+    sort(samples.begin(), samples.end());
+    timing.Minimum = samples.front();
+    timing.Median = samples[samples.size() / 2];
+    timing.Mean = accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    return timing;
+}
+
+ScoreBenchmarkResult ScoreBenchmark::Measure(const boost::filesystem::path &file) const
+{
+    const auto elapsed = [](const high_resolution_clock::time_point &start) {
+        return duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+    };
+
+    ScoreBenchmarkResult result;
+    result.Name = ConvertUnicodeToUTF8(file.filename().wstring());
+    result.Bytes = boost::filesystem::file_size(file);
+
+    SusAnalyzer analyzer(192);
+    vector<double> loadFull, loadMeta, render, curves, absoluteTime;
+    uint64_t slides = 0, queries = 0;
+    for (auto r = 0u; r < options.Repeats; r++) {
+        analyzer.Reset();
+        auto start = high_resolution_clock::now();
+        analyzer.LoadFromFile(file.wstring(), true);
+        loadMeta.push_back(elapsed(start));
+
+        analyzer.Reset();
+        start = high_resolution_clock::now();
+        analyzer.LoadFromFile(file.wstring());
+        loadFull.push_back(elapsed(start));
+        if (analyzer.SharedMetaData.UTitle.find('\r') != string::npos || analyzer.SharedMetaData.UWaveFileName.find('\r') != string::npos) {
+            spdlog::get("main")->warn(u8"{0}: メタデータに改行文字が残っています", result.Name);
+        }
+
+        DrawableNotesList data;
+        SusCurveBuffer curveData;
+        start = high_resolution_clock::now();
+        analyzer.RenderScoreData(data, curveData);
+        render.push_back(elapsed(start));
+        result.Notes = data.size();
+        result.CurvePoints = curveData.GetSize();
+
+        // RenderScoreDataでも作っているが、スライドの曲線だけをもう一度作り直して計る
+        SusCurveBuffer rebuilt;
+        slides = 0;
+        start = high_resolution_clock::now();
+        for (const auto &note : data) {
+            if (!note->Type[size_t(SusNoteType::Slide)]) continue;
+            analyzer.CalculateCurves(note, rebuilt);
+            ++slides;
+        }
+        curves.push_back(elapsed(start));
+
+        // 全小節を1拍の1/8刻みで引く
+        const auto measures = get<0>(analyzer.GetRelativeTime(analyzer.SharedMetaData.ScoreDuration)) + 1;
+        auto sum = 0.0;
+        queries = 0;
+        start = high_resolution_clock::now();
+        const auto step = max(1u, analyzer.ticksPerBeat / 8);
+        for (auto m = 0u; m < measures; m++) {
+            const auto ticks = SU_TO_UINT32(analyzer.GetBeatsAt(m) * analyzer.ticksPerBeat);
+            for (auto t = 0u; t < ticks; t += step) {
+                sum += analyzer.GetAbsoluteTime(m, t);
+                ++queries;
+            }
+        }
+        absoluteTime.push_back(elapsed(start));
+        if (isnan(sum)) spdlog::get("main")->warn(u8"{0}: GetAbsoluteTimeがNaNを返しました", result.Name);
+    }
+
+    result.Timings.push_back(Summarize("LoadFromFile", loadFull, 1));
+    result.Timings.push_back(Summarize("LoadFromFileMetaData", loadMeta, 1));
+    result.Timings.push_back(Summarize("RenderScoreData", render, result.Notes));
+    result.Timings.push_back(Summarize("CalculateCurves", curves, slides));
+    result.Timings.push_back(Summarize("GetAbsoluteTime", absoluteTime, queries));
+    return result;
+}
+
+// 曲線1本分の分割を、制御点の数と1秒あたりの分割数ごとに計る
+// CalculateCurvesと同じく0.25~1秒の区間を(分割数 * 秒数 + 2)点に分ける
+// 区間は曲の0~600秒のどこかに置く(曲の後半ほど時刻の絶対値が大きく、桁落ちしやすい)
+ScoreBenchmarkResult ScoreBenchmark::MeasureCurveKernel() const
+{
+    const auto elapsed = [](const high_resolution_clock::time_point &start) {
+        return duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+    };
+    const auto segments = 200u;
+
+    ScoreBenchmarkResult result;
+    result.Name = "curve-kernel";
+    for (const auto controlCount : { 2u, 3u, 4u, 6u, 12u, 24u }) {
+        for (const auto segmentsPerSecond : { 20u, 100u, 1000u }) {
+            mt19937 random(benchmarkSeed);
+            uniform_real_distribution<double> duration(0.25, 1.0), position(0.0, 1.0), offset(0.0, 600.0);
+            vector<vector<tuple<double, double>>> curves(segments);
+            vector<uint32_t> counts(segments);
+            uint64_t samples = 0;
+            for (auto i = 0u; i < segments; i++) {
+                const auto length = duration(random);
+                const auto start = offset(random);
+                for (auto c = 0u; c < controlCount; c++) curves[i].emplace_back(start + length * c / (controlCount - 1), position(random));
+                counts[i] = SU_TO_UINT32(segmentsPerSecond * length + 2);
+                samples += counts[i];
+            }
+
+            vector<double> kernel, reference;
+            SusCurveBuffer buffer;
+            vector<tuple<double, double>> expected;
+            for (auto r = 0u; r < options.Repeats; r++) {
+                buffer.Clear();
+                auto start = high_resolution_clock::now();
+                for (auto i = 0u; i < segments; i++) buffer.PushBezier(curves[i], counts[i]);
+                kernel.push_back(elapsed(start));
+
+                expected.clear();
+                start = high_resolution_clock::now();
+                for (auto i = 0u; i < segments; i++) PushDeCasteljau(expected, curves[i], counts[i]);
+                reference.push_back(elapsed(start));
+            }
+
+            auto deviation = 0.0;
+            const auto &points = buffer.GetPoints();
+            for (auto i = 0u; i < points.size() && i < expected.size(); i++) {
+                deviation = max({ deviation, fabs(get<0>(points[i]) - get<0>(expected[i])), fabs(get<1>(points[i]) - get<1>(expected[i])) });
+            }
+            if (points.size() != expected.size() || deviation > 1e-9) {
+                spdlog::get("main")->warn(u8"curve-kernel: 制御点{0}個 {1}分割/秒でde Casteljauと{2}ずれています", controlCount, segmentsPerSecond, deviation);
+            }
+
+            const auto name = fmt::format("cps={0} sps={1}", controlCount, segmentsPerSecond);
+            result.Timings.push_back(Summarize("PushBezier " + name, kernel, samples));
+            result.Timings.push_back(Summarize("DeCasteljau " + name, reference, samples));
+            result.CurvePoints += samples;
+        }
+    }
+    return result;
+}
+
+bool ScoreBenchmark::Run()
+{
+    auto log = spdlog::get("main");
+    if (!GenerateCorpus()) return false;
+
+    vector<boost::filesystem::path> files;
+    for (const auto &entry : boost::make_iterator_range(boost::filesystem::directory_iterator(options.CorpusDirectory), {})) {
+        if (ba::iequals(entry.path().extension().wstring(), L".sus")) files.push_back(entry.path());
+    }
+    sort(files.begin(), files.end());
+
+    vector<ScoreBenchmarkResult> results;
+    for (const auto &file : files) {
+        log->info(u8"計測中: {0}", ConvertUnicodeToUTF8(file.filename().wstring()));
+        results.push_back(Measure(file));
+    }
+    log->info(u8"計測中: curve-kernel");
+    results.push_back(MeasureCurveKernel());
+    return WriteResult(results);
+}
+
+// 記録して比べられるように、項目の並びと名前は変えない
+bool ScoreBenchmark::WriteResult(const vector<ScoreBenchmarkResult> &results) const
+{
+    auto log = spdlog::get("main");
+    boost::filesystem::ofstream file(boost::filesystem::path(options.OutputPath), ios::out | ios::binary | ios::trunc);
+    if (!file) {
+        log->error(u8"計測結果 {0} を書き出せませんでした", ConvertUnicodeToUTF8(options.OutputPath));
+        return false;
+    }
+
+    file << "{\n";
+    file << fmt::format("  \"version\": \"{0}\",\n", SU_APP_VERSION);
+    file << fmt::format("  \"repeats\": {0},\n", options.Repeats);
+    file << "  \"unit\": \"ms\",\n";
+    file << "  \"charts\": [\n";
+    for (auto i = 0u; i < results.size(); i++) {
+        const auto &result = results[i];
+        file << "    {\n";
+        file << fmt::format("      \"name\": \"{0}\",\n", result.Name);
+        file << fmt::format("      \"bytes\": {0},\n", result.Bytes);
+        file << fmt::format("      \"notes\": {0},\n", result.Notes);
+        file << fmt::format("      \"curve_points\": {0},\n", result.CurvePoints);
+        file << "      \"benchmarks\": [\n";
+        for (auto j = 0u; j < result.Timings.size(); j++) {
+            const auto &timing = result.Timings[j];
+            file << fmt::format(
+                "        {{ \"name\": \"{0}\", \"min\": {1:.6f}, \"median\": {2:.6f}, \"mean\": {3:.6f}, \"operations\": {4} }}{5}\n",
+                timing.Name, timing.Minimum, timing.Median, timing.Mean, timing.Operations, j + 1 < result.Timings.size() ? "," : "");
+        }
+        file << "      ]\n";
+        file << fmt::format("    }}{0}\n", i + 1 < results.size() ? "," : "");
+    }
+    file << "  ]\n}\n";
+    log->info(u8"計測結果を {0} に書き出しました", ConvertUnicodeToUTF8(options.OutputPath));
+    return true;
+}
@@ -0,0 +1,52 @@
+﻿#pragma once
+
+#include "SusAnalyzer.h"
+
+#define SU_BENCHMARK_OPTION L"--benchmark"
+
+// ScoreBenchmarkの設定 コマンドライン
+//   --benchmark <コーパスのディレクトリ> [--output <結果.json>] [--repeat <回数>]
+struct ScoreBenchmarkOptions {
+    std::wstring CorpusDirectory;
+    std::wstring OutputPath;        // 空ならコーパスのディレクトリのbenchmark.json
+    uint32_t Repeats = 5;
+
+    static bool Parse(const std::vector<std::wstring> &args, ScoreBenchmarkOptions &options);
+};
+
+// 1項目分の計測結果(ミリ秒)
+struct ScoreBenchmarkTiming {
+    std::string Name;
+    double Minimum = 0;
+    double Median = 0;
+    double Mean = 0;
+    uint64_t Operations = 0;        // 1回の計測で処理した数(GetAbsoluteTimeなら呼び出し回数)
+};
+
+struct ScoreBenchmarkResult {
+    std::string Name;
+    uint64_t Bytes = 0;
+    uint64_t Notes = 0;
+    uint64_t CurvePoints = 0;
+    std::vector<ScoreBenchmarkTiming> Timings;
+};
+
+// 譜面解析の計測
+// 特徴の違う譜面をコーパスのディレクトリに生成して、そこにある.susをすべて計測しJSONで書き出す
+// 曲線の分割(PushBezier)だけの計測もcurve-kernelとして並べる
+// SusAnalyzerだけに依存するのでDxLib無しでもビルドできる
+class ScoreBenchmark final {
+private:
+    ScoreBenchmarkOptions options;
+
+    bool GenerateCorpus() const;
+    ScoreBenchmarkResult Measure(const boost::filesystem::path &file) const;
+    ScoreBenchmarkResult MeasureCurveKernel() const;
+    ScoreBenchmarkTiming Summarize(const std::string &name, std::vector<double> &samples, uint64_t operations) const;
+    bool WriteResult(const std::vector<ScoreBenchmarkResult> &results) const;
+
+public:
+    explicit ScoreBenchmark(const ScoreBenchmarkOptions &options);
+
+    bool Run();
+};
@@ -12,8 +12,10 @@ enum class NoteAttribute {
     HellChecking,
     Completed,
     Activated,
+    SoundScheduled,     // 判定音を先読みでBGMに混ぜ込み済み
 };
 
+enum class JudgeSoundType;
 class ScenePlayer;
 class ScoreProcessor {
 public:
@@ -25,7 +27,9 @@ public:
     virtual void Update(std::vector<std::shared_ptr<SusDrawableNoteData>> &notes) = 0;
     virtual void MovePosition(double relative) = 0;
     virtual void Draw() = 0;
-    virtual bool ShouldJudge(std::shared_ptr<SusDrawableNoteData> note) = 0;
+    virtual bool ShouldJudge(const std::shared_ptr<SusDrawableNoteData> &note) = 0;
+    // ShouldJudgeがtrueになりうるのはノーツの始点からこれだけ前 ～ 終点からこれだけ後ろまで
+    virtual double GetJudgeMargin() const = 0;
 };
 
 class PlayableProcessor : public ScoreProcessor {
@@ -66,7 +70,8 @@ public:
     void SetJudgeWidths(double jc, double j, double a);
     void SetJudgeAdjusts(double jas, double jms, double jaa, double jma) override;
     void Reset() override;
-    bool ShouldJudge(std::shared_ptr<SusDrawableNoteData> note) override;
+    bool ShouldJudge(const std::shared_ptr<SusDrawableNoteData> &note) override;
+    double GetJudgeMargin() const override;
     void Update(std::vector<std::shared_ptr<SusDrawableNoteData>> &notes) override;
     void MovePosition(double relative) override;
     void Draw() override;
@@ -78,16 +83,23 @@ protected:
     std::vector<std::shared_ptr<SusDrawableNoteData>> &data = DefaultDataValue;
     bool isInHold = false, isInSlide = false, isInAA = false;
     bool wasInHold = false, wasInSlide = false, wasInAA = false;
+    // 譜面中の判定音(曲内時刻, 種類, ノーツ) 時刻順
+    std::vector<std::tuple<double, JudgeSoundType, std::shared_ptr<SusDrawableNoteData>>> soundEvents;
+    size_t nextSoundEvent = 0;
 
     void ProcessScore(const std::shared_ptr<SusDrawableNoteData>& notes);
-    void IncrementCombo(const JudgeInformation &info, const std::string& extra) const;
+    void IncrementCombo(const std::shared_ptr<SusDrawableNoteData>& note, const JudgeInformation &info, const std::string& extra) const;
+    void BuildSoundEvents();
+    void ScheduleSounds();
+    void EnqueueNoteSound(const std::shared_ptr<SusDrawableNoteData>& note, JudgeSoundType type) const;
 
 public:
     AutoPlayerProcessor(ScenePlayer *player);
 
     void SetJudgeAdjusts(double jas, double jms, double jaa, double jma) override;
     void Reset() override;
-    bool ShouldJudge(std::shared_ptr<SusDrawableNoteData> note) override;
+    bool ShouldJudge(const std::shared_ptr<SusDrawableNoteData> &note) override;
+    double GetJudgeMargin() const override;
     void Update(std::vector<std::shared_ptr<SusDrawableNoteData>> &notes) override;
     void MovePosition(double relative) override;
     void Draw() override;
@@ -419,19 +419,18 @@ void SSoundMixer::Play(SSound *sound) const
     sound->Release();
 }
 
-// ReSharper disable once CppMemberFunctionMayBeStatic
 void SSoundMixer::Stop(SSound *sound) const
 {
     if (!sound) return;
 
-    SoundMixerStream::Stop(sound->sample);
+    mixer->Stop(sound->sample);
 
     sound->Release();
 }
 
 SSoundMixer * SSoundMixer::CreateMixer(SoundManager * manager)
 {
-    auto result = new SSoundMixer(SoundManager::CreateMixerStream());
+    auto result = new SSoundMixer(manager->CreateMixerStream());
     result->AddRef();
 
     BOOST_ASSERT(result->GetRefCount() == 1);
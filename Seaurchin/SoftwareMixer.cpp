@@ -0,0 +1,279 @@
+﻿#include "SoftwareMixer.h"
+#include "Misc.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define SU_MIXER_SSE
+#include <xmmintrin.h>
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+namespace
+{
+    const size_t maxVoices = 128;   // 超えたら古い単発の音から止める
+}
+
+// SoftwareMixer ------------------------
+SoftwareMixer::SoftwareMixer(const uint32_t frequency, const uint32_t bufferFrames)
+    : frequency(frequency), bufferFrames(max(bufferFrames, 16u))
+{
+    voices.reserve(maxVoices);
+}
+
+// 出力側で溜めている分 (Renderしてから実際に鳴るまで)
+void SoftwareMixer::SetOutputLatency(const double seconds)
+{
+    outputLatency = int64_t(seconds * 1e9);
+}
+
+// pcmはChannelsチャンネルのインターリーブ
+bool SoftwareMixer::Play(const uint32_t id, const MixerPcm &pcm, const double gain, const bool loop)
+{
+    if (!pcm || pcm->size() < Channels || pcm->size() % Channels) return false;
+    return Push({ CommandType::Play, id, pcm, SU_TO_FLOAT(gain), loop, {} });
+}
+
+void SoftwareMixer::Stop(const uint32_t id)
+{
+    Push({ CommandType::Stop, id, nullptr, 0, false, {} });
+}
+
+void SoftwareMixer::StopAll()
+{
+    Push({ CommandType::StopAll, 0, nullptr, 0, false, {} });
+}
+
+void SoftwareMixer::SetVolume(const double newVolume)
+{
+    Push({ CommandType::SetVolume, 0, nullptr, SU_TO_FLOAT(newVolume), false, {} });
+}
+
+bool SoftwareMixer::Push(Command &&command)
+{
+    command.Issued = steady_clock::now();
+    ++issuedCommands;
+    if (commands.push(command)) return true;
+    ++droppedCommands;
+    return false;
+}
+
+void SoftwareMixer::ProcessCommands()
+{
+    Command command;
+    while (commands.pop(command)) {
+        switch (command.Type) {
+            case CommandType::Play:
+                if (voices.size() >= maxVoices) {
+                    // ループ音(Hold・Slideなどの押している間の音)は止めると次に押し直すまで鳴らないので、単発の音から止める
+                    const auto oneShot = find_if(voices.begin(), voices.end(), [](const Voice &voice) { return !voice.Loop; });
+                    voices.erase(oneShot != voices.end() ? oneShot : voices.begin());
+                }
+                voices.push_back({ command.Id, move(command.Pcm), 0, command.Gain, command.Loop, false, command.Issued });
+                break;
+            case CommandType::Stop: {
+                const auto id = command.Id;
+                voices.erase(remove_if(voices.begin(), voices.end(), [id](const Voice &voice) { return voice.Id == id; }), voices.end());
+                break;
+            }
+            case CommandType::StopAll:
+                voices.clear();
+                break;
+            case CommandType::SetVolume:
+                volume = command.Gain;
+                break;
+        }
+    }
+}
+
+// 出力デバイスのスレッドから呼ばれる
+// 指示はバッファの先頭でまとめて反映するので、発音の遅れは最大でバッファ1つ分
+void SoftwareMixer::Render(float *output, const size_t frames)
+{
+    const auto begin = steady_clock::now();
+    ProcessCommands();
+
+    fill_n(output, frames * Channels, 0.0f);
+    const auto delay = outputLatency.load();
+    for (auto &voice : voices) {
+        if (!voice.Started) {
+            const auto wait = duration_cast<nanoseconds>(begin - voice.Issued).count() + delay;
+            latency += wait;
+            if (wait > latencyMax) latencyMax = wait;
+            ++startedVoices;
+            voice.Started = true;
+        }
+
+        const auto &pcm = *voice.Pcm;
+        auto written = size_t(0);
+        while (written < frames && voice.Position < pcm.size()) {
+            const auto count = min((frames - written) * Channels, pcm.size() - voice.Position);
+            MixSamples(output + written * Channels, pcm.data() + voice.Position, count, voice.Gain * volume);
+            voice.Position += count;
+            written += count / Channels;
+            if (voice.Loop && voice.Position >= pcm.size()) voice.Position = 0;
+        }
+    }
+    voices.erase(remove_if(voices.begin(), voices.end(), [](const Voice &voice) {
+        return voice.Position >= voice.Pcm->size();
+    }), voices.end());
+    activeVoices = uint32_t(voices.size());
+
+    const auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    renderTime += elapsed;
+    if (elapsed > renderTimeMax) renderTimeMax = elapsed;
+    renderedFrames += frames;
+    ++renderedBuffers;
+}
+
+// destination += source * gain
+void SoftwareMixer::MixSamples(float *destination, const float *source, const size_t count, const float gain)
+{
+    auto i = size_t(0);
+#ifdef SU_MIXER_SSE
+    const auto g = _mm_set1_ps(gain);
+    for (; i + 8 <= count; i += 8) {
+        const auto a = _mm_add_ps(_mm_loadu_ps(destination + i), _mm_mul_ps(_mm_loadu_ps(source + i), g));
+        const auto b = _mm_add_ps(_mm_loadu_ps(destination + i + 4), _mm_mul_ps(_mm_loadu_ps(source + i + 4), g));
+        _mm_storeu_ps(destination + i, a);
+        _mm_storeu_ps(destination + i + 4, b);
+    }
+#endif
+    for (; i < count; i++) destination[i] += source[i] * gain;
+}
+
+SoftwareMixerStatistics SoftwareMixer::GetStatistics() const
+{
+    SoftwareMixerStatistics result;
+    result.Buffers = renderedBuffers;
+    result.Frames = renderedFrames;
+    result.Commands = issuedCommands;
+    result.DroppedCommands = droppedCommands;
+    result.ActiveVoices = activeVoices;
+    if (result.Buffers) result.RenderTimeMean = renderTime / 1e9 / result.Buffers;
+    result.RenderTimeMax = renderTimeMax / 1e9;
+    const auto started = startedVoices.load();
+    if (started) result.LatencyMean = latency / 1e9 / started;
+    result.LatencyMax = latencyMax / 1e9;
+    return result;
+}
+
+// NullOutputDevice ------------------------
+NullOutputDevice::~NullOutputDevice()
+{
+    NullOutputDevice::Stop();
+}
+
+bool NullOutputDevice::Start(SoftwareMixer *mixer)
+{
+    if (!mixer || running) return false;
+    // 書いたバッファが鳴り終わるまでの1つ分だけ溜めている扱い
+    mixer->SetOutputLatency(double(mixer->GetBufferFrames()) / mixer->GetFrequency());
+    running = true;
+    renderThread = thread([this, mixer] { RenderLoop(mixer); });
+    return true;
+}
+
+void NullOutputDevice::Stop()
+{
+    running = false;
+    if (renderThread.joinable()) renderThread.join();
+}
+
+void NullOutputDevice::RenderLoop(SoftwareMixer *mixer)
+{
+#ifdef _WIN32
+    timeBeginPeriod(1);
+#endif
+    const auto frames = mixer->GetBufferFrames();
+    const auto period = duration_cast<steady_clock::duration>(duration<double>(double(frames) / mixer->GetFrequency()));
+    vector<float> buffer(frames * SoftwareMixer::Channels);
+    auto deadline = steady_clock::now();
+    while (running) {
+        mixer->Render(buffer.data(), frames);
+        Write(buffer.data(), frames);
+
+        deadline += period;
+        if (steady_clock::now() > deadline) {
+            // 締め切りに間に合わなかった分は取り戻さない
+            ++lateBuffers;
+            deadline = steady_clock::now();
+            continue;
+        }
+        while (running) {
+            const auto rest = deadline - steady_clock::now();
+            if (rest <= steady_clock::duration::zero()) break;
+            if (rest >= milliseconds(2)) {
+                this_thread::sleep_for(milliseconds(1));
+            } else {
+                this_thread::yield();
+            }
+        }
+    }
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
+
+// WaveFileOutputDevice ------------------------
+WaveFileOutputDevice::WaveFileOutputDevice(const boost::filesystem::path &path)
+    : file(path, ios::out | ios::binary | ios::trunc)
+{}
+
+WaveFileOutputDevice::~WaveFileOutputDevice()
+{
+    WaveFileOutputDevice::Stop();
+}
+
+bool WaveFileOutputDevice::Start(SoftwareMixer *mixer)
+{
+    if (!file || !mixer) return false;
+    frequency = mixer->GetFrequency();
+    writtenFrames = 0;
+    WriteHeader();
+    return NullOutputDevice::Start(mixer);
+}
+
+void WaveFileOutputDevice::Stop()
+{
+    NullOutputDevice::Stop();
+    if (!file.is_open()) return;
+    // 書いた長さで先頭を書き直す
+    WriteHeader();
+    file.close();
+}
+
+void WaveFileOutputDevice::Write(const float *data, const size_t frames)
+{
+    converted.resize(frames * SoftwareMixer::Channels);
+    for (size_t i = 0; i < converted.size(); i++) {
+        converted[i] = int16_t(boost::algorithm::clamp(data[i] * 32767.0f, -32768.0f, 32767.0f));
+    }
+    file.write(reinterpret_cast<const char*>(converted.data()), converted.size() * sizeof(int16_t));
+    writtenFrames += frames;
+}
+
+// 16bit PCMのRIFFヘッダ
+void WaveFileOutputDevice::WriteHeader()
+{
+    const auto channels = uint16_t(SoftwareMixer::Channels);
+    const auto dataBytes = uint32_t(min<uint64_t>(writtenFrames * channels * sizeof(int16_t), 0xFFFFFFFFu - 36));
+    const auto write16 = [this](const uint16_t value) { file.write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+    const auto write32 = [this](const uint32_t value) { file.write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+
+    const auto position = file.tellp();
+    file.seekp(0);
+    file.write("RIFF", 4);
+    write32(36 + dataBytes);
+    file.write("WAVEfmt ", 8);
+    write32(16);
+    write16(1);
+    write16(channels);
+    write32(frequency);
+    write32(frequency * channels * sizeof(int16_t));
+    write16(channels * sizeof(int16_t));
+    write16(16);
+    file.write("data", 4);
+    write32(dataBytes);
+    if (position > 44) file.seekp(position);
+}
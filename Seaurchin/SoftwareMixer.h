@@ -0,0 +1,140 @@
+﻿#pragma once
+
+// DxLibにもBASSにも依存しない効果音ミキサー
+// 鳴らす音はあらかじめfloatのPCM(ステレオ・ミキサーと同じ周波数)に展開しておき、
+// 再生・停止の指示はロックフリーのキューで出力スレッドに渡す
+// Play/Stop/SetVolumeは1つのスレッドから、Renderは出力デバイスのスレッドから呼ぶ
+typedef std::shared_ptr<const std::vector<float>> MixerPcm;
+
+struct SoftwareMixerStatistics final {
+    uint64_t Buffers = 0;           // Renderした回数
+    uint64_t Frames = 0;
+    uint64_t Commands = 0;
+    uint64_t DroppedCommands = 0;   // キューが溢れて捨てた指示
+    uint32_t ActiveVoices = 0;
+    double RenderTimeMean = 0;      // 1回のRenderにかかった秒数
+    double RenderTimeMax = 0;
+    double LatencyMean = 0;         // Playから最初のサンプルが出力に届くまでの秒数(出力側のバッファ分を含む)
+    double LatencyMax = 0;
+};
+
+class SoftwareMixer final {
+public:
+    static const uint32_t Channels = 2;
+
+private:
+    enum class CommandType {
+        Play,
+        Stop,
+        StopAll,
+        SetVolume,
+    };
+
+    struct Command {
+        CommandType Type;
+        uint32_t Id;
+        MixerPcm Pcm;
+        float Gain;
+        bool Loop;
+        std::chrono::steady_clock::time_point Issued;
+    };
+
+    struct Voice {
+        uint32_t Id;
+        MixerPcm Pcm;
+        size_t Position;            // Pcmで次に混ぜる位置
+        float Gain;
+        bool Loop;
+        bool Started;
+        std::chrono::steady_clock::time_point Issued;
+    };
+
+    uint32_t frequency;
+    uint32_t bufferFrames;
+    boost::lockfree::spsc_queue<Command, boost::lockfree::capacity<1024>> commands;
+    std::vector<Voice> voices;      // 出力スレッド専用
+    float volume = 1.0f;            // 出力スレッド専用
+
+    std::atomic<int64_t> outputLatency { 0 };   // ナノ秒
+    std::atomic<uint64_t> issuedCommands { 0 };
+    std::atomic<uint64_t> droppedCommands { 0 };
+    std::atomic<uint64_t> renderedBuffers { 0 };
+    std::atomic<uint64_t> renderedFrames { 0 };
+    std::atomic<int64_t> renderTime { 0 };
+    std::atomic<int64_t> renderTimeMax { 0 };
+    std::atomic<uint64_t> startedVoices { 0 };
+    std::atomic<int64_t> latency { 0 };
+    std::atomic<int64_t> latencyMax { 0 };
+    std::atomic<uint32_t> activeVoices { 0 };
+
+    bool Push(Command &&command);
+    void ProcessCommands();
+
+public:
+    SoftwareMixer(uint32_t frequency, uint32_t bufferFrames);
+
+    uint32_t GetFrequency() const { return frequency; }
+    uint32_t GetBufferFrames() const { return bufferFrames; }
+    void SetOutputLatency(double seconds);
+
+    bool Play(uint32_t id, const MixerPcm &pcm, double gain, bool loop);
+    void Stop(uint32_t id);
+    void StopAll();
+    void SetVolume(double newVolume);
+
+    void Render(float *output, size_t frames);
+    SoftwareMixerStatistics GetStatistics() const;
+
+    static void MixSamples(float *destination, const float *source, size_t count, float gain);
+};
+
+// SoftwareMixerからRenderで音を引き出す出力先
+class MixerOutputDevice {
+public:
+    virtual ~MixerOutputDevice() = default;
+
+    virtual bool Start(SoftwareMixer *mixer) = 0;
+    virtual void Stop() = 0;
+};
+
+// どこにも鳴らさずに、実時間と同じ間隔でRenderだけを呼び続ける
+// 音の出ない環境でミキサーの遅延と負荷を測るためのもの
+class NullOutputDevice : public MixerOutputDevice {
+private:
+    std::thread renderThread;
+    std::atomic<bool> running { false };
+    std::atomic<uint64_t> lateBuffers { 0 };
+
+    void RenderLoop(SoftwareMixer *mixer);
+
+protected:
+    virtual void Write(const float *, size_t) {}
+
+public:
+    ~NullOutputDevice() override;
+
+    bool Start(SoftwareMixer *mixer) override;
+    void Stop() override;
+    uint64_t GetLateBuffers() const { return lateBuffers; }   // 間に合わなかったバッファ数
+};
+
+// NullOutputDeviceと同じ間隔でRenderした結果を16bitのWAVファイルに書き出す
+class WaveFileOutputDevice final : public NullOutputDevice {
+private:
+    boost::filesystem::ofstream file;
+    uint32_t frequency = 0;
+    uint64_t writtenFrames = 0;
+    std::vector<int16_t> converted;
+
+    void WriteHeader();
+
+protected:
+    void Write(const float *data, size_t frames) override;
+
+public:
+    explicit WaveFileOutputDevice(const boost::filesystem::path &path);
+    ~WaveFileOutputDevice() override;
+
+    bool Start(SoftwareMixer *mixer) override;
+    void Stop() override;
+};
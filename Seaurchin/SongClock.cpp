@@ -0,0 +1,52 @@
+﻿#include "SongClock.h"
+
+using namespace std;
+
+namespace {
+    // ループの固有角周波数(rad/s) 約0.3Hzより速い揺らぎは追わない
+    const double clockNaturalFrequency = 2.0;
+    // これ以上ずれたら追従をやめて合わせ直す(シークや音切れ)
+    const double clockResyncThreshold = 0.1;
+    // ずれの平均・揺らぎを取るときの時定数(秒)
+    const double clockStatisticsPeriod = 2.0;
+    const double clockRateLimit = 0.05;
+}
+
+// シークなどで時刻を飛ばす 次のSynchronizeで合わせ直す
+void SongClock::Reset(const double newTime)
+{
+    time = lastTime = newTime;
+    locked = false;
+}
+
+void SongClock::Advance(const double delta)
+{
+    lastTime = time;
+    lastDelta = delta;
+    time += delta * rate;
+}
+
+// Advanceの後に呼ぶ
+void SongClock::Synchronize(const double sourceTime)
+{
+    const auto error = sourceTime - time;
+    if (!locked || fabs(error) > clockResyncThreshold) {
+        // 先に進みすぎていた場合はBGMが追いつくまで待つ
+        time = max(lastTime, sourceTime);
+        rate = 1.0;
+        drift = variance = 0;
+        locked = true;
+        return;
+    }
+
+    // 統計(指数移動平均)
+    const auto alpha = min(1.0, lastDelta / clockStatisticsPeriod);
+    drift += (error - drift) * alpha;
+    variance += ((error - drift) * (error - drift) - variance) * alpha;
+
+    // 位相は比例で、速度は積分で詰める(臨界制動)
+    const auto kp = min(1.0, 2.0 * clockNaturalFrequency * lastDelta);
+    const auto ki = clockNaturalFrequency * clockNaturalFrequency * lastDelta;
+    time = max(lastTime, time + error * kp);
+    rate = boost::algorithm::clamp(rate + error * ki, 1.0 - clockRateLimit, 1.0 + clockRateLimit);
+}
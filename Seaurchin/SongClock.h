@@ -0,0 +1,27 @@
+﻿#pragma once
+
+// BGMの再生位置に追従する曲内時刻
+// フレームの経過時間で進めつつ、BGMの再生位置とのずれを2次のPLLで少しずつ詰める
+// BGMの位置は更新の粒度が粗く揺らぐので、そのまま使わずに平滑化する
+// Resetしない限り時刻は巻き戻らない
+class SongClock final {
+private:
+    double time = 0;            // 曲内時刻
+    double rate = 1.0;          // 実時間1秒あたりに進める曲内時刻 (BGMの再生速度の推定)
+    double drift = 0;           // BGM時刻 - 曲内時刻 の平均
+    double variance = 0;        // 上の分散
+    bool locked = false;        // BGMに追従し始めていればtrue
+    double lastDelta = 0;
+    double lastTime = 0;
+
+public:
+    void Reset(double newTime);
+    void Advance(double delta);
+    void Synchronize(double sourceTime);
+
+    double GetTime() const { return time; }
+    double GetRate() const { return rate; }
+    double GetDrift() const { return drift; }
+    double GetJitter() const { return sqrt(variance); }
+    bool IsLocked() const { return locked; }
+};
@@ -6,7 +6,12 @@ using namespace boost::algorithm;
 using namespace boost::filesystem;
 
 // SoundSample ------------------------
+namespace {
+    atomic<uint32_t> nextSampleId { 1 };
+}
+
 SoundSample::SoundSample(const HSAMPLE sample)
+    : id(nextSampleId++)
 {
     Type = SoundType::Sample;
     hSample = sample;
@@ -55,6 +60,81 @@ void SoundSample::SetLoop(const bool looping) const
     BASS_SampleSetInfo(hSample, &info);
 }
 
+bool SoundSample::IsLooping() const
+{
+    BASS_SAMPLE info = { 0 };
+    BASS_SampleGetInfo(hSample, &info);
+    return (info.flags & BASS_SAMPLE_LOOP) != 0;
+}
+
+float SoundSample::GetVolume() const
+{
+    BASS_SAMPLE info = { 0 };
+    if (!BASS_SampleGetInfo(hSample, &info)) return 1.0f;
+    return info.volume;
+}
+
+// 混ぜ込み用にfloat・指定の周波数とチャンネル数に変換する
+// チャンネル数が違う場合は元のチャンネルを繰り返して割り当てる
+vector<float> SoundSample::Decode(const DWORD frequency, const DWORD channels) const
+{
+    BASS_SAMPLE info = { 0 };
+    if (!hSample || !BASS_SampleGetInfo(hSample, &info) || !info.chans || !info.freq || !frequency || !channels) return {};
+    vector<uint8_t> raw(info.length);
+    if (raw.empty() || !BASS_SampleGetData(hSample, raw.data())) return {};
+
+    const size_t width = (info.flags & BASS_SAMPLE_FLOAT) ? 4 : ((info.flags & BASS_SAMPLE_8BITS) ? 1 : 2);
+    const auto sourceFrames = info.length / (width * info.chans);
+    if (!sourceFrames) return {};
+    const auto read = [&](const size_t frame, const DWORD ch) {
+        const auto index = frame * info.chans + ch % info.chans;
+        switch (width) {
+            case 4:
+                return reinterpret_cast<const float*>(raw.data())[index];
+            case 1:
+                return (raw[index] - 128) / 128.0f;
+            default:
+                return reinterpret_cast<const int16_t*>(raw.data())[index] / 32768.0f;
+        }
+    };
+
+    // 線形補間で周波数を合わせる
+    const auto ratio = double(info.freq) / frequency;
+    const auto frames = size_t(sourceFrames / ratio);
+    vector<float> result(frames * channels);
+    for (size_t i = 0; i < frames; i++) {
+        const auto pos = i * ratio;
+        const auto index = min(size_t(pos), sourceFrames - 1);
+        const auto next = min(index + 1, sourceFrames - 1);
+        const auto t = SU_TO_FLOAT(pos - index);
+        for (DWORD c = 0; c < channels; c++) {
+            result[i * channels + c] = info.volume * ((1.0f - t) * read(index, c) + t * read(next, c));
+        }
+    }
+    return result;
+}
+
+// Decodeした結果をこのサンプルが消えるまで持っておく
+// 音量が変わっていたら展開し直す メインスレッドから呼ぶ
+MixerPcm SoundSample::GetDecoded(const DWORD frequency, const DWORD channels) const
+{
+    const auto volume = GetVolume();
+    auto decoded = find_if(decodedPcm.begin(), decodedPcm.end(), [&](const DecodedPcm &pcm) {
+        return pcm.Frequency == frequency && pcm.Channels == channels;
+    });
+    if (decoded != decodedPcm.end() && decoded->Volume == volume) return decoded->Pcm;
+
+    auto pcm = make_shared<const vector<float>>(Decode(frequency, channels));
+    if (pcm->empty()) return nullptr;
+    if (decoded == decodedPcm.end()) {
+        decodedPcm.push_back({ frequency, channels, volume, pcm });
+    } else {
+        decoded->Volume = volume;
+        decoded->Pcm = pcm;
+    }
+    return pcm;
+}
+
 // SoundStream ------------------------
 SoundStream::SoundStream(const HSTREAM stream)
 {
@@ -112,13 +192,107 @@ void SoundStream::SetPlayingPosition(const double pos) const
     BASS_ChannelSetPosition(hStream, bp, BASS_POS_BYTE);
 }
 
-// SoundMixerStream ------------------------
-SoundMixerStream::SoundMixerStream(const int ch, const int freq)
+// SoundScheduler ------------------------
+SoundScheduler::SoundScheduler(SoundStream *stream)
+{
+    hStream = stream ? stream->GetSoundHandle() : 0;
+    BASS_CHANNELINFO info = { 0 };
+    if (!hStream || !BASS_ChannelGetInfo(hStream, &info)) return;
+    // 8bitのストリームには混ぜない
+    if (info.flags & BASS_SAMPLE_8BITS) return;
+
+    frequency = info.freq;
+    channels = info.chans;
+    isFloat = !!(info.flags & BASS_SAMPLE_FLOAT);
+    length = int64_t(BASS_ChannelGetLength(hStream, BASS_POS_BYTE) / ((isFloat ? sizeof(float) : sizeof(int16_t)) * channels));
+    hDsp = BASS_ChannelSetDSP(hStream, ProcessDsp, this, 0);
+}
+
+SoundScheduler::~SoundScheduler()
+{
+    if (hDsp) BASS_ChannelRemoveDSP(hStream, hDsp);
+}
+
+// positionはストリーム上の秒数
+// 鳴らせない位置(ストリームの範囲外・すでにDSPを通り過ぎた)ならfalse
+bool SoundScheduler::Schedule(SoundSample *sample, const double position, const double gain)
+{
+    if (!hDsp || !sample || position < 0) return false;
+    const auto start = int64_t(position * frequency);
+    if (start >= length || start < processedPosition) return false;
+
+    auto pcm = sample->GetDecoded(frequency, channels);
+    if (!pcm) return false;
+    return incomingVoices.push({ pcm, start, 0, SU_TO_FLOAT(gain), generation });
+}
+
+// シークしたときなど、予約済みでまだ鳴り終わっていないものを全部取り消す
+void SoundScheduler::Clear()
+{
+    ++generation;
+    processedPosition = 0;
+}
+
+// これより先の分を予約しておけばDSPに間に合う(再生バッファの長さ+余裕)
+double SoundScheduler::GetLookahead() const
+{
+    return BASS_GetConfig(BASS_CONFIG_BUFFER) / 1000.0 + 0.25;
+}
+
+void CALLBACK SoundScheduler::ProcessDsp(HDSP handle, DWORD channel, void *buffer, const DWORD bytes, void *user)
+{
+    static_cast<SoundScheduler*>(user)->Mix(buffer, bytes);
+}
+
+void SoundScheduler::Mix(void *buffer, const DWORD bytes)
+{
+    const auto frameBytes = (isFloat ? sizeof(float) : sizeof(int16_t)) * channels;
+    const auto frames = int64_t(bytes / frameBytes);
+    // DSPが呼ばれた時点のデコード位置はバッファの末尾
+    const auto end = int64_t(BASS_ChannelGetPosition(hStream, BASS_POS_BYTE | BASS_POS_DECODE) / frameBytes);
+    const auto start = end - frames;
+
+    Voice incoming;
+    while (incomingVoices.pop(incoming)) activeVoices.push_back(move(incoming));
+
+    const auto currentGeneration = generation.load();
+    for (auto &voice : activeVoices) {
+        const auto &pcm = *voice.Pcm;
+        if (voice.Generation != currentGeneration) {
+            voice.Offset = pcm.size();
+            continue;
+        }
+        // 予約が間に合わなかったものはすぐ鳴らす
+        if (voice.Offset == 0 && voice.Start < start) voice.Start = start;
+        if (voice.Start >= end) continue;
+
+        const auto first = size_t(max<int64_t>(0, voice.Start - start));
+        const auto count = min(size_t(frames) * channels, first * channels + (pcm.size() - voice.Offset));
+        auto index = first * channels;
+        if (isFloat) {
+            const auto data = static_cast<float*>(buffer);
+            for (; index < count; index++) data[index] += pcm[voice.Offset++] * voice.Gain;
+        } else {
+            const auto data = static_cast<int16_t*>(buffer);
+            for (; index < count; index++) {
+                const auto value = data[index] + pcm[voice.Offset++] * voice.Gain * 32768.0f;
+                data[index] = int16_t(boost::algorithm::clamp(value, -32768.0f, 32767.0f));
+            }
+        }
+    }
+    activeVoices.erase(remove_if(activeVoices.begin(), activeVoices.end(), [](const Voice &voice) {
+        return voice.Offset >= voice.Pcm->size();
+    }), activeVoices.end());
+    processedPosition = end;
+}
+
+// BassMixerStream ------------------------
+BassMixerStream::BassMixerStream(const int ch, const int freq)
 {
     hMixerStream = BASS_Mixer_StreamCreate(freq, ch, 0);
 }
 
-SoundMixerStream::~SoundMixerStream()
+BassMixerStream::~BassMixerStream()
 {
     if (hMixerStream) {
         for (auto &ch : playingSounds) BASS_Mixer_ChannelRemove(ch);
@@ -127,7 +301,7 @@ SoundMixerStream::~SoundMixerStream()
     }
 }
 
-void SoundMixerStream::Update()
+void BassMixerStream::Update()
 {
     if (!hMixerStream) return;
 
@@ -143,7 +317,7 @@ void SoundMixerStream::Update()
     }
 }
 
-void SoundMixerStream::Play(Sound * sound)
+void BassMixerStream::Play(Sound * sound)
 {
     auto ch = sound->GetSoundHandle();
     playingSounds.emplace(ch);
@@ -151,25 +325,115 @@ void SoundMixerStream::Play(Sound * sound)
     BASS_ChannelPlay(ch, FALSE);
 }
 
-void SoundMixerStream::Stop(Sound *sound)
+void BassMixerStream::Stop(Sound *sound)
 {
     sound->StopSound();
     //チャンネル削除はUpdateに任せる
 }
 
-void SoundMixerStream::SetVolume(const double vol) const
+void BassMixerStream::SetVolume(const double vol)
 {
     BASS_ChannelSetAttribute(hMixerStream, BASS_ATTRIB_VOL, SU_TO_FLOAT(vol));
 }
 
+// BassOutputDevice ------------------------
+BassOutputDevice::~BassOutputDevice()
+{
+    BassOutputDevice::Stop();
+}
+
+bool BassOutputDevice::Start(SoftwareMixer *mixer)
+{
+    if (!mixer || hStream) return false;
+    hStream = BASS_StreamCreate(mixer->GetFrequency(), SoftwareMixer::Channels, BASS_SAMPLE_FLOAT, &BassOutputDevice::ProcessStream, mixer);
+    if (!hStream) return false;
+
+    // BASS側で先読みさせず、デバイスの更新ごとにバッファ単位で直接引き出させる
+    BASS_ChannelSetAttribute(hStream, BASS_ATTRIB_BUFFER, 0);
+    BASS_ChannelSetAttribute(hStream, BASS_ATTRIB_GRANULE, SU_TO_FLOAT(mixer->GetBufferFrames()));
+    // デバイスの遅延は正確には取れないので推奨バッファ長を目安にする
+    BASS_INFO info = { 0 };
+    const auto deviceLatency = BASS_GetInfo(&info) ? info.minbuf / 1000.0 : 0.0;
+    mixer->SetOutputLatency(double(mixer->GetBufferFrames()) / mixer->GetFrequency() + deviceLatency);
+    return BASS_ChannelPlay(hStream, FALSE) != FALSE;
+}
+
+void BassOutputDevice::Stop()
+{
+    if (!hStream) return;
+    BASS_StreamFree(hStream);
+    hStream = 0;
+}
+
+DWORD CALLBACK BassOutputDevice::ProcessStream(HSTREAM handle, void *buffer, const DWORD length, void *user)
+{
+    const auto mixer = static_cast<SoftwareMixer*>(user);
+    mixer->Render(static_cast<float*>(buffer), length / (sizeof(float) * SoftwareMixer::Channels));
+    return length;
+}
+
+// SoftwareMixerStream ------------------------
+SoftwareMixerStream::SoftwareMixerStream(const uint32_t frequency, const uint32_t bufferFrames)
+    : mixer(frequency, bufferFrames)
+    , streams(SoftwareMixer::Channels, frequency)
+{}
+
+SoftwareMixerStream::~SoftwareMixerStream()
+{
+    if (device) device->Stop();
+}
+
+bool SoftwareMixerStream::Open(unique_ptr<MixerOutputDevice> output)
+{
+    if (device || !output || !output->Start(&mixer)) return false;
+    device = move(output);
+    return true;
+}
+
+// 発音の終わったサンプルはRender側で片付くので、ストリームだけ片付ける
+void SoftwareMixerStream::Update()
+{
+    streams.Update();
+}
+
+void SoftwareMixerStream::SetVolume(const double vol)
+{
+    mixer.SetVolume(vol);
+    streams.SetVolume(vol);
+}
+
+void SoftwareMixerStream::Play(Sound *sound)
+{
+    if (sound->Type != SoundType::Sample) {
+        streams.Play(sound);
+        return;
+    }
+    const auto sample = static_cast<SoundSample*>(sound);
+    const auto pcm = sample->GetDecoded(mixer.GetFrequency(), SoftwareMixer::Channels);
+    if (pcm) mixer.Play(sample->GetId(), pcm, 1.0, sample->IsLooping());
+}
+
+void SoftwareMixerStream::Stop(Sound *sound)
+{
+    if (sound->Type != SoundType::Sample) {
+        streams.Stop(sound);
+        return;
+    }
+    mixer.Stop(static_cast<SoundSample*>(sound)->GetId());
+}
+
 // SoundManager -----------------------------
 SoundManager::SoundManager()
 {
     auto log = spdlog::get("main");
     //よろしくない
     if (!BASS_Init(-1, 44100, 0, GetMainWindowHandle(), nullptr)) {
-        log->critical(u8"BASS Libraryの初期化に失敗しました");
-        abort();
+        // 出力デバイスが無い環境(リプレイ実行など)では無音デバイスで続ける
+        if (!BASS_Init(0, 44100, 0, GetMainWindowHandle(), nullptr)) {
+            log->critical(u8"BASS Libraryの初期化に失敗しました");
+            abort();
+        }
+        log->warn(u8"出力デバイスを初期化できなかったため、無音で続行します");
     }
     spdlog::get("main")->info(u8"BASS Library初期化終了");
 }
@@ -179,9 +443,15 @@ SoundManager::~SoundManager()
     BASS_Free();
 }
 
-SoundMixerStream *SoundManager::CreateMixerStream()
+SoundMixerStream *SoundManager::CreateMixerStream() const
 {
-    return new SoundMixerStream(2, 44100);
+    if (mixerOptions.UseSoftwareMixer) {
+        auto result = new SoftwareMixerStream(44100, mixerOptions.BufferFrames);
+        if (result->Open(make_unique<BassOutputDevice>())) return result;
+        delete result;
+        spdlog::get("main")->warn(u8"ソフトウェアミキサーを開始できなかったため、BASSmixを利用します");
+    }
+    return new BassMixerStream(2, 44100);
 }
 
 void SoundManager::PlayGlobal(Sound *sound)
@@ -189,6 +459,16 @@ void SoundManager::PlayGlobal(Sound *sound)
     BASS_ChannelPlay(sound->GetSoundHandle(), FALSE);
 }
 
+// 元の音量にgainを掛けて鳴らす
+void SoundManager::PlayGlobal(Sound *sound, const double gain)
+{
+    const auto ch = sound->GetSoundHandle();
+    auto volume = 1.0f;
+    BASS_ChannelGetAttribute(ch, BASS_ATTRIB_VOL, &volume);
+    BASS_ChannelSetAttribute(ch, BASS_ATTRIB_VOL, SU_TO_FLOAT(volume * gain));
+    BASS_ChannelPlay(ch, FALSE);
+}
+
 void SoundManager::StopGlobal(Sound *sound)
 {
     sound->StopSound();
@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#include "SoftwareMixer.h"
+
 class SoundManager;
 
 enum class SoundType {
@@ -21,6 +23,17 @@ public:
 class SoundSample : public Sound {
     friend class SoundManager;
 
+private:
+    struct DecodedPcm {
+        DWORD Frequency;
+        DWORD Channels;
+        float Volume;               // 展開したときの音量
+        MixerPcm Pcm;
+    };
+
+    uint32_t id;
+    mutable std::vector<DecodedPcm> decodedPcm;     // 混ぜ込み用に展開したもの 形式ごとに1つ
+
 protected:
     HSAMPLE hSample;
 
@@ -34,6 +47,11 @@ public:
 
     static SoundSample *CreateFromFile(const std::wstring &fileNameW, int maxChannels = 16);
     void SetLoop(bool looping) const;
+    bool IsLooping() const;
+    float GetVolume() const;
+    std::vector<float> Decode(DWORD frequency, DWORD channels) const;
+    MixerPcm GetDecoded(DWORD frequency, DWORD channels) const;
+    uint32_t GetId() const { return id; }
 };
 
 class SoundStream : public Sound {
@@ -59,29 +77,118 @@ public:
     DWORD GetStatus() const { return BASS_ChannelIsActive(hStream); }
 };
 
+// ストリームの再生位置を基準に、効果音をサンプル単位の位置でそのストリームに混ぜ込む
+// 混ぜるのはストリームのDSPなので、フレームの刻みや発音の遅れに左右されない
+class SoundScheduler final {
+private:
+    struct Voice {
+        std::shared_ptr<const std::vector<float>> Pcm;  // ストリームと同じ周波数・チャンネル数に変換済み
+        int64_t Start;              // 鳴らし始めるストリーム上のサンプル位置
+        size_t Offset;              // Pcmで次に混ぜる位置
+        float Gain;
+        uint32_t Generation;
+    };
+
+    HSTREAM hStream;
+    HDSP hDsp = 0;
+    DWORD frequency = 0;
+    DWORD channels = 0;
+    bool isFloat = false;
+    int64_t length = 0;
+    boost::lockfree::spsc_queue<Voice, boost::lockfree::capacity<256>> incomingVoices;
+    std::vector<Voice> activeVoices;                // DSPスレッド専用
+    std::atomic<uint32_t> generation { 0 };
+    std::atomic<int64_t> processedPosition { 0 };   // DSPで処理し終わったサンプル位置
+
+    static void CALLBACK ProcessDsp(HDSP handle, DWORD channel, void *buffer, DWORD length, void *user);
+    void Mix(void *buffer, DWORD bytes);
+
+public:
+    explicit SoundScheduler(SoundStream *stream);
+    ~SoundScheduler();
+
+    bool Schedule(SoundSample *sample, double position, double gain);
+    void Clear();
+    double GetLookahead() const;
+};
+
+// スキンから使うミキサー 中身はSoundManager::CreateMixerStreamで選ぶ
 class SoundMixerStream {
-protected:
+public:
+    virtual ~SoundMixerStream() = default;
+
+    virtual void Update() = 0;
+    virtual void SetVolume(double vol) = 0;
+    virtual void Play(Sound *sound) = 0;
+    virtual void Stop(Sound *sound) = 0;
+};
+
+// BASSmixでまとめる
+class BassMixerStream final : public SoundMixerStream {
+private:
     HSTREAM hMixerStream;
     std::unordered_set<HCHANNEL> playingSounds;
 
 public:
-    SoundMixerStream(int ch, int freq);
-    ~SoundMixerStream();
+    BassMixerStream(int ch, int freq);
+    ~BassMixerStream() override;
+
+    void Update() override;
+    void SetVolume(double vol) override;
+    void Play(Sound *sound) override;
+    void Stop(Sound *sound) override;
+};
+
+// SoftwareMixerの出力をBASSのストリームとして鳴らす
+class BassOutputDevice final : public MixerOutputDevice {
+private:
+    HSTREAM hStream = 0;
+
+    static DWORD CALLBACK ProcessStream(HSTREAM handle, void *buffer, DWORD length, void *user);
+
+public:
+    ~BassOutputDevice() override;
+
+    bool Start(SoftwareMixer *mixer) override;
+    void Stop() override;
+};
+
+// 効果音をSoftwareMixerで混ぜる
+// サンプルは初めて鳴らすときに展開してSoundSample側に持たせる ストリームは展開せずに今まで通りBASSmixで混ぜる
+class SoftwareMixerStream final : public SoundMixerStream {
+private:
+    SoftwareMixer mixer;
+    BassMixerStream streams;        // サンプル以外 音量はmixerと揃える
+    std::unique_ptr<MixerOutputDevice> device;
+
+public:
+    SoftwareMixerStream(uint32_t frequency, uint32_t bufferFrames);
+    ~SoftwareMixerStream() override;
+
+    bool Open(std::unique_ptr<MixerOutputDevice> output);
+    void Update() override;
+    void SetVolume(double vol) override;
+    void Play(Sound *sound) override;
+    void Stop(Sound *sound) override;
+    SoftwareMixerStatistics GetStatistics() const { return mixer.GetStatistics(); }
+};
 
-    void Update();
-    void SetVolume(double vol) const;
-    void Play(Sound *sound);
-    static void Stop(Sound *sound);
+struct SoundMixerOptions final {
+    bool UseSoftwareMixer = false;
+    uint32_t BufferFrames = 256;
 };
 
 class SoundManager final {
 private:
+    SoundMixerOptions mixerOptions;
 
 public:
     SoundManager();
     ~SoundManager();
 
-    static SoundMixerStream *CreateMixerStream();
+    void SetMixerOptions(const SoundMixerOptions &options) { mixerOptions = options; }
+    SoundMixerStream *CreateMixerStream() const;
     static void PlayGlobal(Sound *sound);
+    static void PlayGlobal(Sound *sound, double gain);
     static void StopGlobal(Sound *sound);
 };
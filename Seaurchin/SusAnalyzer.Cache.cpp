@@ -0,0 +1,327 @@
+﻿#include "SusAnalyzer.h"
+#include "Misc.h"
+
+using namespace std;
+
+// 解析済み譜面(.susc)の読み書き
+// RenderScoreDataの結果とプレイ中に使う解析情報(メタデータ、テンポマップ、タイムライン)を書き出しておく
+// 数値はメモリ上の表現そのままなので、SU_SUS_ANALYZER_VERSIONが違うものは読まない
+
+namespace {
+
+struct SusCompiledHeader {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t SourceHash;
+    uint32_t BodySize;
+};
+
+const uint32_t susCompiledMagic = 0x43535553; // "SUSC"
+
+}
+
+uint32_t SusAnalyzer::CalculateFileHash(const wstring &fileName)
+{
+    const MappedFile file(fileName);
+    boost::crc_32_type crc;
+    crc.process_bytes(file.GetData(), file.GetSize());
+    return crc.checksum();
+}
+
+bool SusAnalyzer::LoadCompiledScore(const wstring &cacheFileName, const uint32_t sourceHash, DrawableNotesList &data, SusCurveBuffer &curveData)
+{
+    const MappedFile file(cacheFileName);
+    if (file.GetSize() < sizeof(SusCompiledHeader)) return false;
+
+    SusCompiledHeader header;
+    memcpy(&header, file.GetData(), sizeof(SusCompiledHeader));
+    if (header.Magic != susCompiledMagic) return false;
+    if (header.Version != SU_SUS_ANALYZER_VERSION) return false;
+    if (header.SourceHash != sourceHash) return false;
+    if (header.BodySize != file.GetSize() - sizeof(SusCompiledHeader)) return false;
+
+    // 途中で壊れていたら読みかけの状態を捨てる
+    Reset();
+    const auto fail = [this] {
+        Reset();
+        return false;
+    };
+    BinaryBufferReader reader(file.GetData() + sizeof(SusCompiledHeader), header.BodySize);
+
+    // メタデータ
+    SharedMetaData.UTitle = reader.ReadString();
+    SharedMetaData.USubTitle = reader.ReadString();
+    SharedMetaData.UArtist = reader.ReadString();
+    SharedMetaData.UJacketFileName = reader.ReadString();
+    SharedMetaData.UDesigner = reader.ReadString();
+    SharedMetaData.USongId = reader.ReadString();
+    SharedMetaData.UWaveFileName = reader.ReadString();
+    SharedMetaData.UBackgroundFileName = reader.ReadString();
+    SharedMetaData.UMovieFileName = reader.ReadString();
+    SharedMetaData.UExtraDifficulty = reader.ReadString();
+    SharedMetaData.WaveOffset = reader.Read<double>();
+    SharedMetaData.MovieOffset = reader.Read<double>();
+    SharedMetaData.BaseBpm = reader.Read<double>();
+    SharedMetaData.ShowBpm = reader.Read<double>();
+    SharedMetaData.ScoreDuration = reader.Read<double>();
+    SharedMetaData.SegmentsPerSecond = reader.Read<int32_t>();
+    SharedMetaData.Level = reader.Read<uint32_t>();
+    SharedMetaData.DifficultyType = reader.Read<uint32_t>();
+    SharedMetaData.ExtraFlags = reader.Read<uint32_t>();
+
+    // テンポ
+    ticksPerBeat = reader.Read<uint32_t>();
+    beatsDefinitions.clear();
+    const auto beatsCount = reader.ReadCount(sizeof(uint32_t) + sizeof(float));
+    for (auto i = 0u; i < beatsCount && !reader.IsFailed(); i++) {
+        const auto measure = reader.Read<uint32_t>();
+        beatsDefinitions[measure] = reader.Read<float>();
+    }
+    const auto segmentCount = reader.ReadCount(sizeof(uint32_t) * 2 + sizeof(double) * 2);
+    for (auto i = 0u; i < segmentCount && !reader.IsFailed(); i++) {
+        SusTempoSegment segment;
+        segment.Time.Measure = reader.Read<uint32_t>();
+        segment.Time.Tick = reader.Read<uint32_t>();
+        segment.AbsoluteTime = reader.Read<double>();
+        segment.Bpm = reader.Read<double>();
+        tempoSegments.push_back(segment);
+    }
+    const auto measureCount = reader.ReadCount(sizeof(float));
+    for (auto i = 0u; i < measureCount && !reader.IsFailed(); i++) measureTicks.push_back(reader.Read<float>());
+    const auto bpmChangeCount = reader.ReadCount(sizeof(double) * 2);
+    for (auto i = 0u; i < bpmChangeCount && !reader.IsFailed(); i++) {
+        const auto time = reader.Read<double>();
+        SharedBpmChanges.emplace_back(time, reader.Read<double>());
+    }
+
+    // タイムライン
+    vector<shared_ptr<SusHispeedTimeline>> timelines;
+    const auto timelineCount = reader.ReadCount(sizeof(uint32_t));
+    for (auto i = 0u; i < timelineCount && !reader.IsFailed(); i++) {
+        auto timeline = make_shared<SusHispeedTimeline>([&](const uint32_t m, const uint32_t t) { return GetAbsoluteTime(m, t); });
+        timeline->keys.clear();
+        const auto keyCount = reader.ReadCount(sizeof(double) * 3 + sizeof(int32_t));
+        if (!keyCount) return fail();
+        for (auto j = 0u; j < keyCount && !reader.IsFailed(); j++) {
+            const auto time = reader.Read<double>();
+            const auto sum = reader.Read<double>();
+            const auto visibility = SusHispeedData::Visibility(reader.Read<int32_t>());
+            const auto speed = reader.Read<double>();
+            timeline->data.emplace_back(time, sum, SusHispeedData(visibility, speed));
+        }
+        timeline->CalculateMinSums();
+        timelines.push_back(timeline);
+    }
+    const auto resolveTimeline = [&](const int32_t index) -> shared_ptr<SusHispeedTimeline> {
+        if (index < 0 || SU_TO_UINT32(index) >= timelines.size()) return nullptr;
+        return timelines[index];
+    };
+
+    // アトリビュート
+    vector<shared_ptr<SusNoteExtraAttribute>> attributes;
+    const auto attributeCount = reader.ReadCount(sizeof(uint32_t) * 3 + sizeof(double));
+    for (auto i = 0u; i < attributeCount && !reader.IsFailed(); i++) {
+        auto attribute = make_shared<SusNoteExtraAttribute>();
+        attribute->Priority = reader.Read<uint32_t>();
+        attribute->RollHispeedNumber = reader.Read<int32_t>();
+        attribute->RollTimeline = resolveTimeline(reader.Read<int32_t>());
+        attribute->HeightScale = reader.Read<double>();
+        attributes.push_back(attribute);
+    }
+
+    // ノーツ(ExtraDataも含めた通し番号で並んでいる)
+    vector<shared_ptr<SusDrawableNoteData>> elements;
+    vector<vector<uint32_t>> extraIndices;
+    const auto elementCount = reader.ReadCount(sizeof(uint32_t));
+    for (auto i = 0u; i < elementCount && !reader.IsFailed(); i++) {
+        auto note = make_shared<SusDrawableNoteData>();
+        note->Type = reader.Read<uint32_t>();
+        note->Timeline = resolveTimeline(reader.Read<int32_t>());
+        const auto attribute = reader.Read<int32_t>();
+        if (attribute >= 0 && SU_TO_UINT32(attribute) < attributes.size()) note->ExtraAttribute = attributes[attribute];
+        note->StartLane = reader.Read<float>();
+        note->Length = reader.Read<float>();
+        note->CenterAtZero = reader.Read<float>();
+        note->StartTimeEx = reader.Read<double>();
+        note->StartTime = reader.Read<double>();
+        note->Duration = reader.Read<double>();
+        note->CurveOffset = reader.Read<uint32_t>();
+        note->CurveCount = reader.Read<uint32_t>();
+        vector<uint32_t> extras(reader.ReadCount(sizeof(uint32_t)));
+        for (auto &extra : extras) extra = reader.Read<uint32_t>();
+        elements.push_back(note);
+        extraIndices.push_back(move(extras));
+    }
+    for (auto i = 0u; i < elements.size(); i++) {
+        for (const auto extra : extraIndices[i]) {
+            if (extra >= elements.size()) return fail();
+            elements[i]->ExtraData.push_back(elements[extra]);
+        }
+    }
+
+    DrawableNotesList loadedData;
+    const auto noteCount = reader.ReadCount(sizeof(uint32_t));
+    for (auto i = 0u; i < noteCount && !reader.IsFailed(); i++) {
+        const auto index = reader.Read<uint32_t>();
+        if (index >= elements.size() || !elements[index]->Timeline) return fail();
+        loadedData.push_back(elements[index]);
+    }
+
+    SusCurveBuffer loadedCurves;
+    auto &points = loadedCurves.GetPoints();
+    points.resize(reader.ReadCount(sizeof(double) * 2));
+    for (auto &point : points) {
+        const auto time = reader.Read<double>();
+        point = make_tuple(time, reader.Read<double>());
+    }
+    for (const auto &note : elements) {
+        if (uint64_t(note->CurveOffset) + note->CurveCount > points.size()) return fail();
+    }
+
+    if (reader.IsFailed() || !reader.IsEnd()) return fail();
+    data.swap(loadedData);
+    swap(curveData, loadedCurves);
+    spdlog::get("main")->info(u8"解析済みの譜面データを読み込みました。");
+    return true;
+}
+
+void SusAnalyzer::SaveCompiledScore(const wstring &cacheFileName, const uint32_t sourceHash, const DrawableNotesList &data, const SusCurveBuffer &curveData) const
+{
+    // 参照されているタイムライン、アトリビュート、ノーツに通し番号を振る
+    vector<SusHispeedTimeline*> timelines;
+    unordered_map<SusHispeedTimeline*, int32_t> timelineIndices = { { nullptr, -1 } };
+    vector<SusNoteExtraAttribute*> attributes;
+    unordered_map<SusNoteExtraAttribute*, int32_t> attributeIndices = { { nullptr, -1 } };
+    vector<SusDrawableNoteData*> elements;
+    unordered_map<SusDrawableNoteData*, uint32_t> elementIndices;
+
+    const auto registerTimeline = [&](SusHispeedTimeline *timeline) {
+        if (timelineIndices.find(timeline) != timelineIndices.end()) return;
+        timelineIndices[timeline] = SU_TO_INT32(timelines.size());
+        timelines.push_back(timeline);
+    };
+    const auto registerElement = [&](SusDrawableNoteData *note) {
+        elementIndices[note] = SU_TO_UINT32(elements.size());
+        elements.push_back(note);
+        registerTimeline(note->Timeline.get());
+        const auto attribute = note->ExtraAttribute.get();
+        if (attributeIndices.find(attribute) != attributeIndices.end()) return;
+        attributeIndices[attribute] = SU_TO_INT32(attributes.size());
+        attributes.push_back(attribute);
+        registerTimeline(attribute->RollTimeline.get());
+    };
+    for (const auto &note : data) {
+        registerElement(note.get());
+        for (const auto &extra : note->ExtraData) registerElement(extra.get());
+    }
+
+    BinaryBufferWriter writer;
+
+    // メタデータ
+    writer.WriteString(SharedMetaData.UTitle);
+    writer.WriteString(SharedMetaData.USubTitle);
+    writer.WriteString(SharedMetaData.UArtist);
+    writer.WriteString(SharedMetaData.UJacketFileName);
+    writer.WriteString(SharedMetaData.UDesigner);
+    writer.WriteString(SharedMetaData.USongId);
+    writer.WriteString(SharedMetaData.UWaveFileName);
+    writer.WriteString(SharedMetaData.UBackgroundFileName);
+    writer.WriteString(SharedMetaData.UMovieFileName);
+    writer.WriteString(SharedMetaData.UExtraDifficulty);
+    writer.Write(SharedMetaData.WaveOffset);
+    writer.Write(SharedMetaData.MovieOffset);
+    writer.Write(SharedMetaData.BaseBpm);
+    writer.Write(SharedMetaData.ShowBpm);
+    writer.Write(SharedMetaData.ScoreDuration);
+    writer.Write(SU_TO_INT32(SharedMetaData.SegmentsPerSecond));
+    writer.Write(SharedMetaData.Level);
+    writer.Write(SharedMetaData.DifficultyType);
+    writer.Write(SU_TO_UINT32(SharedMetaData.ExtraFlags.to_ulong()));
+
+    // テンポ
+    writer.Write(ticksPerBeat);
+    writer.Write(SU_TO_UINT32(beatsDefinitions.size()));
+    for (const auto &beats : beatsDefinitions) {
+        writer.Write(beats.first);
+        writer.Write(beats.second);
+    }
+    writer.Write(SU_TO_UINT32(tempoSegments.size()));
+    for (const auto &segment : tempoSegments) {
+        writer.Write(segment.Time.Measure);
+        writer.Write(segment.Time.Tick);
+        writer.Write(segment.AbsoluteTime);
+        writer.Write(segment.Bpm);
+    }
+    writer.Write(SU_TO_UINT32(measureTicks.size()));
+    for (const auto ticks : measureTicks) writer.Write(ticks);
+    writer.Write(SU_TO_UINT32(SharedBpmChanges.size()));
+    for (const auto &bpm : SharedBpmChanges) {
+        writer.Write(get<0>(bpm));
+        writer.Write(get<1>(bpm));
+    }
+
+    // タイムライン
+    writer.Write(SU_TO_UINT32(timelines.size()));
+    for (const auto timeline : timelines) {
+        writer.Write(SU_TO_UINT32(timeline->data.size()));
+        for (const auto &key : timeline->data) {
+            writer.Write(get<0>(key));
+            writer.Write(get<1>(key));
+            writer.Write(SU_TO_INT32(get<2>(key).VisibilityState));
+            writer.Write(get<2>(key).Speed);
+        }
+    }
+
+    // アトリビュート
+    writer.Write(SU_TO_UINT32(attributes.size()));
+    for (const auto attribute : attributes) {
+        writer.Write(attribute->Priority);
+        writer.Write(attribute->RollHispeedNumber);
+        writer.Write(timelineIndices[attribute->RollTimeline.get()]);
+        writer.Write(attribute->HeightScale);
+    }
+
+    // ノーツ
+    writer.Write(SU_TO_UINT32(elements.size()));
+    for (const auto note : elements) {
+        writer.Write(SU_TO_UINT32(note->Type.to_ulong()));
+        writer.Write(timelineIndices[note->Timeline.get()]);
+        writer.Write(attributeIndices[note->ExtraAttribute.get()]);
+        writer.Write(note->StartLane);
+        writer.Write(note->Length);
+        writer.Write(note->CenterAtZero);
+        writer.Write(note->StartTimeEx);
+        writer.Write(note->StartTime);
+        writer.Write(note->Duration);
+        writer.Write(note->CurveOffset);
+        writer.Write(note->CurveCount);
+        writer.Write(SU_TO_UINT32(note->ExtraData.size()));
+        for (const auto &extra : note->ExtraData) writer.Write(elementIndices[extra.get()]);
+    }
+    writer.Write(SU_TO_UINT32(data.size()));
+    for (const auto &note : data) writer.Write(elementIndices[note.get()]);
+
+    // 曲線は各ノーツがCurveOffset/CurveCountで指しているのでバッファごと
+    writer.Write(curveData.GetSize());
+    for (const auto &point : curveData.GetPoints()) {
+        writer.Write(get<0>(point));
+        writer.Write(get<1>(point));
+    }
+
+    const auto &body = writer.GetBuffer();
+    SusCompiledHeader header;
+    header.Magic = susCompiledMagic;
+    header.Version = SU_SUS_ANALYZER_VERSION;
+    header.SourceHash = sourceHash;
+    header.BodySize = SU_TO_UINT32(body.size());
+
+    boost::system::error_code ec;
+    create_directories(boost::filesystem::path(cacheFileName).parent_path(), ec);
+    boost::filesystem::ofstream file(boost::filesystem::path(cacheFileName), ios::out | ios::binary | ios::trunc);
+    if (!file) {
+        spdlog::get("main")->warn(u8"解析済みの譜面データを書き出せませんでした。");
+        return;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(SusCompiledHeader));
+    file.write(body.data(), body.size());
+}
@@ -2,21 +2,94 @@
 #include <utility>
 #include "Misc.h"
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SU_CURVE_USE_SSE2
+#endif
+
 using namespace std;
 using namespace crc32_constexpr;
 namespace b = boost;
 namespace ba = boost::algorithm;
 namespace xp = boost::xpressive;
 
-xp::sregex SusAnalyzer::regexSusCommand = "#" >> (xp::s1 = +xp::alnum) >> !(+xp::space >> (xp::s2 = +(~xp::_n)));
-xp::sregex SusAnalyzer::regexSusData = "#" >> (xp::s1 = xp::repeat<3, 3>(xp::alnum)) >> (xp::s2 = xp::repeat<2, 3>(xp::alnum)) >> ":" >> *xp::space >> (xp::s3 = +(~xp::_n));
-
-static xp::sregex allNumeric = xp::bos >> +(xp::digit) >> xp::eos;
+// glm::mixと同じ計算 (ポータブルビルドではglmを使わない)
+template<typename T, typename U>
+static T mixLinear(const T x, const T y, const U a)
+{
+    return static_cast<T>(static_cast<U>(x) * (static_cast<U>(1) - a) + static_cast<U>(y) * a);
+}
 
 auto toUpper = [](const char c) {
     return (c >= 'a' && c <= 'z') ? char(c - 0x20) : c;
 };
 
+static auto isAlnum = [](const char c) {
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+};
+
+static auto isSpace = [](const char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+};
+
+static auto isAllNumeric = [](const b::string_view input) {
+    return !input.empty() && all_of(input.begin(), input.end(), [](const char c) { return c >= '0' && c <= '9'; });
+};
+
+// 大文字化しながらCRC32を計算する(コマンド名のswitch用)
+static auto crc32Upper = [](const b::string_view input) {
+    auto crc = 0xFFFFFFFFu;
+    for (const auto c : input) crc = crc32Table[static_cast<unsigned char>(crc) ^ static_cast<unsigned char>(toUpper(c))] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+};
+
+// SUS有効行の字句解析
+// 行バッファを指すstring_viewに切り分けるだけで、規則は以前の正規表現と同じ
+//   コマンド: "#" >> (s1 = +alnum) >> !(+space >> (s2 = +(~_n)))
+//   データ:   "#" >> (s1 = repeat<3, 3>(alnum)) >> (s2 = repeat<2, 3>(alnum)) >> ":" >> *space >> (s3 = +(~_n))
+
+// 空白minSpaces個以上の後ろに続く値を切り出す
+// 空白しかない場合は最後の1文字が値になる(正規表現のバックトラックと同じ)
+static auto tokenizeSusValue = [](const b::string_view rest, const size_t minSpaces, b::string_view &value) {
+    auto pos = size_t(0);
+    while (pos < rest.size() && isSpace(rest[pos])) ++pos;
+    if (pos < minSpaces) return false;
+    if (pos < rest.size()) {
+        value = rest.substr(pos);
+        return true;
+    }
+    if (rest.size() <= minSpaces) return false;
+    value = rest.substr(rest.size() - 1);
+    return true;
+};
+
+bool TokenizeSusCommand(const b::string_view line, b::string_view &name, b::string_view &value)
+{
+    if (line.empty() || line[0] != '#') return false;
+    auto pos = size_t(1);
+    while (pos < line.size() && isAlnum(line[pos])) ++pos;
+    if (pos == 1) return false;
+
+    name = line.substr(1, pos - 1);
+    value = b::string_view();
+    return pos == line.size() || tokenizeSusValue(line.substr(pos), 1, value);
+}
+
+bool TokenizeSusData(const b::string_view line, b::string_view &meas, b::string_view &lane, b::string_view &pattern)
+{
+    if (line.size() < 7 || line[0] != '#') return false;
+    for (auto i = 1; i < 6; ++i) if (!isAlnum(line[i])) return false;
+
+    auto colon = size_t(6);
+    if (line[6] != ':') {
+        if (!isAlnum(line[6]) || line.size() < 8 || line[7] != ':') return false;
+        colon = 7;
+    }
+    meas = line.substr(1, 3);
+    lane = line.substr(4, colon - 4);
+    return tokenizeSusValue(line.substr(colon + 1), 0, pattern);
+}
+
 static auto convertRawString = [](const string &input) -> string {
     // TIL: ASCII文字範囲ではUTF-8と本来のASCIIを間違うことはない
     if (ba::starts_with(input, "\"")) {
@@ -65,6 +138,16 @@ static auto convertRawString = [](const string &input) -> string {
     return input;
 };
 
+// ロングノーツの種類とチャンネル(Extra)をまとめたキー
+static auto makeChannelKey = [](const SusNoteType type, const uint32_t channel) -> uint64_t {
+    return (uint64_t(channel) << 32) | uint64_t(type);
+};
+
+// 時刻と位置をまとめたキー(小節とtickはそれぞれ24bitに収まる前提)
+static auto makePositionKey = [](const SusRelativeNoteTime &time, const uint16_t position) -> uint64_t {
+    return (uint64_t(time.Measure) << 40) | (uint64_t(time.Tick & 0xFFFFFF) << 16) | position;
+};
+
 SusAnalyzer::SusAnalyzer(const uint32_t tpb)
     : timelineResolver([=](const uint32_t number) { return hispeedDefinitions[number]; })
     , ticksPerBeat(tpb)
@@ -99,6 +182,8 @@ void SusAnalyzer::Reset()
     extraAttributes.clear();
 
     bpmChanges.clear();
+    tempoSegments.clear();
+    measureTicks.clear();
 
     SharedMetaData.Reset();
     SharedBpmChanges.clear();
@@ -124,38 +209,50 @@ void SusAnalyzer::SetMessageCallBack(const function<void(string, string)>& func)
     errorCallbacks.push_back(func);
 }
 
+void SusAnalyzer::SetMetaDataScanRule(const SusMetaDataScanRule rule)
+{
+    metaDataScanRule = rule;
+}
+
 //一応UTF-8として処理することにしますがどうせ変わらないだろうなぁ
 //あと列挙済みファイルを流し込む前提でエラーチェックしない
 void SusAnalyzer::LoadFromFile(const wstring &fileName, const bool analyzeOnlyMetaData)
 {
     auto log = spdlog::get("main");
-    ifstream file;
-    string rawline;
-    xp::smatch match;
+    b::string_view name, value, meas, lane, pattern;
     uint32_t line = 0;
 
     Reset();
     if (!analyzeOnlyMetaData) log->info(u8"{0}の解析を開始…", ConvertUnicodeToUTF8(fileName));
 
-    file.open(fileName, ios::in);
-
-    char bom[3] = { 0 };
-    file.read(bom, 3);
-    if (file.gcount() != 3 || bom[0] != char(0xEF) || bom[1] != char(0xBB) || bom[2] != char(0xBF)) file.seekg(0);
-
-    while (getline(file, rawline)) {
+    // ファイル全体をマップして行ごとにその場で切り出す
+    const MappedFile file(fileName);
+    auto cursor = file.GetData();
+    const auto end = cursor + file.GetSize();
+    if (end - cursor >= 3 && cursor[0] == char(0xEF) && cursor[1] == char(0xBB) && cursor[2] == char(0xBF)) cursor += 3;
+
+    while (cursor < end) {
+        const auto eol = static_cast<const char*>(memchr(cursor, '\n', end - cursor));
+        b::string_view rawline(cursor, (eol ? eol : end) - cursor);
+        cursor = eol ? eol + 1 : end;
+        // CRLFのCRはテキストモードで読んでいたときと同じく落とす
+        if (!rawline.empty() && rawline.back() == '\r') rawline.remove_suffix(1);
         ++line;
         if (rawline.empty() || rawline[0] != '#') continue;
 
-        if (xp::regex_match(rawline, match, regexSusCommand)) {
-            ProcessCommand(match, analyzeOnlyMetaData, line);
-        } else if (xp::regex_match(rawline, match, regexSusData)) {
-            if (!analyzeOnlyMetaData || boost::starts_with(rawline, "#BPM")) ProcessData(match, line);
+        if (TokenizeSusCommand(rawline, name, value)) {
+            ProcessCommand(name, value, analyzeOnlyMetaData, line);
+        } else if (TokenizeSusData(rawline, meas, lane, pattern)) {
+            if (!analyzeOnlyMetaData || boost::starts_with(rawline, "#BPM")) {
+                ProcessData(meas, lane, pattern, line);
+            } else if (metaDataScanRule == SusMetaDataScanRule::UntilNoteData && isAllNumeric(meas)) {
+                // ヘッダ部分は読み終わったとみなす
+                break;
+            }
         } else {
             MakeMessage(line, u8"SUS有効行ですが解析できませんでした。");
         }
     }
-    file.close();
 
     if (!analyzeOnlyMetaData) log->info(u8"…終了");
     if (!analyzeOnlyMetaData) {
@@ -189,6 +286,7 @@ void SusAnalyzer::LoadFromFile(const wstring &fileName, const bool analyzeOnlyMe
             noteData.DefinitionNumber = 1; // リセット時にbpmDefinitions[1]が設定されていることより、1は必ず有効であると仮定している。(0 basedじゃないのはなぜ?)
             bpmChanges.emplace_back(time, noteData);
         }
+        BuildTempoMap(lastMeasure + 1);
 
         for (auto &hs : hispeedDefinitions) hs.second->Finialize();
         if (SharedMetaData.BaseBpm == 0) SharedMetaData.BaseBpm = GetBpmAt(0, 0);
@@ -201,26 +299,25 @@ void SusAnalyzer::LoadFromFile(const wstring &fileName, const bool analyzeOnlyMe
     }
 }
 
-void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta, const uint32_t line)
+void SusAnalyzer::ProcessCommand(const b::string_view name, const b::string_view value, const bool onlyMeta, const uint32_t line)
 {
-    auto name = result[1].str();
-    transform(name.cbegin(), name.cend(), name.begin(), toUpper);
-    switch (Crc32Rec(0xffffffff, name.c_str())) {
+    const auto param = value.to_string();
+    switch (crc32Upper(name)) {
         case "TITLE"_crc32:
-            SharedMetaData.UTitle = convertRawString(result[2]);
+            SharedMetaData.UTitle = convertRawString(param);
             break;
         case "SUBTITLE"_crc32:
-            SharedMetaData.USubTitle = convertRawString(result[2]);
+            SharedMetaData.USubTitle = convertRawString(param);
             break;
         case "ARTIST"_crc32:
-            SharedMetaData.UArtist = convertRawString(result[2]);
+            SharedMetaData.UArtist = convertRawString(param);
             break;
         case "GENRE"_crc32:
-            // SharedMetaData.UGenre = ConvertRawString(result[2]);
+            // SharedMetaData.UGenre = ConvertRawString(param);
             break;
         case "DESIGNER"_crc32:
         case "SUBARTIST"_crc32:  // BMS互換
-            SharedMetaData.UDesigner = convertRawString(result[2]);
+            SharedMetaData.UDesigner = convertRawString(param);
             break;
         case "PLAYLEVEL"_crc32: {
             if (SharedMetaData.DifficultyType == 4) {
@@ -228,7 +325,7 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
                 break;
             }
 
-            string lstr = result[2];
+            const auto &lstr = param;
             const auto pluspos = lstr.find('+');
             if (pluspos != string::npos) {
                 SharedMetaData.UExtraDifficulty = u8"+";
@@ -240,9 +337,9 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
             break;
         }
         case "DIFFICULTY"_crc32: {
-            if (xp::regex_match(result[2], allNumeric)) {
+            if (isAllNumeric(param)) {
                 //通常記法
-                const auto difficultyType = ConvertInteger(result[2]);
+                const auto difficultyType = ConvertInteger(param);
                 if (difficultyType < 0 || 3 < difficultyType) {
                     MakeMessage(line, u8"不明な難易度指定です。");
                     break;
@@ -258,7 +355,7 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
                 SharedMetaData.DifficultyType = difficultyType;
             } else {
                 //WE記法
-                auto dd = convertRawString(result[2]);
+                auto dd = convertRawString(param);
                 vector<string> params;
                 ba::split(params, dd, ba::is_any_of(":"));
                 if (params.size() < 2) {
@@ -272,37 +369,37 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
             break;
         }
         case "SONGID"_crc32:
-            SharedMetaData.USongId = convertRawString(result[2]);
+            SharedMetaData.USongId = convertRawString(param);
             break;
         case "WAVE"_crc32:
-            SharedMetaData.UWaveFileName = convertRawString(result[2]);
+            SharedMetaData.UWaveFileName = convertRawString(param);
             break;
         case "WAVEOFFSET"_crc32:
-            SharedMetaData.WaveOffset = ConvertFloat(result[2]);
+            SharedMetaData.WaveOffset = ConvertFloat(param);
             break;
         case "MOVIE"_crc32:
-            SharedMetaData.UMovieFileName = convertRawString(result[2]);
+            SharedMetaData.UMovieFileName = convertRawString(param);
             break;
         case "MOVIEOFFSET"_crc32:
-            SharedMetaData.MovieOffset = ConvertFloat(result[2]);
+            SharedMetaData.MovieOffset = ConvertFloat(param);
             break;
         case "JACKET"_crc32:
-            SharedMetaData.UJacketFileName = convertRawString(result[2]);
+            SharedMetaData.UJacketFileName = convertRawString(param);
             break;
         case "BACKGROUND"_crc32:
-            SharedMetaData.UBackgroundFileName = convertRawString(result[2]);
+            SharedMetaData.UBackgroundFileName = convertRawString(param);
             break;
         case "REQUEST"_crc32:
-            ProcessRequest(convertRawString(result[2]), line);
+            ProcessRequest(convertRawString(param), line);
             break;
         case "BASEBPM"_crc32:
-            SharedMetaData.BaseBpm = ConvertFloat(result[2]);
+            SharedMetaData.BaseBpm = ConvertFloat(param);
             break;
 
             //此処から先はデータ内で使う用
         case "HISPEED"_crc32: {
             if (onlyMeta) break;
-            const auto hsn = ConvertHexatridecimal(result[2]);
+            const auto hsn = ConvertHexatridecimal(param);
             if (hispeedDefinitions.find(hsn) == hispeedDefinitions.end()) {
                 MakeMessage(line, u8"指定されたタイムラインが存在しません。");
                 break;
@@ -319,7 +416,7 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
         case "ATTRIBUTE"_crc32: {
             if (onlyMeta) break;
 
-            const auto ean = ConvertHexatridecimal(result[2]);
+            const auto ean = ConvertHexatridecimal(param);
             if (extraAttributes.find(ean) == extraAttributes.end()) {
                 MakeMessage(line, u8"指定されたアトリビュートが存在しません。");
                 break;
@@ -336,7 +433,7 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
         case "MEASUREHS"_crc32: {
             if (onlyMeta) break;
 
-            const auto hsn = ConvertHexatridecimal(result[2]);
+            const auto hsn = ConvertHexatridecimal(param);
             if (hispeedDefinitions.find(hsn) == hispeedDefinitions.end()) {
                 MakeMessage(line, u8"指定されたタイムラインが存在しません。");
                 break;
@@ -348,7 +445,7 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
         case "MEASUREBS"_crc32: {
             if (onlyMeta) break;
 
-            const auto bsc = ConvertInteger(result[2]);
+            const auto bsc = ConvertInteger(param);
             if (bsc < 0) {
                 MakeMessage(line, u8"小節オフセットの値が不正です。");
                 break;
@@ -360,7 +457,7 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
         case "CHANNELBS"_crc32: {
             if (onlyMeta) break;
 
-            const auto bsc = ConvertInteger(result[2]);
+            const auto bsc = ConvertInteger(param);
             if (bsc < 0) {
                 MakeMessage(line, u8"チャンネルオフセットの値が不正です。");
                 break;
@@ -402,17 +499,23 @@ void SusAnalyzer::ProcessRequest(const string &cmd, const uint32_t line)
         case "segments_per_second"_crc32:
             SharedMetaData.SegmentsPerSecond = ConvertInteger(params[1]);
             break;
+        case "curve_tolerance"_crc32:
+            SharedMetaData.CurveTolerance = max(0.0, double(ConvertFloat(params[1])));
+            break;
         default:
             break;
     }
 }
 
-void SusAnalyzer::ProcessData(const xp::smatch &result, const uint32_t line)
+void SusAnalyzer::ProcessData(const b::string_view meas, const b::string_view lane, b::string_view pattern, const uint32_t line)
 {
-    auto meas = result[1].str();
-    auto lane = result[2].str();
-    auto pattern = result[3].str();
-    ba::erase_all(pattern, " ");
+    // 空白入りのデータ(まれ)だけ詰め直す
+    string compacted;
+    if (pattern.find(' ') != b::string_view::npos) {
+        compacted.reserve(pattern.size());
+        remove_copy(pattern.begin(), pattern.end(), back_inserter(compacted), ' ');
+        pattern = compacted;
+    }
 
     /*
      判定順について
@@ -423,36 +526,36 @@ void SusAnalyzer::ProcessData(const xp::smatch &result, const uint32_t line)
      4. #---[234]*. (Long)
     */
 
-    const auto noteCount = pattern.length() / 2;
-    const auto step = uint32_t(ticksPerBeat * GetBeatsAt(GetMeasureCount(ConvertInteger(meas)))) / (!noteCount ? 1 : noteCount);
+    const auto measure = GetMeasureCount(ConvertInteger(meas.to_string()));
+    const auto noteCount = SU_TO_UINT32(pattern.length() / 2);
+    const auto step = uint32_t(ticksPerBeat * GetBeatsAt(measure)) / (!noteCount ? 1 : noteCount);
 
-    if (!regex_match(meas, allNumeric)) {
+    if (!isAllNumeric(meas)) {
         // コマンドデータ
-        transform(meas.cbegin(), meas.cend(), meas.begin(), toUpper);
-        if (meas == "BPM") {
-            const auto number = ConvertHexatridecimal(lane);
-            const auto value = ConvertFloat(pattern);
+        if (ba::iequals(meas, "BPM")) {
+            const auto number = ConvertHexatridecimal(lane.to_string());
+            const auto value = ConvertFloat(pattern.to_string());
             bpmDefinitions[number] = value;
             if (SharedMetaData.ShowBpm < 0) SharedMetaData.ShowBpm = value;
-        } else if (meas == "TIL") {
-            const auto number = ConvertHexatridecimal(lane);
+        } else if (ba::iequals(meas, "TIL")) {
+            const auto number = ConvertHexatridecimal(lane.to_string());
             auto it = hispeedDefinitions.find(number);
             if (it == hispeedDefinitions.end()) {
                 auto hs = make_shared<SusHispeedTimeline>([&](const uint32_t m, const uint32_t t) { return GetAbsoluteTime(m, t); });
-                hs->AddKeysByString(convertRawString(pattern), timelineResolver);
+                hs->AddKeysByString(convertRawString(pattern.to_string()), timelineResolver);
                 hispeedDefinitions[number] = hs;
             } else {
-                it->second->AddKeysByString(convertRawString(pattern), timelineResolver);
+                it->second->AddKeysByString(convertRawString(pattern.to_string()), timelineResolver);
             }
-        } else if (meas == "ATR") {
-            const auto number = ConvertHexatridecimal(lane);
+        } else if (ba::iequals(meas, "ATR")) {
+            const auto number = ConvertHexatridecimal(lane.to_string());
             auto it = extraAttributes.find(number);
             if (it == extraAttributes.end()) {
                 auto ea = make_shared<SusNoteExtraAttribute>();
-                ea->Apply(convertRawString(pattern));
+                ea->Apply(convertRawString(pattern.to_string()));
                 extraAttributes[number] = ea;
             } else {
-                it->second->Apply(convertRawString(pattern));
+                it->second->Apply(convertRawString(pattern.to_string()));
             }
         } else {
             MakeMessage(line, u8"不正なデータコマンドです。");
@@ -461,7 +564,7 @@ void SusAnalyzer::ProcessData(const xp::smatch &result, const uint32_t line)
         switch (lane[1]) {
             case '2':
                 // 小節長
-                beatsDefinitions[GetMeasureCount(ConvertInteger(meas))] = ConvertFloat(pattern);
+                beatsDefinitions[measure] = ConvertFloat(pattern.to_string());
                 break;
             case '8': {
                 // BPM
@@ -470,10 +573,10 @@ void SusAnalyzer::ProcessData(const xp::smatch &result, const uint32_t line)
 
                     SusRawNoteData noteData;
                     noteData.Type.set(size_t(SusNoteType::Undefined));
-                    noteData.DefinitionNumber = ConvertHexatridecimal(note);
+                    noteData.DefinitionNumber = ConvertHexatridecimal(note.to_string());
                     if (!noteData.DefinitionNumber) continue;
 
-                    const SusRelativeNoteTime time = { GetMeasureCount(ConvertInteger(meas)), step * i };
+                    const SusRelativeNoteTime time = { measure, step * i };
                     notes.emplace_back(time, noteData);
                 }
                 break;
@@ -488,8 +591,8 @@ void SusAnalyzer::ProcessData(const xp::smatch &result, const uint32_t line)
             const auto note = pattern.substr(i * 2, 2);
 
             SusRawNoteData noteData;
-            noteData.NotePosition.StartLane = ConvertHexatridecimal(lane.substr(1, 1));
-            noteData.NotePosition.Length = ConvertHexatridecimal(note.substr(1, 1));
+            noteData.NotePosition.StartLane = ConvertHexatridecimal(lane.substr(1, 1).to_string());
+            noteData.NotePosition.Length = ConvertHexatridecimal(note.substr(1, 1).to_string());
             noteData.Timeline = hispeedToApply;
             noteData.ExtraAttribute = extraAttributeToApply;
 
@@ -520,7 +623,7 @@ void SusAnalyzer::ProcessData(const xp::smatch &result, const uint32_t line)
                     continue;
             }
 
-            const SusRelativeNoteTime time = { GetMeasureCount(ConvertInteger(meas)), step * i };
+            const SusRelativeNoteTime time = { measure, step * i };
             notes.emplace_back(time, noteData);
         }
     } else if (lane[0] == '5') {
@@ -529,8 +632,8 @@ void SusAnalyzer::ProcessData(const xp::smatch &result, const uint32_t line)
             const auto note = pattern.substr(i * 2, 2);
 
             SusRawNoteData noteData;
-            noteData.NotePosition.StartLane = ConvertHexatridecimal(lane.substr(1, 1));
-            noteData.NotePosition.Length = ConvertHexatridecimal(note.substr(1, 1));
+            noteData.NotePosition.StartLane = ConvertHexatridecimal(lane.substr(1, 1).to_string());
+            noteData.NotePosition.Length = ConvertHexatridecimal(note.substr(1, 1).to_string());
             noteData.Timeline = hispeedToApply;
             noteData.ExtraAttribute = extraAttributeToApply;
 
@@ -586,7 +689,7 @@ void SusAnalyzer::ProcessData(const xp::smatch &result, const uint32_t line)
                     continue;
             }
 
-            const SusRelativeNoteTime time = { GetMeasureCount(ConvertInteger(meas)), step * i };
+            const SusRelativeNoteTime time = { measure, step * i };
             notes.emplace_back(time, noteData);
         }
     } else if (lane.length() == 3 && lane[0] >= '2' && lane[0] <= '4') {
@@ -595,9 +698,9 @@ void SusAnalyzer::ProcessData(const xp::smatch &result, const uint32_t line)
             const auto note = pattern.substr(i * 2, 2);
 
             SusRawNoteData noteData;
-            noteData.NotePosition.StartLane = ConvertHexatridecimal(lane.substr(1, 1));
-            noteData.NotePosition.Length = ConvertHexatridecimal(note.substr(1, 1));
-            noteData.Extra = GetLongNoteChannel(ConvertHexatridecimal(lane.substr(2, 1)));
+            noteData.NotePosition.StartLane = ConvertHexatridecimal(lane.substr(1, 1).to_string());
+            noteData.NotePosition.Length = ConvertHexatridecimal(note.substr(1, 1).to_string());
+            noteData.Extra = GetLongNoteChannel(ConvertHexatridecimal(lane.substr(2, 1).to_string()));
             noteData.Timeline = hispeedToApply;
             noteData.ExtraAttribute = extraAttributeToApply;
 
@@ -637,13 +740,13 @@ void SusAnalyzer::ProcessData(const xp::smatch &result, const uint32_t line)
                     continue;
             }
 
-            const SusRelativeNoteTime time = { GetMeasureCount(ConvertInteger(meas)), step * i };
+            const SusRelativeNoteTime time = { measure, step * i };
             notes.emplace_back(time, noteData);
         }
     } else if (lane.length() == 3 && lane[0] == '9') {
         // z = 0のレーン指定(Tap) #mmm800~#mmm80f~#mmm8ff
-        const auto endlane = lane.substr(1, 1);
-        const auto startlane = lane.substr(2, 1);
+        const auto endlane = lane.substr(1, 1).to_string();
+        const auto startlane = lane.substr(2, 1).to_string();
 
         for (auto i = 0u; i < noteCount; i++) {
             const auto note = pattern.substr(i * 2, 2);
@@ -656,12 +759,12 @@ void SusAnalyzer::ProcessData(const xp::smatch &result, const uint32_t line)
             SusRawNoteData noteData;
             noteData.NotePosition.StartLane = ConvertHexatridecimal(endlane);
             noteData.Extra = ConvertHexatridecimal(startlane);
-            noteData.NotePosition.Length = ConvertHexatridecimal(note.substr(1, 1));
+            noteData.NotePosition.Length = ConvertHexatridecimal(note.substr(1, 1).to_string());
             noteData.Type.set(size_t(SusNoteType::StartPosition));
             // noteData.Timeline = hispeedToApply;
             // noteData.ExtraAttribute = extraAttributeToApply;
 
-            const SusRelativeNoteTime time = { GetMeasureCount(ConvertInteger(meas)), step * i };
+            const SusRelativeNoteTime time = { measure, step * i };
             notes.emplace_back(time, noteData);
         }
     } else {
@@ -706,22 +809,7 @@ double SusAnalyzer::GetBpmAt(const uint32_t measure, const uint32_t tick) const
 {
     uint32_t nm, nt;
     tie(nm, nt) = NormalizeRelativeTime(measure, tick);
-    auto result = defaultBpm;
-    auto lastMeasure = 0u;
-    auto lastTick = 0u;
-    for (const auto &t : bpmChanges) {
-        const auto bcTime = get<0>(t);
-        if (bcTime.Measure > nm || bcTime.Measure < lastMeasure) continue;
-        if (bcTime.Measure == lastMeasure && lastTick > bcTime.Tick) continue;
-
-        const auto &bpmDef = bpmDefinitions.find(get<1>(t).DefinitionNumber);
-        if (bpmDef != bpmDefinitions.end()) {
-            result = bpmDef->second;
-        }
-        lastMeasure = bcTime.Measure;
-        lastTick = bcTime.Tick;
-    }
-    return result;
+    return FindTempoSegment(nm, nt).Bpm;
 }
 
 tuple<uint32_t, uint32_t> SusAnalyzer::NormalizeRelativeTime(const uint32_t meas, const uint32_t tick) const
@@ -735,63 +823,40 @@ tuple<uint32_t, uint32_t> SusAnalyzer::NormalizeRelativeTime(const uint32_t meas
 
 double SusAnalyzer::GetAbsoluteTime(const uint32_t meas, const uint32_t tick) const
 {
-    auto time = 0.0;
-    auto lastBpm = defaultBpm;
     //超過したtick指定にも対応したほうが使いやすいよね
     uint32_t nm, nt;
     tie(nm, nt) = NormalizeRelativeTime(meas, tick);
 
-    for (auto i = 0u; i < nm + 1; i++) {
-        const auto beats = GetBeatsAt(i);
-        auto lastChangeTick = 0u;
-        for (auto& bc : bpmChanges) {
-            if (get<0>(bc).Measure != i) continue;
-            const auto timing = get<0>(bc);
-            if (i == nm && timing.Tick >= nt) break;
-            const auto dur = (60.0 / lastBpm) * (double(timing.Tick - lastChangeTick) / ticksPerBeat);
-            time += dur;
-            lastChangeTick = timing.Tick;
-            const auto bpmDefinition = bpmDefinitions.find(get<1>(bc).DefinitionNumber);
-            if (bpmDefinition != bpmDefinitions.end()) {
-                lastBpm = bpmDefinition->second;
-            }
-        }
-        if (i == nm) {
-            time += (60.0 / lastBpm) * (double(nt - lastChangeTick) / ticksPerBeat);
-        } else {
-            time += (60.0 / lastBpm) * (double(ticksPerBeat * beats - lastChangeTick) / ticksPerBeat);
-        }
-    }
-
-    return time;
+    const auto segment = FindTempoSegment(nm, nt);
+    return segment.AbsoluteTime + (60.0 / segment.Bpm) * (double(nt - segment.Time.Tick) / ticksPerBeat);
 }
 
 tuple<uint32_t, uint32_t> SusAnalyzer::GetRelativeTime(const double time) const
 {
+    // 開始時刻がtime未満の最後の区間に含まれる
+    const auto next = lower_bound(tempoSegments.begin(), tempoSegments.end(), time, [](const SusTempoSegment &s, const double t) {
+        return s.AbsoluteTime < t;
+    });
+    if (next != tempoSegments.end()) {
+        const auto &segment = next == tempoSegments.begin() ? *next : *(next - 1);
+        const auto secPerBeat = 60.0 / segment.Bpm;
+        const auto restTime = time - segment.AbsoluteTime;
+        return make_tuple(segment.Time.Measure, segment.Time.Tick + static_cast<uint32_t>(restTime / secPerBeat * ticksPerBeat));
+    }
+
+    // テンポマップより後ろはBPM変化が無いので小節単位で進める
     auto restTime = time;
     uint32_t meas = 0;
-    auto secPerBeat = (60.0 / 120.0);
-
+    auto secPerBeat = 60.0 / defaultBpm;
+    if (!tempoSegments.empty()) {
+        const auto &last = tempoSegments.back();
+        restTime -= last.AbsoluteTime;
+        meas = last.Time.Measure;
+        secPerBeat = 60.0 / last.Bpm;
+    }
     while (true) {
-        const auto beats = GetBeatsAt(meas);
-        auto lastChangeTick = 0u;
-
-        for (auto& bc : bpmChanges) {
-            const auto timing = get<0>(bc);
-            if (timing.Measure != meas) continue;
-            const auto dur = secPerBeat * (double(timing.Tick - lastChangeTick) / ticksPerBeat);
-            if (dur >= restTime) return make_tuple(meas, lastChangeTick + static_cast<uint32_t>(restTime / secPerBeat * ticksPerBeat));
-            restTime -= dur;
-            lastChangeTick = timing.Tick;
-            const auto bpmDef = bpmDefinitions.find(get<1>(bc).DefinitionNumber);
-
-            if (bpmDef != bpmDefinitions.end()) {
-                secPerBeat = 60.0 / bpmDef->second;
-            }
-        }
-        const double restTicks = ticksPerBeat * beats - lastChangeTick;
-        const auto restDuration = restTicks / ticksPerBeat * secPerBeat;
-        if (restDuration >= restTime) return make_tuple(meas, lastChangeTick + static_cast<uint32_t>(restTime / secPerBeat * ticksPerBeat));
+        const auto restDuration = double(ticksPerBeat * GetBeatsAt(meas)) / ticksPerBeat * secPerBeat;
+        if (restDuration >= restTime) return make_tuple(meas, static_cast<uint32_t>(restTime / secPerBeat * ticksPerBeat));
         restTime -= restDuration;
         meas++;
     }
@@ -799,18 +864,104 @@ tuple<uint32_t, uint32_t> SusAnalyzer::GetRelativeTime(const double time) const
 
 uint32_t SusAnalyzer::GetRelativeTicks(const uint32_t measure, const uint32_t tick) const
 {
+    if (measure < measureTicks.size()) return SU_TO_UINT32(measureTicks[measure]) + tick;
+
+    auto first = 0u;
     float result = 0;
-    for (auto i = 0u; i < measure; i++) result += GetBeatsAt(i) * ticksPerBeat;
+    if (!measureTicks.empty()) {
+        first = SU_TO_UINT32(measureTicks.size() - 1);
+        result = measureTicks.back();
+    }
+    for (auto i = first; i < measure; i++) result += GetBeatsAt(i) * ticksPerBeat;
     return SU_TO_UINT32(result) + tick;
 }
 
-void SusAnalyzer::RenderScoreData(DrawableNotesList &data, NoteCurvesList &curveData)
+// 小節頭とBPM変化点で区切った区間ごとに開始時刻を積算しておく
+// measureCount小節目の頭まで作るので、それ以降にBPM変化があってはいけない
+void SusAnalyzer::BuildTempoMap(const uint32_t measureCount)
+{
+    tempoSegments.clear();
+    measureTicks.clear();
+    tempoSegments.reserve(measureCount + 1 + bpmChanges.size());
+    measureTicks.reserve(measureCount + 1);
+
+    auto time = 0.0;
+    auto lastBpm = defaultBpm;
+    float ticks = 0;
+    auto bc = bpmChanges.cbegin();
+    for (auto i = 0u; i <= measureCount; i++) {
+        tempoSegments.push_back({ { i, 0 }, time, lastBpm });
+        measureTicks.push_back(ticks);
+        if (i == measureCount) break;
+
+        const auto beats = GetBeatsAt(i);
+        auto lastChangeTick = 0u;
+        for (; bc != bpmChanges.cend() && get<0>(*bc).Measure == i; ++bc) {
+            const auto timing = get<0>(*bc);
+            time += (60.0 / lastBpm) * (double(timing.Tick - lastChangeTick) / ticksPerBeat);
+            lastChangeTick = timing.Tick;
+            const auto bpmDefinition = bpmDefinitions.find(get<1>(*bc).DefinitionNumber);
+            if (bpmDefinition != bpmDefinitions.end()) {
+                lastBpm = bpmDefinition->second;
+            }
+            tempoSegments.push_back({ timing, time, lastBpm });
+        }
+        time += (60.0 / lastBpm) * (double(ticksPerBeat * beats - lastChangeTick) / ticksPerBeat);
+        ticks += beats * ticksPerBeat;
+    }
+}
+
+// 指定位置(正規化済み)を含む区間を返す
+// テンポマップが無い(メタデータのみ解析した)場合や範囲外の場合は最後の区間から延長する
+SusTempoSegment SusAnalyzer::FindTempoSegment(const uint32_t meas, const uint32_t tick) const
+{
+    if (!measureTicks.empty() && meas < measureTicks.size()) {
+        const SusRelativeNoteTime key = { meas, tick };
+        const auto next = upper_bound(tempoSegments.begin(), tempoSegments.end(), key, [](const SusRelativeNoteTime &t, const SusTempoSegment &s) {
+            return t < s.Time;
+        });
+        return *(next - 1);
+    }
+
+    auto result = tempoSegments.empty() ? SusTempoSegment { { 0, 0 }, 0.0, defaultBpm } : tempoSegments.back();
+    for (auto i = result.Time.Measure; i < meas; i++) {
+        result.AbsoluteTime += (60.0 / result.Bpm) * (double(ticksPerBeat * GetBeatsAt(i)) / ticksPerBeat);
+    }
+    result.Time = { meas, 0 };
+    return result;
+}
+
+void SusAnalyzer::RenderScoreData(DrawableNotesList &data, SusCurveBuffer &curveData)
 {
     // 不正チェックリスト
     // ショート: はみ出しは全部アウト
     // ホールド: ケツ無しアウト(ケツ連は無視)、Step/Control問答無用アウト、ケツ違いアウト
     // スライド、AA: ケツ無しアウト(ケツ連は無視)
     data.clear();
+    curveData.Clear();
+    auto fixedCurvePoints = 0u;
+
+    // 毎回notes全体を走査しないように先に振り分けておく
+    // ロング: 種類とチャンネルごと(Start以外、ソート順)
+    // Air設置判定、移動レーン: 時刻と位置ごと
+    unordered_map<uint64_t, vector<size_t>> longNoteParts;
+    unordered_map<uint64_t, vector<size_t>> notesAtPosition;
+#ifdef SU_ENABLE_NOTE_HORIZONTAL_MOVING
+    unordered_map<uint64_t, vector<size_t>> startPositions;
+#endif
+    for (auto i = 0u; i < notes.size(); i++) {
+        const auto &ntime = get<0>(notes[i]);
+        const auto &ninfo = get<1>(notes[i]);
+        notesAtPosition[makePositionKey(ntime, ninfo.DefinitionNumber)].push_back(i);
+#ifdef SU_ENABLE_NOTE_HORIZONTAL_MOVING
+        if (ninfo.Type[size_t(SusNoteType::StartPosition)]) startPositions[makePositionKey(ntime, ninfo.NotePosition.StartLane)].push_back(i);
+#endif
+        if (ninfo.Type[size_t(SusNoteType::Start)]) continue;
+        for (const auto ltype : { SusNoteType::Hold, SusNoteType::Slide, SusNoteType::AirAction }) {
+            if (ninfo.Type[size_t(ltype)]) longNoteParts[makeChannelKey(ltype, ninfo.Extra)].push_back(i);
+        }
+    }
+
     for (const auto& note : notes) {
         const auto time = get<0>(note);
         const auto &info = get<1>(note);
@@ -858,14 +1009,15 @@ void SusAnalyzer::RenderScoreData(DrawableNotesList &data, NoteCurvesList &curve
 
             auto completed = false;
             auto lastStep = note;
-            for (const auto &it : notes) {
+            const auto &parts = longNoteParts[makeChannelKey(ltype, info.Extra)];
+            const auto firstPart = lower_bound(parts.begin(), parts.end(), time, [&](const size_t i, const SusRelativeNoteTime &t) {
+                return get<0>(notes[i]) < t;
+            });
+            for (auto part = firstPart; part != parts.end(); ++part) {
+                const auto &it = notes[*part];
                 const auto curPos = get<0>(it);
                 const auto &curNo = get<1>(it);
 
-                if (curNo.Type.test(size_t(SusNoteType::Start))) continue;
-                if (!curNo.Type.test(size_t(ltype)) || curNo.Extra != info.Extra) continue;
-                if (curPos < time) continue;
-
                 if (curNo.NotePosition.StartLane + curNo.NotePosition.Length > 16) {
                     MakeMessage(time.Measure, time.Tick, info.NotePosition.StartLane, u8"ノーツがはみ出しています。");
                     continue;
@@ -927,7 +1079,7 @@ void SusAnalyzer::RenderScoreData(DrawableNotesList &data, NoteCurvesList &curve
 
             SharedMetaData.ScoreDuration = max(SharedMetaData.ScoreDuration, noteData->StartTime + noteData->Duration);
             if (genCurve) {
-                CalculateCurves(noteData, curveData);
+                fixedCurvePoints += CalculateCurves(noteData, curveData);
                 // Injection の幅を決定する
                 for (const auto &extra : noteData->ExtraData) {
                     if (!extra->Type[size_t(SusNoteType::Injection)]) continue;
@@ -940,26 +1092,26 @@ void SusAnalyzer::RenderScoreData(DrawableNotesList &data, NoteCurvesList &curve
                             last = slideElement;
                             continue;
                         }
-                        const auto width = glm::mix(
+                        const auto width = mixLinear(
                             last->Length, slideElement->Length,
                             (extra->StartTime - last->StartTime) / (slideElement->StartTime - last->StartTime)
                         );
-                        auto &segmentPositions = curveData[slideElement];
+                        const auto segmentPositions = curveData.GetCurve(*slideElement);
 
                         auto lastSegmentPosition = segmentPositions[0];
                         auto lastTimeInBlock = get<0>(lastSegmentPosition) / (slideElement->StartTime - last->StartTime);
-                        for (auto &segmentPosition : segmentPositions) {
+                        for (const auto &segmentPosition : segmentPositions) {
                             if (lastSegmentPosition == segmentPosition) continue;
                             const auto currentTimeInBlock = get<0>(segmentPosition) / (slideElement->StartTime - last->StartTime);
-                            const auto cst = glm::mix(last->StartTime, slideElement->StartTime, currentTimeInBlock);
+                            const auto cst = mixLinear(last->StartTime, slideElement->StartTime, currentTimeInBlock);
                             if (extra->StartTime >= cst) {
                                 lastSegmentPosition = segmentPosition;
                                 lastTimeInBlock = currentTimeInBlock;
                                 continue;
                             }
-                            const auto lst = glm::mix(last->StartTime, slideElement->StartTime, lastTimeInBlock);
+                            const auto lst = mixLinear(last->StartTime, slideElement->StartTime, lastTimeInBlock);
                             const auto t = (extra->StartTime - lst) / (cst - lst);
-                            const auto x = glm::mix(get<1>(lastSegmentPosition), get<1>(segmentPosition), t);
+                            const auto x = mixLinear(get<1>(lastSegmentPosition), get<1>(segmentPosition), t);
                             const auto center = x * 16.0;
                             extra->StartLane = SU_TO_FLOAT(center - width / 2.0);
                             extra->Length = width;
@@ -984,15 +1136,9 @@ void SusAnalyzer::RenderScoreData(DrawableNotesList &data, NoteCurvesList &curve
             // if ((下に別ノーツがある && それはロング終点) || 下に別ノーツがない)
             if (info.Type[size_t(SusNoteType::Air)] && !info.Type[size_t(SusNoteType::Grounded)]) {
                 auto require = true;
-                for (const auto &target : notes) {
-                    const auto gtime = get<0>(target);
-                    const auto &ginfo = get<1>(target);
-
-                    // 判定時刻が異なるノーツは処理対象からはじく
-                    if (time != gtime) continue;
-
-                    // 自分自身と位置、サイズが異なるノーツは処理対象からはじく
-                    if (info.DefinitionNumber != ginfo.DefinitionNumber) continue;
+                // 判定時刻、位置、サイズが自分自身と同じノーツだけが処理対象
+                for (const auto target : notesAtPosition[makePositionKey(time, info.DefinitionNumber)]) {
+                    const auto &ginfo = get<1>(notes[target]);
 
                     // 自分自身と異なるハイスピ指定がなされているノーツは処理対象からはじく
                     if (info.Timeline != ginfo.Timeline) continue;
@@ -1028,12 +1174,8 @@ void SusAnalyzer::RenderScoreData(DrawableNotesList &data, NoteCurvesList &curve
 #ifdef SU_ENABLE_NOTE_HORIZONTAL_MOVING
             // 移動レーン処理
             if (SharedMetaData.ExtraFlags[size_t(SusMetaDataFlags::EnableMovingLane)]) {
-                for (const auto &startSource : notes) {
-                    const auto mltime = get<0>(startSource);
-                    const auto &mlinfo = get<1>(startSource);
-                    if (mltime != time) continue;
-                    if (mlinfo.NotePosition.StartLane != info.NotePosition.StartLane) continue;
-                    if (!mlinfo.Type[size_t(SusNoteType::StartPosition)]) continue;
+                for (const auto startSource : startPositions[makePositionKey(time, info.NotePosition.StartLane)]) {
+                    const auto &mlinfo = get<1>(notes[startSource]);
                     noteData->CenterAtZero = mlinfo.Extra + mlinfo.NotePosition.Length / 2.0;
                 }
             }
@@ -1048,13 +1190,151 @@ void SusAnalyzer::RenderScoreData(DrawableNotesList &data, NoteCurvesList &curve
 
         data.push_back(noteData);
     }
+
+    if (SharedMetaData.CurveTolerance > 0) {
+        spdlog::get("main")->info(u8"曲線の分割点: {0}点 (間引き前 {1}点)", curveData.GetSize(), fixedCurvePoints);
+    }
 }
 
-void SusAnalyzer::CalculateCurves(const shared_ptr<SusDrawableNoteData>& note, NoteCurvesList &curveData) const
+// 制御点で決まるBezier曲線上をcount等分した点を追加する
+// de Casteljauを点ごとにやり直す代わりに、べき基底の係数
+//   a_m = C(k, m) * Σ_{i=0..m} (-1)^(m-i) * C(m, i) * P_i
+// を区間ごとに一度だけ求めて、各点はHorner法で評価する(時間とX位置は2要素まとめて計算する)
+// 係数は始点を原点に移した制御点から求める(曲の後半で時刻の絶対値が大きくても桁落ちしないように)
+// 次数が高いと係数自体が大きくなって誤差が増えるので、maxPowerBasisDegreeを超えたら点ごとにde Casteljauで求める
+// 両端は制御点そのものを入れる
+static const size_t maxPowerBasisDegree = 8;
+
+void SusCurveBuffer::PushBezier(const vector<tuple<double, double>> &controlPoints, const uint32_t count)
 {
+    if (controlPoints.empty() || count == 0) return;
+    const auto &first = controlPoints.front();
+    const auto &last = controlPoints.back();
+    // ちょうどの大きさで確保すると曲線ごとに全体を作り直すことになるので倍々で広げる
+    if (points.capacity() < points.size() + count) points.reserve(max(points.capacity() * 2, points.size() + count));
+    points.push_back(first);
+    if (count == 1) return;
+
+    const auto degree = controlPoints.size() - 1;
+    const auto divisor = double(count - 1);
+    if (degree > maxPowerBasisDegree) {
+        coefficients.resize((degree + 1) * 2);
+        auto *work = coefficients.data();
+        for (auto j = 1u; j < count - 1; j++) {
+            const auto t = j / divisor;
+            const auto s = 1 - t;
+            for (auto i = 0u; i <= degree; i++) {
+                work[i * 2] = get<0>(controlPoints[i]);
+                work[i * 2 + 1] = get<1>(controlPoints[i]);
+            }
+            // glm::mixと同じ計算
+#ifdef SU_CURVE_USE_SSE2
+            const auto tv = _mm_set1_pd(t), sv = _mm_set1_pd(s);
+            for (auto k = degree; k > 0; k--) {
+                for (auto i = 0u; i < k; i++) {
+                    _mm_storeu_pd(work + i * 2, _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(work + i * 2), sv), _mm_mul_pd(_mm_loadu_pd(work + i * 2 + 2), tv)));
+                }
+            }
+#else
+            for (auto k = degree; k > 0; k--) {
+                for (auto i = 0u; i < k; i++) {
+                    work[i * 2] = work[i * 2] * s + work[i * 2 + 2] * t;
+                    work[i * 2 + 1] = work[i * 2 + 1] * s + work[i * 2 + 3] * t;
+                }
+            }
+#endif
+            points.emplace_back(work[0], work[1]);
+        }
+        points.push_back(last);
+        return;
+    }
+
+    const auto originTime = get<0>(first), originPosition = get<1>(first);
+    coefficients.assign((degree + 1) * 2, 0.0);
+    coefficients[0] = originTime;
+    coefficients[1] = originPosition;
+    auto outer = double(degree);    // C(k, m)
+    for (auto m = 1u; m <= degree; m++) {
+        auto inner = 1.0;   // C(m, i)
+        auto sumTime = 0.0, sumPosition = 0.0;
+        for (auto i = 0u; i <= m; i++) {
+            const auto sign = (m - i) % 2 ? -inner : inner;
+            sumTime += sign * (get<0>(controlPoints[i]) - originTime);
+            sumPosition += sign * (get<1>(controlPoints[i]) - originPosition);
+            inner = inner * (m - i) / (i + 1);
+        }
+        coefficients[m * 2] = outer * sumTime;
+        coefficients[m * 2 + 1] = outer * sumPosition;
+        outer = outer * (degree - m) / (m + 1);
+    }
+
+    const auto *coefficient = coefficients.data();
+    for (auto j = 1u; j < count - 1; j++) {
+        const auto t = j / divisor;
+        double result[2];
+#ifdef SU_CURVE_USE_SSE2
+        const auto tv = _mm_set1_pd(t);
+        auto acc = _mm_loadu_pd(coefficient + degree * 2);
+        for (auto m = degree; m > 0; m--) acc = _mm_add_pd(_mm_mul_pd(acc, tv), _mm_loadu_pd(coefficient + (m - 1) * 2));
+        _mm_storeu_pd(result, acc);
+#else
+        result[0] = coefficient[degree * 2];
+        result[1] = coefficient[degree * 2 + 1];
+        for (auto m = degree; m > 0; m--) {
+            result[0] = result[0] * t + coefficient[(m - 1) * 2];
+            result[1] = result[1] * t + coefficient[(m - 1) * 2 + 1];
+        }
+#endif
+        points.emplace_back(result[0], result[1]);
+    }
+    points.push_back(last);
+}
+
+void SusCurveBuffer::Simplify(const uint32_t offset, const double tolerance)
+{
+    // Douglas-Peucker法で、両端を結んだ線分から一番離れた点がtoleranceを超えていたらそこで分けて残す
+    // 描画も判定もX位置を時間で線形補間するので、距離は同じ時刻でのX位置の差で測る
+    const auto count = SU_TO_UINT32(points.size()) - offset;
+    if (count <= 2) return;
+    const auto at = [&](const uint32_t i) -> const tuple<double, double>& { return points[offset + i]; };
+
+    vector<uint8_t> keep(count, 0);
+    keep.front() = keep.back() = 1;
+    vector<tuple<uint32_t, uint32_t>> ranges = { make_tuple(0u, count - 1) };
+    while (!ranges.empty()) {
+        const auto first = get<0>(ranges.back());
+        const auto last = get<1>(ranges.back());
+        ranges.pop_back();
+
+        const auto span = get<0>(at(last)) - get<0>(at(first));
+        auto farthest = first;
+        auto maxDistance = tolerance;
+        for (auto i = first + 1; i < last; i++) {
+            const auto ratio = span > 0 ? (get<0>(at(i)) - get<0>(at(first))) / span : 0.0;
+            const auto distance = fabs(get<1>(at(i)) - mixLinear(get<1>(at(first)), get<1>(at(last)), ratio));
+            if (distance <= maxDistance) continue;
+            farthest = i;
+            maxDistance = distance;
+        }
+        if (farthest == first) continue;
+        keep[farthest] = 1;
+        ranges.emplace_back(first, farthest);
+        ranges.emplace_back(farthest, last);
+    }
+
+    auto written = offset;
+    for (auto i = 0u; i < count; i++) {
+        if (keep[i]) points[written++] = points[offset + i];
+    }
+    points.resize(written);
+}
+
+// 直前の点からの曲線を作り、間引く前の分割点の数を返す
+uint32_t SusAnalyzer::CalculateCurves(const shared_ptr<SusDrawableNoteData>& note, SusCurveBuffer &curveData) const
+{
+    auto fixedPoints = 0u;
     auto lastStep = note;
     vector<tuple<double, double>> controlPoints;    // lastStepからの時間, X中央位置(0~1)
-    vector<tuple<double, double>> bezierBuffer;
 
     controlPoints.emplace_back(0, lastStep->CenterAtZero / 16.0);
     for (auto &slideElement : note->ExtraData) {
@@ -1066,25 +1346,16 @@ void SusAnalyzer::CalculateCurves(const shared_ptr<SusDrawableNoteData>& note, N
 
         // EndかStepかInvisible
         const auto segmentPoints = SU_TO_INT32(SharedMetaData.SegmentsPerSecond * (slideElement->StartTime - lastStep->StartTime) + 2);
-        vector<tuple<double, double>> segmentPositions;
-        for (auto j = 0; j < segmentPoints; j++) {
-            const auto relativeTimeInBlock = j / double(segmentPoints - 1);
-            bezierBuffer.clear();
-            copy(controlPoints.begin(), controlPoints.end(), back_inserter(bezierBuffer));
-            for (int k = controlPoints.size() - 1; k >= 0; k--) {
-                for (auto l = 0; l < k; l++) {
-                    auto derivedTime = glm::mix(get<0>(bezierBuffer[l]), get<0>(bezierBuffer[l + 1]), relativeTimeInBlock);
-                    auto derivedPosition = glm::mix(get<1>(bezierBuffer[l]), get<1>(bezierBuffer[l + 1]), relativeTimeInBlock);
-                    bezierBuffer[l] = make_tuple(derivedTime, derivedPosition);
-                }
-            }
-            segmentPositions.push_back(bezierBuffer[0]);
-        }
-        curveData[slideElement] = segmentPositions;
+        slideElement->CurveOffset = curveData.GetSize();
+        curveData.PushBezier(controlPoints, SU_TO_UINT32(max(segmentPoints, 0)));
+        fixedPoints += curveData.GetSize() - slideElement->CurveOffset;
+        if (SharedMetaData.CurveTolerance > 0) curveData.Simplify(slideElement->CurveOffset, SharedMetaData.CurveTolerance / 16.0);
+        slideElement->CurveCount = curveData.GetSize() - slideElement->CurveOffset;
         lastStep = slideElement;
         controlPoints.clear();
         controlPoints.emplace_back(0, slideElement->CenterAtZero / 16.0);
     }
+    return fixedPoints;
 }
 
 uint32_t SusAnalyzer::GetMeasureCount(const uint32_t relativeMeasureCount) const
@@ -1219,33 +1490,65 @@ void SusHispeedTimeline::Finialize()
         lastSpeed = rd.second.Speed;
     }
     keys.clear();
+    CalculateMinSums();
 }
 
-tuple<bool, double> SusHispeedTimeline::GetRawDrawStateAt(const double time)
+void SusHispeedTimeline::CalculateMinSums()
 {
-    auto lastData = data[0];
-    auto check = 0;
-    for (const auto &d : data) {
-        if (!check++) continue;
-        const auto keyTime = get<0>(d);
-        if (keyTime >= time) break;
-        lastData = d;
+    // 最後のキーより後ろは逆走していればどこまでも下がる
+    const auto lastSpeed = data.empty() ? 1.0 : get<2>(data.back()).Speed;
+    minSums.resize(data.size() + 1);
+    minSums.back() = lastSpeed < 0 ? -numeric_limits<double>::infinity() : numeric_limits<double>::infinity();
+    for (auto i = data.size(); i > 0; --i) minSums[i - 1] = min(minSums[i], get<1>(data[i - 1]));
+}
+
+// time直前(time未満で最後)のキーの位置、無ければ先頭
+// 再生中は時刻が単調に進むので、前回の位置とその次を先に見る
+size_t SusHispeedTimeline::FindKeyIndex(const double time)
+{
+    const auto isBefore = [&](const size_t index) {
+        return index == 0 || get<0>(data[index]) < time;
+    };
+    const auto isLast = [&](const size_t index) {
+        return index + 1 == data.size() || get<0>(data[index + 1]) >= time;
+    };
+
+    if (lastKeyIndex < data.size() && isBefore(lastKeyIndex)) {
+        if (isLast(lastKeyIndex)) return lastKeyIndex;
+        if (isLast(lastKeyIndex + 1)) return ++lastKeyIndex;
     }
+
+    const auto next = lower_bound(data.begin() + 1, data.end(), time, [](const tuple<double, double, SusHispeedData> &key, const double t) {
+        return get<0>(key) < t;
+    });
+    lastKeyIndex = size_t(next - data.begin()) - 1;
+    return lastKeyIndex;
+}
+
+// 同じフレームの中ではほぼ全ノーツが同じタイムラインを同じ時刻で聞いてくるので、直前の結果を覚えておく
+tuple<bool, double> SusHispeedTimeline::GetRawDrawStateAt(const double time)
+{
+    if (time == cachedTime) return cachedState;
+
+    const auto &lastData = data[FindKeyIndex(time)];
     const auto lastDifference = time - get<0>(lastData);
-    return make_tuple(get<2>(lastData).VisibilityState == SusHispeedData::Visibility::Visible, get<1>(lastData) + lastDifference * get<2>(lastData).Speed);
+    cachedTime = time;
+    cachedState = make_tuple(get<2>(lastData).VisibilityState == SusHispeedData::Visibility::Visible, get<1>(lastData) + lastDifference * get<2>(lastData).Speed);
+    return cachedState;
 }
 
 double SusHispeedTimeline::GetSpeedAt(const double time)
 {
-    auto lastData = data[0];
-    auto check = 0;
-    for (const auto &d : data) {
-        if (!check++) continue;
-        const auto keyTime = get<0>(d);
-        if (keyTime >= time) break;
-        lastData = d;
-    }
-    return get<2>(lastData).Speed;
+    return get<2>(data[FindKeyIndex(time)]).Speed;
+}
+
+// time以降で位置が取りうる最小値
+// 区間内は位置が線形に変わるので、timeでの値と後ろのキーでの値だけ見ればよい
+double SusHispeedTimeline::GetMinSumFrom(const double time)
+{
+    const auto index = FindKeyIndex(time);
+    const auto current = get<1>(GetRawDrawStateAt(time));
+    return min(current, minSums[index == 0 ? 0 : index + 1]);
 }
 
 tuple<bool, double> SusDrawableNoteData::GetStateAt(const double time)
@@ -3,6 +3,9 @@
 #define SU_NOTE_LONG_MASK  0b00000000001110000000
 #define SU_NOTE_SHORT_MASK 0b00000000000001111110
 
+// 解析結果(.susc)の形式や内容が変わるような変更をしたら上げる
+#define SU_SUS_ANALYZER_VERSION 4
+
 enum class SusNoteType : uint16_t {
     Undefined = 0,
 
@@ -61,6 +64,13 @@ struct SusRelativeNoteTime {
     }
 };
 
+// テンポマップの1区間(小節頭かBPM変化点から始まる)
+struct SusTempoSegment {
+    SusRelativeNoteTime Time;   // 区間の開始位置
+    double AbsoluteTime;        // 区間の開始時刻(秒)
+    double Bpm;                 // 区間内のBPM
+};
+
 
 struct SusHispeedData {
     enum class Visibility {
@@ -88,10 +98,18 @@ struct SusHispeedData {
 };
 
 class SusHispeedTimeline final {
+    friend class SusAnalyzer;
 private:
     std::vector<std::pair<SusRelativeNoteTime, SusHispeedData>> keys;
     std::vector<std::tuple<double, double, SusHispeedData>> data;
     std::function<double(uint32_t, uint32_t)> relToAbs;
+    size_t lastKeyIndex = 0;    // 前回見つけたキーの位置(描画スレッドからしか呼ばれない前提)
+    double cachedTime = std::numeric_limits<double>::quiet_NaN();   // 前回GetRawDrawStateAtに渡された時刻
+    std::tuple<bool, double> cachedState;
+    std::vector<double> minSums;    // 各キー以降の位置の最小値(末尾は最後のキーより後ろの分)
+
+    size_t FindKeyIndex(double time);
+    void CalculateMinSums();
 
 public:
     SusHispeedTimeline(std::function<double(uint32_t, uint32_t)> func);
@@ -101,6 +119,7 @@ public:
     void Finialize();
     std::tuple<bool, double> GetRawDrawStateAt(double time);
     double GetSpeedAt(double time);
+    double GetMinSumFrom(double time);
 };
 
 class SusNoteExtraAttribute final {
@@ -135,6 +154,7 @@ struct SusMetaData {
     double ShowBpm = -1;
     double ScoreDuration = 0;
     int SegmentsPerSecond = 20;
+    double CurveTolerance = 0;  // 曲線の間引きで許す誤差(レーン単位) 0なら間引かない
     uint32_t Level = 0;
     uint32_t DifficultyType = 0;
     std::string UExtraDifficulty = "";
@@ -152,6 +172,7 @@ struct SusMetaData {
         ShowBpm = -1;
         ScoreDuration = 0;
         SegmentsPerSecond = 100;
+        CurveTolerance = 0;
         DifficultyType = 0;
         UExtraDifficulty = u8"";
         ExtraFlags.reset();
@@ -209,20 +230,67 @@ struct SusDrawableNoteData {
     double Duration = 0;
     //スライド・AA用制御データ
     std::vector<std::shared_ptr<SusDrawableNoteData>> ExtraData;
+    //スライド・AAの直前の中継点からこの点までの曲線(SusCurveBuffer内の範囲)
+    uint32_t CurveOffset = 0;
+    uint32_t CurveCount = 0;
 
     std::tuple<bool, double> GetStateAt(double time);
 };
 
 
+// メタデータのみ解析する時にどこまで読むか
+enum class SusMetaDataScanRule {
+    WholeFile = 0,  // 最後まで読む
+    UntilNoteData,  // 小節番号付きのデータ行(ノーツ、小節長など)が出てきたら打ち切る
+};
+
 using DrawableNotesList = std::vector<std::shared_ptr<SusDrawableNoteData>>;
-using NoteCurvesList = std::unordered_map<std::shared_ptr<SusDrawableNoteData>, std::vector<std::tuple<double, double>>>;
+
+// SusCurveBufferの一部分
+class SusCurveSpan final {
+private:
+    const std::tuple<double, double> *first, *last;
+
+public:
+    SusCurveSpan(const std::tuple<double, double> *first, const std::tuple<double, double> *last) : first(first), last(last) {}
+
+    const std::tuple<double, double> *begin() const { return first; }
+    const std::tuple<double, double> *end() const { return last; }
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+    const std::tuple<double, double> &operator[](const size_t i) const { return first[i]; }
+};
+
+// スライド・AAの曲線の分割点(直前の中継点からの時間, X中央位置(0~1))を全部まとめて持つ
+// どこからどこまでが自分の分かは各ノーツのCurveOffset/CurveCountで持つ
+class SusCurveBuffer final {
+private:
+    std::vector<std::tuple<double, double>> points;
+    std::vector<double> coefficients;   // PushBezier用 関数内ローカル変数で頻繁に生成,破棄されるのを嫌って宣言
+
+public:
+    void Clear() { points.clear(); }
+    uint32_t GetSize() const { return static_cast<uint32_t>(points.size()); }
+    void Push(const double time, const double position) { points.emplace_back(time, position); }
+    void PushBezier(const std::vector<std::tuple<double, double>> &controlPoints, uint32_t count);
+    void Simplify(uint32_t offset, double tolerance);
+    SusCurveSpan GetCurve(const SusDrawableNoteData &note) const
+    {
+        const auto first = points.data() + note.CurveOffset;
+        return SusCurveSpan(first, first + note.CurveCount);
+    }
+    const std::vector<std::tuple<double, double>> &GetPoints() const { return points; }
+    std::vector<std::tuple<double, double>> &GetPoints() { return points; }
+};
+
+// SUS有効行をコマンド(#名前 値)・データ(#小節レーン:値)に切り分ける 切り分けた値はlineを指す
+bool TokenizeSusCommand(boost::string_view line, boost::string_view &name, boost::string_view &value);
+bool TokenizeSusData(boost::string_view line, boost::string_view &meas, boost::string_view &lane, boost::string_view &pattern);
 
 // BMS派生フォーマットことSUS(SeaUrchinScore)の解析
 class SusAnalyzer final {
+    friend class ScoreBenchmark;
 private:
-    static boost::xpressive::sregex regexSusCommand;
-    static boost::xpressive::sregex regexSusData;
-
     const float defaultBeats = 4.0;
     const double defaultBpm = 120.0;
     const uint32_t defaultHispeedNumber = std::numeric_limits<uint32_t>::max();
@@ -231,6 +299,8 @@ private:
     std::vector<std::function<void(std::string, std::string)>> errorCallbacks;
     const std::function<std::shared_ptr<SusHispeedTimeline>(uint32_t)> timelineResolver;
 
+    SusMetaDataScanRule metaDataScanRule = SusMetaDataScanRule::WholeFile;
+
     uint32_t ticksPerBeat;          // 1拍あたりの分割数(分解能)
     uint32_t measureCountOffset;    // SUSデータから読み込んだ小節数に加算するオフセット
     uint32_t longNoteChannelOffset; // SUSデータから読み込んだロングノーツ識別番号に加算するオフセット
@@ -244,17 +314,21 @@ private:
     std::unordered_map<uint32_t, std::shared_ptr<SusNoteExtraAttribute>> extraAttributes;
 
     std::vector<std::tuple<SusRelativeNoteTime, SusRawNoteData>> bpmChanges; // notesからBPM指定だけコピーしてきて使う
+    std::vector<SusTempoSegment> tempoSegments; // 小節頭とBPM変化点ごとの区間(時刻順)
+    std::vector<float> measureTicks;            // 各小節頭までの累積tick数
 
     std::shared_ptr<SusHispeedTimeline> hispeedToApply, hispeedToMeasure;
     std::shared_ptr<SusNoteExtraAttribute> extraAttributeToApply;
 
-    void ProcessCommand(const boost::xpressive::smatch &result, bool onlyMeta, uint32_t line);
+    void ProcessCommand(boost::string_view name, boost::string_view value, bool onlyMeta, uint32_t line);
     void ProcessRequest(const std::string &cmd, uint32_t line);
-    void ProcessData(const boost::xpressive::smatch &result, uint32_t line);
+    void ProcessData(boost::string_view meas, boost::string_view lane, boost::string_view pattern, uint32_t line);
     void MakeMessage(const std::string &message) const;
     void MakeMessage(uint32_t line, const std::string &message) const;
     void MakeMessage(uint32_t meas, uint32_t tick, uint32_t lane, const std::string &message) const;
-    void CalculateCurves(const std::shared_ptr<SusDrawableNoteData>& note, NoteCurvesList &curveData) const;
+    void BuildTempoMap(uint32_t measureCount);
+    SusTempoSegment FindTempoSegment(uint32_t meas, uint32_t tick) const;
+    uint32_t CalculateCurves(const std::shared_ptr<SusDrawableNoteData>& note, SusCurveBuffer &curveData) const;
     uint32_t GetMeasureCount(uint32_t relativeMeasureCount) const;
     uint32_t GetLongNoteChannel(uint32_t relativeLongNoteChannel) const;
 
@@ -267,8 +341,12 @@ public:
 
     void Reset();
     void SetMessageCallBack(const std::function<void(std::string, std::string)>& func);
+    void SetMetaDataScanRule(SusMetaDataScanRule rule);
     void LoadFromFile(const std::wstring &fileName, bool analyzeOnlyMetaData = false);
-    void RenderScoreData(DrawableNotesList &data, NoteCurvesList &curveData);
+    void RenderScoreData(DrawableNotesList &data, SusCurveBuffer &curveData);
+    bool LoadCompiledScore(const std::wstring &cacheFileName, uint32_t sourceHash, DrawableNotesList &data, SusCurveBuffer &curveData);
+    void SaveCompiledScore(const std::wstring &cacheFileName, uint32_t sourceHash, const DrawableNotesList &data, const SusCurveBuffer &curveData) const;
+    static uint32_t CalculateFileHash(const std::wstring &fileName);
     float GetBeatsAt(uint32_t measure) const;
     double GetBpmAt(uint32_t measure, uint32_t tick) const;
     double GetAbsoluteTime(uint32_t meas, uint32_t tick) const;
@@ -0,0 +1,130 @@
+﻿#define BOOST_TEST_MODULE NoteSpriteBatchTest
+#include <boost/test/included/unit_test.hpp>
+#include "NoteSpriteBatch.h"
+
+using namespace std;
+
+// Flushで渡された内容を取っておく
+struct FlushedBatch {
+    NoteSpriteState State;
+    vector<NoteSpriteVertex> Vertices;
+    vector<uint16_t> Indices;
+};
+
+struct BatchFixture {
+    vector<FlushedBatch> flushed;
+    NoteSpriteBatch batch;
+
+    BatchFixture() : batch([this](const NoteSpriteBatch &b) {
+        flushed.push_back({ b.GetState(), b.GetVertices(), b.GetIndices() });
+    }) {}
+};
+
+static NoteSpriteState MakeState(const int texture, const int mode, const int param)
+{
+    NoteSpriteState state;
+    state.Texture = texture;
+    state.BlendMode = mode;
+    state.BlendParam = param;
+    return state;
+}
+
+BOOST_FIXTURE_TEST_CASE(QuadVerticesAndIndices, BatchFixture)
+{
+    const auto state = MakeState(1, 0, 255);
+    batch.AddQuad(state, 10, 20, 30, 40, 0.0f, 0.25f, 0.5f, 0.75f);
+    batch.AddQuad(state, 50, 60, 70, 80, 0.0f, 0.0f, 1.0f, 1.0f);
+    BOOST_REQUIRE_EQUAL(batch.GetQuadCount(), 2u);
+
+    // 左上・右上・右下・左下の順
+    const auto &v = batch.GetVertices();
+    BOOST_CHECK_EQUAL(v[0].X, 10); BOOST_CHECK_EQUAL(v[0].Y, 20); BOOST_CHECK_EQUAL(v[0].U, 0.0f); BOOST_CHECK_EQUAL(v[0].V, 0.25f);
+    BOOST_CHECK_EQUAL(v[1].X, 30); BOOST_CHECK_EQUAL(v[1].Y, 20); BOOST_CHECK_EQUAL(v[1].U, 0.5f); BOOST_CHECK_EQUAL(v[1].V, 0.25f);
+    BOOST_CHECK_EQUAL(v[2].X, 30); BOOST_CHECK_EQUAL(v[2].Y, 40); BOOST_CHECK_EQUAL(v[2].U, 0.5f); BOOST_CHECK_EQUAL(v[2].V, 0.75f);
+    BOOST_CHECK_EQUAL(v[3].X, 10); BOOST_CHECK_EQUAL(v[3].Y, 40); BOOST_CHECK_EQUAL(v[3].U, 0.0f); BOOST_CHECK_EQUAL(v[3].V, 0.75f);
+
+    // 2つ目の矩形は頂点番号が4ずれる
+    const vector<uint16_t> expected = { 0, 1, 3, 3, 1, 2, 4, 5, 7, 7, 5, 6 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(batch.GetIndices().begin(), batch.GetIndices().end(), expected.begin(), expected.end());
+    BOOST_CHECK(flushed.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(NoteBlocks, BatchFixture)
+{
+    // 左端・中央2つ・右端の4ブロック
+    batch.AddNoteBlocks(MakeState(1, 0, 255), 100, 50, 16, 8, 4, 0.25f, 1.0f);
+    BOOST_REQUIRE_EQUAL(batch.GetQuadCount(), 4u);
+
+    const auto &v = batch.GetVertices();
+    const float lefts[] = { 100, 116, 132, 148 };
+    const float us[] = { 0.0f, 0.25f, 0.25f, 0.5f };
+    for (auto i = 0u; i < 4; i++) {
+        BOOST_TEST_CONTEXT("block " << i) {
+            BOOST_CHECK_EQUAL(v[i * 4].X, lefts[i]);
+            BOOST_CHECK_EQUAL(v[i * 4 + 2].X, lefts[i] + 16);
+            BOOST_CHECK_EQUAL(v[i * 4].Y, 46);
+            BOOST_CHECK_EQUAL(v[i * 4 + 2].Y, 54);
+            BOOST_CHECK_EQUAL(v[i * 4].U, us[i]);
+            BOOST_CHECK_EQUAL(v[i * 4 + 2].U, us[i] + 0.25f);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(SplitsOnStateChange, BatchFixture)
+{
+    const auto a = MakeState(1, 0, 255);
+    const auto otherTexture = MakeState(2, 0, 255);
+    const auto otherBlend = MakeState(2, 1, 255);
+    const auto otherParam = MakeState(2, 1, 128);
+
+    batch.AddQuad(a, 0, 0, 1, 1, 0, 0, 1, 1);
+    batch.AddQuad(a, 0, 0, 1, 1, 0, 0, 1, 1);
+    BOOST_CHECK(flushed.empty());
+
+    batch.AddQuad(otherTexture, 0, 0, 1, 1, 0, 0, 1, 1);
+    BOOST_REQUIRE_EQUAL(flushed.size(), 1u);
+    BOOST_CHECK(flushed[0].State == a);
+    BOOST_CHECK_EQUAL(flushed[0].Vertices.size(), 8u);
+    BOOST_CHECK_EQUAL(flushed[0].Indices.size(), 12u);
+
+    batch.AddQuad(otherBlend, 0, 0, 1, 1, 0, 0, 1, 1);
+    batch.AddQuad(otherParam, 0, 0, 1, 1, 0, 0, 1, 1);
+    BOOST_REQUIRE_EQUAL(flushed.size(), 3u);
+    BOOST_CHECK(flushed[1].State == otherTexture);
+    BOOST_CHECK(flushed[2].State == otherBlend);
+
+    // 新しいバッチの頂点番号は0から振り直す
+    BOOST_CHECK_EQUAL(batch.GetIndices().front(), 0);
+
+    batch.Flush();
+    BOOST_REQUIRE_EQUAL(flushed.size(), 4u);
+    BOOST_CHECK(flushed[3].State == otherParam);
+    BOOST_CHECK_EQUAL(batch.GetQuadCount(), 0u);
+    BOOST_CHECK_EQUAL(batch.GetFlushCount(), 4u);
+
+    // 空のときは何もしない
+    batch.Flush();
+    BOOST_CHECK_EQUAL(flushed.size(), 4u);
+}
+
+BOOST_FIXTURE_TEST_CASE(SplitsWhenIndicesOverflow, BatchFixture)
+{
+    const auto state = MakeState(1, 0, 255);
+    for (auto i = 0u; i < NoteSpriteBatch::MaxQuads; i++) batch.AddQuad(state, 0, 0, 1, 1, 0, 0, 1, 1);
+    BOOST_CHECK(flushed.empty());
+    BOOST_CHECK_EQUAL(batch.GetIndices().back(), 0xFFFE);
+
+    batch.AddQuad(state, 0, 0, 1, 1, 0, 0, 1, 1);
+    BOOST_REQUIRE_EQUAL(flushed.size(), 1u);
+    BOOST_CHECK_EQUAL(flushed[0].Vertices.size(), NoteSpriteBatch::MaxQuads * 4);
+    BOOST_CHECK_EQUAL(batch.GetQuadCount(), 1u);
+
+    // ブロックの列は途中で溢れるなら、列の前で区切る
+    batch.Flush();
+    flushed.clear();
+    for (auto i = 0u; i < NoteSpriteBatch::MaxQuads - 2; i++) batch.AddQuad(state, 0, 0, 1, 1, 0, 0, 1, 1);
+    batch.AddNoteBlocks(state, 0, 0, 1, 1, 4, 0.25f, 1.0f);
+    BOOST_REQUIRE_EQUAL(flushed.size(), 1u);
+    BOOST_CHECK_EQUAL(flushed[0].Vertices.size(), (NoteSpriteBatch::MaxQuads - 2) * 4);
+    BOOST_CHECK_EQUAL(batch.GetQuadCount(), 4u);
+}
@@ -0,0 +1,159 @@
+﻿#define BOOST_TEST_MODULE ReplayInputTest
+#include <boost/test/included/unit_test.hpp>
+#include <spdlog/sinks/null_sink.h>
+#include "ReplayInput.h"
+
+using namespace std;
+
+static const uint8_t airUp = 1 << size_t(AirControlSource::AirUp);
+static const uint8_t airDown = 1 << size_t(AirControlSource::AirDown);
+static const uint8_t airHold = 1 << size_t(AirControlSource::AirHold);
+static const uint8_t airAction = 1 << size_t(AirControlSource::AirAction);
+
+// Loadはspdlogの"main"にエラーを出す
+struct LoggerFixture {
+    LoggerFixture()
+    {
+        if (!spdlog::get("main")) spdlog::create<spdlog::sinks::null_sink_mt>("main");
+    }
+};
+BOOST_GLOBAL_FIXTURE(LoggerFixture);
+
+static bool LoadTimeline(ReplayInputTimeline &timeline, const string &text)
+{
+    istringstream stream(text);
+    return timeline.Load(stream);
+}
+
+BOOST_AUTO_TEST_CASE(ParseOptions)
+{
+    ReplayOptions options;
+    BOOST_CHECK(!ReplayOptions::Parse({ L"Seaurchin.exe" }, options));
+    BOOST_CHECK(!ReplayOptions::Parse({ L"Seaurchin.exe", L"--replay" }, options));
+
+    options = ReplayOptions();
+    BOOST_REQUIRE(ReplayOptions::Parse({ L"Seaurchin.exe", L"--replay", L"a.sus" }, options));
+    BOOST_CHECK(options.ScorePath == L"a.sus");
+    BOOST_CHECK(options.InputPath.empty());
+    BOOST_CHECK(options.OutputPath == L"a.sus.replay.txt");
+    BOOST_CHECK_CLOSE(options.Delta, 1.0 / 60.0, 1e-9);
+
+    options = ReplayOptions();
+    BOOST_REQUIRE(ReplayOptions::Parse({ L"Seaurchin.exe", L"--delta", L"0.001", L"--input", L"in.txt", L"--replay", L"b.sus", L"--output", L"out.txt" }, options));
+    BOOST_CHECK(options.ScorePath == L"b.sus");
+    BOOST_CHECK(options.InputPath == L"in.txt");
+    BOOST_CHECK(options.OutputPath == L"out.txt");
+    BOOST_CHECK_CLOSE(options.Delta, 0.001, 1e-9);
+
+    // 値の位置にある文字列はオプションとして扱わない
+    options = ReplayOptions();
+    BOOST_REQUIRE(ReplayOptions::Parse({ L"Seaurchin.exe", L"--output", L"--replay", L"--replay", L"c.sus" }, options));
+    BOOST_CHECK(options.OutputPath == L"--replay");
+    BOOST_CHECK(options.ScorePath == L"c.sus");
+}
+
+BOOST_AUTO_TEST_CASE(ParseTimeline)
+{
+    ReplayInputTimeline timeline;
+    BOOST_REQUIRE(LoadTimeline(timeline,
+        "# comment\n"
+        "\n"
+        "0.5 1000000000000001 UH\r\n"
+        "0.25 0100000000000000\n"
+        "1.0 0000000000000000 DA\n"));
+    BOOST_CHECK_EQUAL(timeline.GetSize(), 3u);
+
+    // 時刻順に並べ直される
+    auto snapshot = timeline.GetSnapshotUntil(0.3);
+    BOOST_CHECK_EQUAL(snapshot.Time, 0.3);
+    BOOST_CHECK_EQUAL(snapshot.Sliders, 1 << 1);
+    BOOST_CHECK_EQUAL(snapshot.Air, 0);
+
+    snapshot = timeline.GetSnapshotUntil(0.5);
+    BOOST_CHECK_EQUAL(snapshot.Sliders, 1 << 0 | 1 << 15);
+    BOOST_CHECK_EQUAL(snapshot.Air, airUp | airHold);
+
+    snapshot = timeline.GetSnapshotUntil(1.0);
+    BOOST_CHECK_EQUAL(snapshot.Sliders, 0);
+    BOOST_CHECK_EQUAL(snapshot.Air, airDown | airAction);
+}
+
+BOOST_AUTO_TEST_CASE(RejectsMalformedLines)
+{
+    const char *invalid[] = {
+        "x 0000000000000000\n",
+        "0.5\n",
+        "0.5 000000000000000\n",
+        "0.5 00000000000000000\n",
+        "0.5 0000000020000000\n",
+        "0.5 0000000000000000 X\n",
+        "0.5 0000000000000000 U extra\n",
+        "0.0 0000000000000000\n0.5 01\n",
+    };
+    for (const auto text : invalid) {
+        BOOST_TEST_CONTEXT("input: " << text) {
+            ReplayInputTimeline timeline;
+            BOOST_CHECK(!LoadTimeline(timeline, text));
+            BOOST_CHECK(timeline.IsEmpty());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MergesEdgesWithinFrame)
+{
+    ReplayInputTimeline timeline;
+    BOOST_REQUIRE(LoadTimeline(timeline,
+        "0.010 0000000000000000 U\n"
+        "0.012 0000000000000000 H\n"
+        "0.014 0000000000000000 A\n"
+        "0.020 0000000000000000\n"));
+
+    // 1フレームの間の立ち上がりは全部立つ
+    auto snapshot = timeline.GetSnapshotUntil(1.0 / 60.0);
+    BOOST_CHECK_EQUAL(snapshot.Air, airUp | airAction);
+
+    // 立ち上がりは次のフレームに残らない
+    snapshot = timeline.GetSnapshotUntil(2.0 / 60.0);
+    BOOST_CHECK_EQUAL(snapshot.Air, 0);
+}
+
+BOOST_AUTO_TEST_CASE(KeepsAirHold)
+{
+    ReplayInputTimeline timeline;
+    BOOST_REQUIRE(LoadTimeline(timeline,
+        "0.0 0000000000000000 UH\n"
+        "0.5 0000000000000000\n"));
+
+    auto snapshot = timeline.GetSnapshotUntil(0.1);
+    BOOST_CHECK_EQUAL(snapshot.Air, airUp | airHold);
+    // 次の入力まではHだけ残る
+    snapshot = timeline.GetSnapshotUntil(0.2);
+    BOOST_CHECK_EQUAL(snapshot.Air, airHold);
+    snapshot = timeline.GetSnapshotUntil(0.6);
+    BOOST_CHECK_EQUAL(snapshot.Air, 0);
+}
+
+BOOST_AUTO_TEST_CASE(KeepsShortSliderPress)
+{
+    ReplayInputTimeline timeline;
+    BOOST_REQUIRE(LoadTimeline(timeline,
+        "0.005 0000100000000000\n"
+        "0.010 0000000000000000\n"
+        "0.040 0000010000000000\n"));
+
+    // 1フレームの中で押して離しても、そのフレームは押している
+    auto snapshot = timeline.GetSnapshotUntil(1.0 / 60.0);
+    BOOST_CHECK_EQUAL(snapshot.Sliders, 1 << 4);
+    snapshot = timeline.GetSnapshotUntil(2.0 / 60.0);
+    BOOST_CHECK_EQUAL(snapshot.Sliders, 0);
+    snapshot = timeline.GetSnapshotUntil(3.0 / 60.0);
+    BOOST_CHECK_EQUAL(snapshot.Sliders, 1 << 5);
+
+    // 押しっぱなしは立ち上がりとして数え直さない
+    snapshot = timeline.GetSnapshotUntil(4.0 / 60.0);
+    BOOST_CHECK_EQUAL(snapshot.Sliders, 1 << 5);
+
+    timeline.Rewind();
+    snapshot = timeline.GetSnapshotUntil(0.0);
+    BOOST_CHECK_EQUAL(snapshot.Sliders, 0);
+}
@@ -0,0 +1,157 @@
+﻿#define BOOST_TEST_MODULE SusTokenizerTest
+#include <boost/test/included/unit_test.hpp>
+#include "SusAnalyzer.h"
+
+using namespace std;
+namespace b = boost;
+namespace xp = boost::xpressive;
+
+// 置き換える前のSusAnalyzerが使っていた正規表現
+static const xp::sregex regexSusCommand = "#" >> (xp::s1 = +xp::alnum) >> !(+xp::space >> (xp::s2 = +(~xp::_n)));
+static const xp::sregex regexSusData = "#" >> (xp::s1 = xp::repeat<3, 3>(xp::alnum)) >> (xp::s2 = xp::repeat<2, 3>(xp::alnum)) >> ":" >> *xp::space >> (xp::s3 = +(~xp::_n));
+
+// 行の分類と切り出した値 (どちらでもなければkind == 0)
+struct Tokens {
+    int kind = 0;
+    string first, second, third;
+};
+
+static ostream &operator<<(ostream &os, const Tokens &t)
+{
+    return os << t.kind << " [" << t.first << "] [" << t.second << "] [" << t.third << "]";
+}
+
+static bool operator==(const Tokens &a, const Tokens &b)
+{
+    return a.kind == b.kind && a.first == b.first && a.second == b.second && a.third == b.third;
+}
+
+static Tokens ByRegex(const string &line)
+{
+    Tokens result;
+    xp::smatch match;
+    if (xp::regex_match(line, match, regexSusCommand)) {
+        result.kind = 1;
+        result.first = match[1];
+        result.second = match[2];
+    } else if (xp::regex_match(line, match, regexSusData)) {
+        result.kind = 2;
+        result.first = match[1];
+        result.second = match[2];
+        result.third = match[3];
+    }
+    return result;
+}
+
+static Tokens ByTokenizer(const string &line)
+{
+    Tokens result;
+    b::string_view first, second, third;
+    if (TokenizeSusCommand(line, first, second)) {
+        result.kind = 1;
+        result.first = first.to_string();
+        result.second = second.to_string();
+    } else if (TokenizeSusData(line, first, second, third)) {
+        result.kind = 2;
+        result.first = first.to_string();
+        result.second = second.to_string();
+        result.third = third.to_string();
+    }
+    return result;
+}
+
+static const char *lines[] = {
+    // コマンド
+    "#TITLE \"test\"",
+    "#TITLE\t\"tab\"",
+    "#WAVEOFFSET -0.5",
+    "#REQUEST \"ticks_per_beat 480\"",
+    "#NOVALUE",
+    "#TITLE  \"two spaces\"",
+    "#A b",
+    "#BPM01 120",
+    "#TIL00 \"0'0:1.0\"",
+    "#HISPEED 00",
+    // 値が空白だけのコマンド: 正規表現はバックトラックで最後の空白を値にする
+    "#TITLE ",
+    "#TITLE  ",
+    "#TITLE   ",
+    "#TITLE \t",
+    "#TITLE\t\t\t",
+    // データ: 2文字・3文字のレーン
+    "#00010:1111",
+    "#00011:00000000",
+    "#000101:1010",
+    "#00020a:11",
+    "#012ab: 1 2",
+    "#00010:    11",
+    "#BPM01:120",
+    "#BPM01: 120",
+    "#00002:4",
+    "#00010:1111 ",
+    "#abcde:x",
+    "#abcdef:x",
+    // 値が空白だけのデータ
+    "#00010: ",
+    "#00010:  ",
+    "#000101:\t\t",
+    // どちらでもない
+    "#",
+    "#00010:",
+    "#000101:",
+    "#0001:11",
+    "#0001000:11",
+    "#00010 :11",
+    "#000-1:11",
+    "#TITLE:",
+    "# TITLE a",
+    "TITLE a",
+    "",
+    "#00010:1111\xE3\x81\x82",
+    "#\xE3\x81\x82 a",
+};
+
+BOOST_AUTO_TEST_CASE(MatchesRegexes)
+{
+    for (const auto line : lines) {
+        BOOST_TEST_CONTEXT("line: \"" << line << "\"") {
+            BOOST_CHECK_EQUAL(ByTokenizer(line), ByRegex(line));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(WhitespaceOnlyValues)
+{
+    Tokens command;
+    command.kind = 1;
+    command.first = "TITLE";
+    command.second = " ";
+    BOOST_CHECK_EQUAL(ByTokenizer("#TITLE  "), command);
+    command.second = "\t";
+    BOOST_CHECK_EQUAL(ByTokenizer("#TITLE \t"), command);
+
+    // 空白1つだけでは値にならないので、コマンドとしてもデータとしても解析できない
+    BOOST_CHECK_EQUAL(ByTokenizer("#TITLE ").kind, 0);
+
+    Tokens data;
+    data.kind = 2;
+    data.first = "000";
+    data.second = "10";
+    data.third = " ";
+    BOOST_CHECK_EQUAL(ByTokenizer("#00010: "), data);
+}
+
+BOOST_AUTO_TEST_CASE(LaneWidths)
+{
+    const auto two = ByTokenizer("#00010:1111");
+    BOOST_CHECK_EQUAL(two.first, "000");
+    BOOST_CHECK_EQUAL(two.second, "10");
+    BOOST_CHECK_EQUAL(two.third, "1111");
+
+    const auto three = ByTokenizer("#000101:1111");
+    BOOST_CHECK_EQUAL(three.first, "000");
+    BOOST_CHECK_EQUAL(three.second, "101");
+    BOOST_CHECK_EQUAL(three.third, "1111");
+
+    BOOST_CHECK_EQUAL(ByTokenizer("#0001000:1111").kind, 0);
+}